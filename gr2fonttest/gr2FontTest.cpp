@@ -409,7 +409,12 @@ bool Parameters::loadFromArgs(int argc, char *argv[])
                 else if (strcmp(argv[a], "-demand") == 0)
                 {
                     option = NONE;
-                    opts = gr_face_default;
+                    opts = gr_face_options(opts & ~gr_face_preloadAll);
+                }
+                else if (strcmp(argv[a], "-lazy") == 0)
+                {
+                    option = NONE;
+                    opts = gr_face_options(opts | gr_face_lazyRules);
                 }
                 else
                 {
@@ -789,6 +794,7 @@ int main(int argc, char *argv[])
         fprintf(stderr,"-log out.log\tSet log file to use rather than stdout\n");
         fprintf(stderr,"-trace trace.json\tDefine a file for the JSON trace log\n");
         fprintf(stderr,"-demand\tDemand load glyphs and cmap cache\n");
+        fprintf(stderr,"-lazy\tDecode each pass's rules when first run\n");
         fprintf(stderr,"-cache\tEnable Segment Cache\n");
         fprintf(stderr,"-bytes\tword size for character transfer [1,2,4] defaults to 4\n");
         return 1;
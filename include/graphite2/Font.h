@@ -62,6 +62,10 @@ enum gr_face_options {
     gr_face_preloadGlyphs = 2,
     /** Cache the lookup from code point to glyph ID at construction time */
     gr_face_cacheCmap = 4,
+    /** Check the structure of each pass at construction time but only decode its
+      * rules when a segment first runs the pass. A rule that fails to decode then
+      * makes segment creation fail instead of face creation. */
+    gr_face_lazyRules = 8,
     /** Preload everything */
     gr_face_preloadAll = gr_face_preloadGlyphs | gr_face_cacheCmap
 };
@@ -104,6 +108,26 @@ typedef const void *(*gr_get_table_fn)(const void* appFaceHandle, unsigned int n
   */
 typedef void (*gr_release_table_fn)(const void* appFaceHandle, const void *table_buffer);
 
+/** type describing a unit of work handed to a gr_run_tasks_fn
+  *
+  * @param task_data is the data pointer passed to gr_run_tasks_fn.
+  * @param index is the index of this task, in the range [0, num_tasks).
+  */
+typedef void (*gr_task_fn)(void *task_data, size_t index);
+
+/** type describing function to run a batch of independent tasks on a client task executor
+  *
+  * The function must call task(task_data, i) exactly once for each i in [0, num_tasks),
+  * in any order and possibly concurrently, and must not return until all the calls
+  * have completed.
+  *
+  * @param appFaceHandle is the unique information passed to gr_make_face()
+  * @param task is the function to run for each task.
+  * @param task_data is passed unchanged to each call of task.
+  * @param num_tasks is the number of tasks in the batch.
+  */
+typedef void (*gr_run_tasks_fn)(const void* appFaceHandle, gr_task_fn task, void *task_data, size_t num_tasks);
+
 /** struct housing function pointers to manage font table buffers for the graphite engine. */
 struct gr_face_ops
 {
@@ -113,7 +137,14 @@ struct gr_face_ops
 	gr_get_table_fn 	get_table;
         /** is a pointer to a function to notify the client the a table can be released.
           * This can be NULL to signify that the client does not wish to do any release handling. */
-	gr_release_table_fn	release_table;  
+	gr_release_table_fn	release_table;
+        /** is a pointer to a function to run independent tasks concurrently. If not
+          * NULL the engine may use it to split up work, such as reading the passes of
+          * a Silf subtable while the face loads, or collision fixing of independent
+          * ranges within a segment. Results, including any load error, are identical
+          * to the serial case. This can be NULL to signify that all work is done on the
+          * calling thread. */
+	gr_run_tasks_fn		run_tasks;
 };
 typedef struct gr_face_ops	gr_face_ops;
 
@@ -130,6 +161,23 @@ typedef struct gr_face_ops	gr_face_ops;
   */
 GR2_API gr_face* gr_make_face_with_ops(const void* appFaceHandle/*non-NULL*/, const gr_face_ops *face_ops, unsigned int faceOptions);
 
+/** Create a gr_face that shares all the font data loaded by another face.
+  *
+  * The new face takes almost no memory of its own: it has its own logger and
+  * error state, but its glyphs, cmap, features and Graphite tables are those
+  * of the original. The original stays alive until every face sharing its
+  * data has been destroyed, so it may be destroyed at any point. Faces sharing
+  * the same data may be created, destroyed and used to shape text on different
+  * threads at once, whatever options the original was made with: glyphs, cmap
+  * pages and rules that are read lazily are read once, by whichever thread
+  * needs them first. The data is shared within one process only; a face
+  * cannot be shared with another process.
+  *
+  * @return gr_face or NULL if face is NULL or memory is short.
+  * @param face          The face whose data to share.
+  */
+GR2_API gr_face* gr_make_shared_face(const gr_face *face);
+
 /** Create a gr_face object given application information and a getTable function. This function is deprecated as of v1.2.0 in
   * favour of gr_make_face_with_ops.
   *
@@ -225,6 +273,36 @@ GR2_API unsigned short gr_face_n_glyphs(const gr_face* pFace);
 /** Returns a faceinfo for the face and script **/
 GR2_API const gr_faceinfo *gr_face_info(const gr_face *pFace, gr_uint32 script);
 
+/** Memory held by a face, broken down by use. Sizes are in bytes. */
+struct gr_face_memory
+{
+    size_t size;            /**< size in bytes of this structure, set by the caller */
+    size_t glyphs;          /**< glyph metrics and attributes read so far */
+    size_t boxes;           /**< glyph octaboxes used in collision avoidance */
+    size_t cmap;            /**< the cmap cache when gr_face_cacheCmap is used */
+    size_t classes;         /**< Silf class maps, pseudo glyphs and justification levels */
+    size_t passes;          /**< pass state machines and rule code */
+    size_t segcache;        /**< the segment cache, if the face has one */
+    size_t tables;          /**< font tables the face decompressed and still holds */
+    size_t advances;        /**< glyph advance tables shared by fonts made from the face */
+    unsigned int glyphs_loaded; /**< number of glyphs read so far */
+    unsigned int glyphs_total;  /**< number of glyphs in the face */
+};
+typedef struct gr_face_memory gr_face_memory;
+
+/** Report how much memory a face is holding.
+  *
+  * A face made with gr_make_shared_face() reports the data it shares. The face
+  * must not be used on another thread during the call. Set usage->size to
+  * sizeof(gr_face_memory) first: no more than that many bytes are filled in,
+  * and size is set to the number that were.
+  *
+  * @return 0 if either argument is NULL, otherwise 1.
+  * @param pFace    face to report on
+  * @param usage    filled in with the face's memory usage
+  */
+GR2_API int gr_face_memory_usage(const gr_face *pFace, gr_face_memory *usage);
+
 /** Returns whether the font supports a given Unicode character
   *
   * @return true if the character is supported.
@@ -236,6 +314,10 @@ GR2_API int gr_face_is_char_supported(const gr_face *pFace, gr_uint32 usv, gr_ui
 
 #ifndef GRAPHITE2_NFILEFACE
 /** Create gr_face from a font file
+  *
+  * Where the platform supports it the file is mapped read-only into memory
+  * and tables are used in place, so the file must not be truncated or
+  * rewritten while the face exists.
   *
   * @return gr_face that accesses a font file directly. Returns NULL on failure.
   * @param filename Full path and filename to font file
@@ -270,6 +352,15 @@ GR2_API gr_font* gr_make_font(float ppm, const gr_face *face);
  */
 typedef float (*gr_advance_fn)(const void* appFontHandle, gr_uint16 glyphid);
 
+/** type describing function to retrieve the hinted advances of several glyphs in one call
+  *
+  * @param appFontHandle is the unique information passed to gr_make_font_with_ops()
+  * @param glyphids are the glyphs to retrieve the hinted advances for.
+  * @param advances receives the advance of each glyph in glyphids, in the same order.
+  * @param n is the number of glyphs in glyphids.
+  */
+typedef void (*gr_advances_fn)(const void* appFontHandle, const gr_uint16* glyphids, float* advances, size_t n);
+
 /** struct housing function pointers to manage font hinted metrics for the
   * graphite engine. */
 struct gr_font_ops
@@ -286,6 +377,13 @@ struct gr_font_ops
           * provide without client assistance.  This can be
           * NULL to signify no horizontal hinted metrics are necessary. */
     gr_advance_fn       glyph_advance_y;
+        /** a pointer to a function to retrieve the hinted
+          * advance widths of several glyphs at once. When
+          * given, each segment asks for all the advances it
+          * is missing in a single call before positioning.
+          * This can be NULL, in which case glyph_advance_x
+          * is called for each glyph as it is needed. */
+    gr_advances_fn      glyph_advances_x;
 };
 typedef struct gr_font_ops  gr_font_ops;
 
@@ -253,8 +253,9 @@ GR2_API size_t gr_count_unicode_characters(enum gr_encform enc, const void* buff
   *               which graphite table within the font to use. Maybe 0. Tag may be 4 chars
   *               NULL padded in LSBs or space padded in LSBs.
   * @param pFeats Pointer to a feature values to be used for the segment. Only one
-  *               feature values may be used for a segment. If NULL the default features
-  *               for the font will be used.
+  *               feature values may be used for a segment, use
+  *               gr_make_seg_with_feature_runs to vary them. If NULL the default
+  *               features for the font will be used.
   * @param enc Specifies what encoding form the string is in (utf8, utf16, utf32)
   * @param pStart Start of the string
   * @param nChars Number of unicode characters to process in the string. The string will
@@ -268,6 +269,39 @@ GR2_API size_t gr_count_unicode_characters(enum gr_encform enc, const void* buff
   */
 GR2_API gr_segment* gr_make_seg(const gr_font* font, const gr_face* face, gr_uint32 script, const gr_feature_val* pFeats, enum gr_encform enc, const void* pStart, size_t nChars, int dir);
 
+/** A run of characters in a segment that take their own feature values.
+  *
+  * @param feats Feature values for the characters in the run. If NULL the default
+  *              features for the font will be used.
+  * @param first Index of the first character in the run.
+  * @param length Number of characters in the run.
+  */
+typedef struct gr_feature_run
+{
+    const gr_feature_val* feats;
+    size_t first;
+    size_t length;
+} gr_feature_run;
+
+/** Creates and returns a segment whose characters may take different feature values.
+  *
+  * This works as gr_make_seg, except that each run of characters given in runs is
+  * shaped with that run's feature values and characters outside any run with pFeats.
+  * Where runs overlap, later runs take precedence. Runs may extend past the end of the
+  * text. A segment can hold up to 256 distinct feature values; if more are needed NULL
+  * is returned.
+  *
+  * @return a segment that needs seg_destroy called on it. May return NULL if bad problems
+  *     in segment processing.
+  * @param pFeats Feature values for characters outside any run. If NULL the default
+  *               features for the font will be used.
+  * @param runs Array of nRuns feature runs. May be NULL if nRuns is 0.
+  * @param nRuns Number of runs in runs.
+  *
+  * See gr_make_seg for the other parameters.
+  */
+GR2_API gr_segment* gr_make_seg_with_feature_runs(const gr_font* font, const gr_face* face, gr_uint32 script, const gr_feature_val* pFeats, const gr_feature_run* runs, size_t nRuns, enum gr_encform enc, const void* pStart, size_t nChars, int dir);
+
 /** Destroys a segment, freeing the memory.
   *
   * @param p The segment to destroy
@@ -326,6 +360,47 @@ GR2_API const gr_slot* gr_seg_last_slot(gr_segment* pSeg/*not NULL*/);    //may
   */
 GR2_API float gr_seg_justify(gr_segment* pSeg/*not NULL*/, const gr_slot* pStart/*not NULL*/, const gr_font *pFont, double width, enum gr_justFlags flags, const gr_slot* pFirst, const gr_slot* pLast);
 
+/** type describing function to retrieve the width available to a line
+  *
+  * @return double  The width in pixels of the given line
+  * @param appData  is the data pointer passed to gr_seg_break_lines()
+  * @param lineNum  is the number of the line, counting from 0
+  */
+typedef double (*gr_line_width_fn)(void *appData, unsigned int lineNum);
+
+/** Breaks a segment into lines and justifies each line
+  *
+  * The segment is walked once. Each line is broken before the last slot that fits the line
+  * width, at which the break weight is no worse than maxBreak. If there is no such slot,
+  * the line is broken before the last slot that fits and that a cursor may be placed before.
+  * The slot linked list is chopped at each break, as by gr_slot_linebreak_before(), and
+  * each line is then justified to its width as by gr_seg_justify(). The last line is only
+  * justified if justifyLast is set, otherwise it is just positioned. Only the slots of each
+  * line are repositioned, so the cost is linear in the length of the segment.
+  *
+  * The breaks are found from the glyphs the segment already has. Line end contextuals are
+  * handled as gr_seg_justify() handles them: while the font's justification passes run
+  * over a line, including a last line that is not justified, it has line end glyphs at
+  * both ends. The linebreak passes, which run only when a segment is made, are not rerun
+  * around each break, so glyphs those passes would choose differently at a line end are
+  * not changed; make a segment for each line if they are needed.
+  *
+  * @return unsigned int  The number of lines. If this is more than maxLines, only the first
+  *                 maxLines line starts are returned. An empty segment is one line, which
+  *                 starts at NULL. 0 if a line could not be justified, in which case the
+  *                 segment is left unbroken.
+  * @param pSeg     Pointer to the segment
+  * @param pFont    Font to use for positioning
+  * @param width    Width in pixels of every line, if widthFn is NULL
+  * @param widthFn  If not NULL, called to get the width of each line in turn
+  * @param appData  Passed to widthFn
+  * @param maxBreak The worst break weight to break a line at, say gr_breakWord
+  * @param justifyLast  If not zero, the last line is justified as well
+  * @param pLines   Array to receive the first slot of each line. May be NULL if maxLines is 0
+  * @param maxLines Number of entries in pLines
+  */
+GR2_API unsigned int gr_seg_break_lines(gr_segment* pSeg/*not NULL*/, const gr_font *pFont, double width, gr_line_width_fn widthFn, void *appData, int maxBreak, int justifyLast, const gr_slot** pLines, unsigned int maxLines);
+
 /** Returns the next slot along in the segment.
   *
   * Slots are held in a linked list. This returns the next in the linked list. The slot
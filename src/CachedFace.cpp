@@ -51,6 +51,13 @@ bool CachedFace::setupCache(unsigned int cacheSize)
 }
 
 
+void CachedFace::memoryUsage(gr_face_memory & usage) const
+{
+    Face::memoryUsage(usage);
+    if (m_cacheStore)
+        usage.segcache += m_cacheStore->memoryUsage(m_silfs);
+}
+
 bool CachedFace::runGraphite(Segment *seg, const Silf *pSilf) const
 {
     assert(pSilf);
@@ -59,7 +66,10 @@ bool CachedFace::runGraphite(Segment *seg, const Silf *pSilf) const
     unsigned int silfIndex = 0;
     for (; silfIndex < m_numSilf && &(m_silfs[silfIndex]) != pSilf; ++silfIndex);
     if (silfIndex == m_numSilf)  return false;
-    SegCache * const segCache = m_cacheStore->getOrCreate(silfIndex, seg->getFeatures(0));
+    if (seg->charInfoCount() == 0)  return true;
+    // each word is cached under the features of its characters
+    int segCacheFid = seg->charinfo(0)->fid();
+    SegCache * segCache = m_cacheStore->getOrCreate(silfIndex, seg->getFeatures(0));
     if (!segCache)
         return false;
 
@@ -81,19 +91,29 @@ bool CachedFace::runGraphite(Segment *seg, const Silf *pSilf) const
                     nextBreakWeight = (i + 1 < seg->charInfoCount())?
                             seg->charinfo(i+1)->breakWeight() : 0;
         const uint8 f = seg->charinfo(i)->flags();
+        // a word may not span characters with different features
+        const bool featsChange = i + 1 < seg->charInfoCount()
+                && seg->charinfo(i+1)->fid() != seg->charinfo(i)->fid();
         if (((spaceOnly
                 || (breakWeight > 0 && breakWeight <= gr_breakWord)
                 || i + 1 == seg->charInfoCount()
                 || ((nextBreakWeight < 0 && nextBreakWeight >= gr_breakBeforeWord)
                     || (subSegEndSlot->next() && m_cacheStore->isSpaceGlyph(subSegEndSlot->next()->gid()))))
                 && f != 1)
-            || f == 2)
+            || f == 2 || featsChange)
         {
             // record the next slot before any splicing
             Slot * nextSlot = subSegEndSlot->next();
             // spaces should be left untouched by graphite rules in any sane font
             if (!spaceOnly)
             {
+                if (seg->charinfo(subSegStart)->fid() != segCacheFid)
+                {
+                    segCacheFid = seg->charinfo(subSegStart)->fid();
+                    segCache = m_cacheStore->getOrCreate(silfIndex, seg->getFeatures(subSegStart));
+                    if (!segCache)
+                        return false;
+                }
                 // found a break position, check for a cache of the sub sequence
                 const SegCacheEntry * entry = segCache->find(cmapGlyphs, length);
                 // TODO disable cache for words at start/end of line with contextuals
@@ -25,6 +25,8 @@ License, as published by the Free Software Foundation, either version 2
 of the License or (at your option) any later version.
 */
 
+#include <cstring>
+
 #include "inc/Main.h"
 #include "inc/CmapCache.h"
 #include "inc/Face.h"
@@ -34,6 +36,12 @@ of the License or (at your option) any later version.
 
 using namespace graphite2;
 
+void Cmap::lookup(const uint32 * usv, uint16 * gids, size_t n) const throw()
+{
+    for (; n; --n)
+        *gids++ = (*this)[*usv++];
+}
+
 const void * bmp_subtable(const Face::Table & cmap)
 {
     const void * stbl;
@@ -57,87 +65,181 @@ const void * smp_subtable(const Face::Table & cmap)
     return 0;
 }
 
-template <unsigned int (*NextCodePoint)(const void *, unsigned int, int *),
-          uint16 (*LookupCodePoint)(const void *, unsigned int, int)>
-bool cache_subtable(uint16 * blocks[], const void * cst, const unsigned int limit)
+namespace
 {
-    int rangeKey = 0;
-    uint32          codePoint = NextCodePoint(cst, 0, &rangeKey),
-                    prevCodePoint = 0;
-    while (codePoint < limit)
+    // Shared by every block that maps no characters.
+    const uint16 empty_page[0x100] = {0};
+
+    // A block entry is either a pointer to its page, or, with the bottom bit
+    // set, the first of the consecutive glyph ids its characters map to.
+    inline uintptr linear_block(const uint16 gid) { return (uintptr(gid) << 1) | 1; }
+
+    template <int (*RangeKey)(const void *, unsigned int, unsigned int &, unsigned int &),
+              uint16 (*LookupCodePoint)(const void *, unsigned int, int)>
+    void fill_page(uint16 * glyphs, const void * cst, bool ordered, const uint32 base)
     {
-        unsigned int block = codePoint >> 8;
-        if (!blocks[block])
+        const uint32 limit = base + 0xFF;
+        if (!ordered)
         {
-            blocks[block] = grzeroalloc<uint16>(0x100);
-            if (!blocks[block])
-                return false;
+            for (uint32 usv = base; usv <= limit; ++usv)
+                if (const uint16 gid = LookupCodePoint(cst, usv, 0))
+                    glyphs[usv - base] = gid;
+            return;
+        }
+
+        for (uint32 usv = base; usv <= limit;)
+        {
+            unsigned int first, last;
+            const int key = RangeKey(cst, usv, first, last);
+            last = min(last, limit);
+            if (key >= 0)
+            {
+                for (; usv <= last; ++usv)
+                    if (const uint16 gid = LookupCodePoint(cst, usv, key))
+                        glyphs[usv - base] = gid;
+            }
+            usv = last + 1;
         }
-        blocks[block][codePoint & 0xFF] = LookupCodePoint(cst, codePoint, rangeKey);
-        // prevent infinite loop
-        if (codePoint <= prevCodePoint)
-            codePoint = prevCodePoint + 1;
-        prevCodePoint = codePoint;
-        codePoint =  NextCodePoint(cst, codePoint, &rangeKey);
     }
-    return true;
+
+    uint32 hash_page(const uint16 * glyphs)
+    {
+        uint32 h = 2166136261u;
+        for (const uint16 * const e = glyphs + 0x100; glyphs != e; ++glyphs)
+            h = (h ^ *glyphs) * 16777619u;
+        return h;
+    }
 }
 
 
 CachedCmap::CachedCmap(const Face & face)
-: m_isBmpOnly(true),
-  m_blocks(0)
+: m_cmap(face, Tag::cmap),
+  m_smp(smp_subtable(m_cmap)),
+  m_bmp(bmp_subtable(m_cmap)),
+  m_smpOrdered(m_smp && TtfUtil::CmapSubtable12Ordered(m_smp)),
+  m_bmpOrdered(m_bmp && TtfUtil::CmapSubtable4Ordered(m_bmp)),
+  m_numBlocks(0x100),
+  m_blocks(0),
+  m_lock(0)
 {
-    const Face::Table cmap(face, Tag::cmap);
-    if (!cmap)  return;
-
-    const void * bmp_cmap = bmp_subtable(cmap);
-    const void * smp_cmap = smp_subtable(cmap);
-    m_isBmpOnly = !smp_cmap;
+    if (!m_cmap)  return;
 
-    m_blocks = grzeroalloc<uint16 *>(m_isBmpOnly ? 0x100 : 0x1100);
-    if (m_blocks && smp_cmap)
+    if (m_smp)
     {
-        if (!cache_subtable<TtfUtil::CmapSubtable12NextCodepoint, TtfUtil::CmapSubtable12Lookup>(m_blocks, smp_cmap, 0x10FFFF))
-            return;
+        // Only index blocks up to the last one the subtable maps.
+        unsigned int first = 0x110000, last;
+        if (!m_smpOrdered || TtfUtil::CmapSubtable12RangeKey(m_smp, 0x10FFFF, first, last) >= 0)
+            first = 0x110000;
+        m_numBlocks = max(m_numBlocks, min(first + 0xFF, 0x110000u) >> 8);
     }
+    m_blocks = grzeroalloc<uintptr>(m_numBlocks);
+}
+
+CachedCmap::~CachedCmap() throw()
+{
+    for (const Page * p = m_pages.begin(); p != m_pages.end(); ++p)
+        free(p->glyphs);
+    free(m_blocks);
+}
+
+inline
+uint16 CachedCmap::glyph(const uint32 usv) const throw()
+{
+    const uint32 block = usv >> 8;
+    if (block >= m_numBlocks)
+        return 0;
+    // A page is published with store_release once it is filled in.
+    uintptr entry = load_acquire(m_blocks + block);
+    if (!entry)
+        entry = buildBlock(block);
+    return entry & 1 ? uint16((entry >> 1) + (usv & 0xFF))
+                     : reinterpret_cast<const uint16 *>(entry)[usv & 0xFF];
+}
 
-    if (m_blocks && bmp_cmap)
+uintptr CachedCmap::buildBlock(const uint32 block) const throw()
+{
+    // The page is filled outside the lock, which only guards interning it.
+    //  Where both subtables map a BMP character the format 4 one wins.
+    uint16 glyphs[0x100];
+    memset(glyphs, 0, sizeof glyphs);
+    if (m_smp)
+        fill_page<TtfUtil::CmapSubtable12RangeKey, TtfUtil::CmapSubtable12Lookup>(glyphs, m_smp, m_smpOrdered, block << 8);
+    if (m_bmp && block < 0x100)
+        fill_page<TtfUtil::CmapSubtable4RangeKey, TtfUtil::CmapSubtable4Lookup>(glyphs, m_bmp, m_bmpOrdered, block << 8);
+
+    while (compare_and_swap(&m_lock, 0, 1) != 0)
+        yield_thread();
+
+    uintptr entry = m_blocks[block];
+    if (!entry)
     {
-        if (!cache_subtable<TtfUtil::CmapSubtable4NextCodepoint, TtfUtil::CmapSubtable4Lookup>(m_blocks, bmp_cmap, 0xFFFF))
-            return;
+        entry = internPage(glyphs);
+        store_release(m_blocks + block, entry);
     }
+
+    compare_and_swap(&m_lock, 1, 0);
+    return entry ? entry : reinterpret_cast<uintptr>(empty_page);
 }
 
-CachedCmap::~CachedCmap() throw()
+uintptr CachedCmap::internPage(const uint16 * glyphs) const throw()
 {
-    if (!m_blocks) return;
-    unsigned int numBlocks = (m_isBmpOnly)? 0x100 : 0x1100;
-    for (unsigned int i = 0; i < numBlocks; i++)
-        free(m_blocks[i]);
-    free(m_blocks);
+    bool empty = true, linear = true;
+    for (int i = 0; i != 0x100; ++i)
+    {
+        empty &= !glyphs[i];
+        linear &= glyphs[i] == uint16(glyphs[0] + i);
+    }
+    if (empty)  return reinterpret_cast<uintptr>(empty_page);
+    if (linear) return linear_block(glyphs[0]);
+
+    const uint32 hash = hash_page(glyphs);
+    for (const Page * p = m_pages.begin(); p != m_pages.end(); ++p)
+        if (p->hash == hash && !memcmp(p->glyphs, glyphs, 0x100 * sizeof(uint16)))
+            return reinterpret_cast<uintptr>(p->glyphs);
+
+    Page page = { hash, gralloc<uint16>(0x100) };
+    if (!page.glyphs)   return 0;
+    memcpy(page.glyphs, glyphs, 0x100 * sizeof(uint16));
+    m_pages.push_back(page);
+    return reinterpret_cast<uintptr>(page.glyphs);
 }
 
 uint16 CachedCmap::operator [] (const uint32 usv) const throw()
 {
-    if ((m_isBmpOnly && usv > 0xFFFF) || (usv > 0x10FFFF))
-        return 0;
-    const uint32 block = 0xFFFF & (usv >> 8);
-    if (m_blocks[block])
-        return m_blocks[block][usv & 0xFF];
-    return 0;
-};
+    return glyph(usv);
+}
+
+void CachedCmap::lookup(const uint32 * usv, uint16 * gids, size_t n) const throw()
+{
+    for (; n; --n)
+        *gids++ = glyph(*usv++);
+}
 
 CachedCmap::operator bool() const throw()
 {
     return m_blocks != 0;
 }
 
+size_t CachedCmap::memoryUsage() const throw()
+{
+    while (compare_and_swap(&m_lock, 0, 1) != 0)
+        yield_thread();
+    size_t n = sizeof(CachedCmap) + m_cmap.memoryUsage()
+             + m_pages.capacity() * sizeof(Page)
+             + m_pages.size() * 0x100 * sizeof(uint16);
+    compare_and_swap(&m_lock, 1, 0);
+    if (m_blocks)
+        n += m_numBlocks * sizeof(uintptr);
+    return n;
+}
+
 
 DirectCmap::DirectCmap(const Face & face)
 : _cmap(face, Tag::cmap),
   _smp(smp_subtable(_cmap)),
-  _bmp(bmp_subtable(_cmap))
+  _bmp(bmp_subtable(_cmap)),
+  _smpOrdered(_smp && TtfUtil::CmapSubtable12Ordered(_smp)),
+  _bmpOrdered(_bmp && TtfUtil::CmapSubtable4Ordered(_bmp))
 {
 }
 
@@ -148,8 +250,52 @@ uint16 DirectCmap::operator [] (const uint32 usv) const throw()
             : TtfUtil::CmapSubtable4Lookup(_bmp, usv, 0);
 }
 
+void DirectCmap::lookup(const uint32 * usv, uint16 * gids, size_t n) const throw()
+{
+    // Text tends to stay within a script, so keep the segment the last character fell in
+    // and only search the subtable again once a character falls outside it. Characters
+    // from a subtable that isn't sorted are looked up one at a time.
+    unsigned int first = 1, last = 0;
+    int key = -1;
+    for (; n; --n, ++usv, ++gids)
+    {
+        const uint32 u = *usv;
+        if (u > 0xFFFF ? _smp && !_smpOrdered : !_bmpOrdered)
+        {
+            *gids = DirectCmap::operator [](u);
+            continue;
+        }
+        if (u < first || u > last)
+        {
+            if (u <= 0xFFFF)
+                key = TtfUtil::CmapSubtable4RangeKey(_bmp, u, first, last);
+            else
+            {
+                if (_smp)
+                    key = TtfUtil::CmapSubtable12RangeKey(_smp, u, first, last);
+                else
+                {
+                    key = -1;
+                    last = ~0u;
+                }
+                first = max(first, 0x10000u);
+            }
+        }
+        if (key < 0)
+            *gids = 0;
+        else
+            *gids = u > 0xFFFF ? TtfUtil::CmapSubtable12Lookup(_smp, u, key)
+                               : TtfUtil::CmapSubtable4Lookup(_bmp, u, key);
+    }
+}
+
 DirectCmap::operator bool () const throw()
 {
     return _cmap && _bmp;
 }
 
+size_t DirectCmap::memoryUsage() const throw()
+{
+    return sizeof(DirectCmap) + _cmap.memoryUsage();
+}
+
@@ -720,6 +720,13 @@ void Machine::Code::decoder::set_changed(int index) throw() {
 }
 
 
+// The bytes taken by the program and its data, whether they are our own or
+// part of a pass's program pool.
+size_t Machine::Code::memoryUsage() const throw()
+{
+    return _code ? ((_instr_count+1) + (_data_size + sizeof(instr)-1)/sizeof(instr))*sizeof(instr) : 0;
+}
+
 void Machine::Code::release_buffers() throw()
 {
     if (_own)
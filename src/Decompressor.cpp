@@ -61,33 +61,109 @@ bool read_sequence(u8 const * &src, u8 const * const end, u8 const * &literal, u
     return src <= end-5;
 }
 
+// Sequences with short literal and match lengths can be decoded with fixed
+// size copies and no bounds checks beyond the match distance, so long as
+// both buffers have at least this much room left.
+ptrdiff_t const     FAST_SRC_MARGIN = 32,
+                    FAST_DST_MARGIN = 64;
+
+// For a match closer than 8 bytes, a distance that is the smallest multiple
+// of the real one at least 8 bytes back reads the same repeating pattern.
+u8 const            pattern_dist[8] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+
+// Copy n bytes of match from dist bytes back, repeating it as the byte by
+//  byte copy would. May write up to 15 bytes beyond the end of the match.
+inline
+u8 * repeat_copy(u8 * d, u8 const * s, size_t n, u32 dist)
+{
+    u8 * const e = d + n;
+    if (dist < 8)
+    {
+        // Replicate the pattern byte by byte once, then copy the rest in
+        //  words from a whole number of repeats back.
+        for (int i = 0; i != 8; ++i) d[i] = s[i];
+        d += 8;
+        s = d - pattern_dist[dist];
+    }
+    if (dist >= 16)
+        do { unaligned_copy<16>(d, s); d += 16; s += 16; } while (d < e);
+    else
+        while (d < e) { unaligned_copy<8>(d, s); d += 8; s += 8; }
+    return e;
+}
+
 }
 
 int lz4::decompress(void const *in, size_t in_size, void *out, size_t out_size)
 {
-    if (out_size <= in_size || in_size < sizeof(unsigned long)+1)
+    size_t in_pos = 0, out_pos = 0;
+    return decompress(in, in_size, out, out_size, in_pos, out_pos, out_size);
+}
+
+int lz4::decompress(void const *in, size_t in_size, void *out, size_t out_size,
+                    size_t & in_pos, size_t & out_pos, size_t limit)
+{
+    if (out_size <= in_size || in_size < sizeof(unsigned long)+1
+            || in_pos > in_size || out_pos > out_size)
         return -1;
     
-    u8 const *       src     = static_cast<u8 const *>(in),
+    u8 const *       src     = static_cast<u8 const *>(in) + in_pos,
              *       literal = 0,
-             * const src_end = src + in_size;
+             * const src_end = static_cast<u8 const *>(in) + in_size;
+
+    u8 *       dst     = static_cast<u8*>(out) + out_pos,
+       * const dst_end = static_cast<u8*>(out) + out_size;
 
-    u8 *       dst     = static_cast<u8*>(out),
-       * const dst_end = dst + out_size;
+    // When asked for only part of the output we stop at the first sequence
+    //  boundary at or past the limit, and record where to carry on from.
+    bool const partial  = limit < out_size;
+    u8 * const dst_stop = partial ? static_cast<u8*>(out) + limit : dst_end;
     
     u32 literal_len = 0,
         match_len = 0,
         match_dist = 0;
     
-    while (read_sequence(src, src_end, literal, literal_len, match_len, match_dist))
+    for (;;)
     {
+        while (dst < dst_stop && src_end - src > FAST_SRC_MARGIN && dst_end - dst > FAST_DST_MARGIN)
+        {
+            u8 const token = *src;
+            if ((token >> 4) == 15 || (token & 0xf) == 15)
+                break;
+            literal_len = token >> 4;
+            match_len = (token & 0xf) + MINMATCH;
+
+            unaligned_copy<16>(dst, src + 1);
+            src += literal_len + 1;
+            dst += literal_len;
+
+            match_dist  = *src++;
+            match_dist |= *src++ << 8;
+            if (match_dist == 0 || match_dist > u32(dst - static_cast<u8*>(out)))
+                return -1;
+            dst = repeat_copy(dst, dst - match_dist, match_len, match_dist);
+        }
+
+        if (partial && dst >= dst_stop)
+        {
+            in_pos = src - static_cast<u8 const *>(in);
+            out_pos = dst - static_cast<u8*>(out);
+            return out_pos;
+        }
+
+        if (!read_sequence(src, src_end, literal, literal_len, match_len, match_dist))
+            break;
+
         if (literal_len != 0)
         {
             // Copy in literal. At this point the last full sequence must be at
             // least MINMATCH + 5 from the end of the output buffer.
             if (align(literal_len) > unsigned(dst_end - dst - (MINMATCH+5)) || dst_end - dst < MINMATCH + 5)
                 return -1;
-            dst = overrun_copy(dst, literal, literal_len);
+            if (literal_len + 16 <= unsigned(dst_end - dst) && literal_len + 16 <= unsigned(src_end - literal))
+                dst = repeat_copy(dst, literal, literal_len, 16);
+            else
+                dst = overrun_copy(dst, literal, literal_len);
         }
         
         // Copy, possibly repeating, match from earlier in the
@@ -98,10 +174,9 @@ int lz4::decompress(void const *in, size_t in_size, void *out, size_t out_size)
                   || match_len > unsigned(dst_end - dst - (MINMATCH+5))
                   || dst_end - dst < MINMATCH + 5)
             return -1;
-        if (dst > pcpy+sizeof(unsigned long) 
-            && dst + align(match_len + MINMATCH) <= dst_end)
-            dst = overrun_copy(dst, pcpy, match_len + MINMATCH);
-        else 
+        if (match_len + MINMATCH + 16 <= unsigned(dst_end - dst))
+            dst = repeat_copy(dst, pcpy, match_len + MINMATCH, match_dist);
+        else
             dst = safe_copy(dst, pcpy, match_len + MINMATCH);
     }
     
@@ -110,6 +185,39 @@ int lz4::decompress(void const *in, size_t in_size, void *out, size_t out_size)
         return -1;
     dst = fast_copy(dst, literal, literal_len);
     
-    return dst - (u8*)out;
+    in_pos = in_size;
+    out_pos = dst - (u8*)out;
+    return out_pos;
 }
 
+int lz4::check(void const *in, size_t in_size, size_t out_size)
+{
+    if (out_size <= in_size || in_size < sizeof(unsigned long)+1)
+        return -1;
+
+    u8 const *       src     = static_cast<u8 const *>(in),
+             *       literal = 0,
+             * const src_end = src + in_size;
+    size_t  dst = 0;
+    u32 literal_len = 0,
+        match_len = 0,
+        match_dist = 0;
+
+    // The same tests decompress makes, in the same order.
+    while (read_sequence(src, src_end, literal, literal_len, match_len, match_dist))
+    {
+        if (literal_len != 0
+                && (out_size - dst < MINMATCH + 5 || align(literal_len) > out_size - dst - (MINMATCH+5)))
+            return -1;
+        dst += literal_len;
+        if (match_dist == 0 || match_dist > dst
+                || out_size - dst < MINMATCH + 5 || match_len > out_size - dst - (MINMATCH+5))
+            return -1;
+        dst += match_len + MINMATCH;
+    }
+
+    if (literal_len > size_t(src_end - literal)
+              || literal_len > out_size - dst)
+        return -1;
+    return dst + literal_len;
+}
@@ -49,8 +49,22 @@ enum compression
     LZ4
 };
 
+// How many advance tables no font is using a face keeps for fonts to come.
+const int MAX_SPARE_ADVANCES = 4;
+
 }
 
+// A table of every glyph's advance at one scale, shared by the fonts at that
+// scale. It is filled when made and never changes after.
+struct Face::Advances
+{
+    Advances  * next;
+    float       scale;
+    long        refs;
+
+    float * values() { return reinterpret_cast<float *>(this + 1); }
+};
+
 Face::Face(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops)
 : m_appFaceHandle(appFaceHandle),
   m_pFileFace(NULL),
@@ -58,6 +72,11 @@ Face::Face(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops)
   m_cmap(NULL),
   m_pNames(NULL),
   m_logger(NULL),
+  m_silfTable(NULL),
+  m_base(NULL),
+  m_refs(1),
+  m_advances(NULL),
+  m_advancesLock(0),
   m_error(0), m_errcntxt(0),
   m_silfs(NULL),
   m_numSilf(0),
@@ -69,23 +88,132 @@ Face::Face(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops)
 }
 
 
+// Share everything read from the font with base, which is kept alive until
+// this face goes. Only the logger, error state and name table are our own.
+Face::Face(const Face * base)
+: m_ops(base->m_ops),
+  m_appFaceHandle(base->m_appFaceHandle),
+  m_pFileFace(NULL),
+  m_pGlyphFaceCache(base->m_pGlyphFaceCache),
+  m_cmap(base->m_cmap),
+  m_pNames(NULL),
+  m_logger(NULL),
+  m_silfTable(NULL),
+  m_base(base->m_base ? base->m_base : base),
+  m_refs(1),
+  m_advances(NULL),
+  m_advancesLock(0),
+  m_error(0), m_errcntxt(0),
+  m_silfs(base->m_silfs),
+  m_numSilf(base->m_numSilf),
+  m_ascent(base->m_ascent),
+  m_descent(base->m_descent)
+{
+    atomic_add(&m_base->m_refs, 1);
+}
+
+
 Face::~Face()
 {
     setLogger(0);
-    delete m_pGlyphFaceCache;
-    delete m_cmap;
-    delete[] m_silfs;
+    if (m_base)
+        m_base->release();
+    else
+    {
+        delete m_pGlyphFaceCache;
+        delete m_cmap;
+        delete[] m_silfs;
+        delete m_silfTable;
+        while (m_advances)
+        {
+            Advances * const a = m_advances;
+            m_advances = a->next;
+            free(a);
+        }
+    }
 #ifndef GRAPHITE2_NFILEFACE
     delete m_pFileFace;
 #endif
     delete m_pNames;
 }
 
-float Face::default_glyph_advance(const void* font_ptr, gr_uint16 glyphid)
+void Face::release() const
 {
-    const Font & font = *reinterpret_cast<const Font *>(font_ptr);
+    if (atomic_add(&m_refs, -1) == 0)
+        delete this;
+}
+
+const float * Face::acquireAdvances(float scale) const
+{
+    if (m_base)
+        return m_base->acquireAdvances(scale);
+
+    // The table is filled outside the lock, so other threads making fonts
+    //  only wait while the list is searched. If one made a table at the same
+    //  scale meanwhile, that is used and ours freed.
+    Advances * made = 0;
+    for (;;)
+    {
+        while (compare_and_swap(&m_advancesLock, 0, 1) != 0)
+            yield_thread();
 
-    return font.face().glyphs().glyph(glyphid)->theAdvance().x * font.scale();
+        Advances * a = m_advances;
+        for (; a && a->scale != scale; a = a->next) {}
+        if (!a && made)
+        {
+            made->next = m_advances;
+            m_advances = a = made;
+            made = 0;
+        }
+        if (a)
+            ++a->refs;
+
+        compare_and_swap(&m_advancesLock, 1, 0);
+        if (a)
+        {
+            free(made);
+            return a->values();
+        }
+
+        const uint16 n = m_pGlyphFaceCache->numGlyphs();
+        made = reinterpret_cast<Advances *>(gralloc<char>(sizeof(Advances) + n * sizeof(float)));
+        if (!made)
+            return 0;
+        m_pGlyphFaceCache->advances(scale, made->values());
+        made->scale = scale;
+        made->refs = 0;
+    }
+}
+
+void Face::releaseAdvances(const float * advances) const
+{
+    if (m_base)
+    {
+        m_base->releaseAdvances(advances);
+        return;
+    }
+
+    while (compare_and_swap(&m_advancesLock, 0, 1) != 0)
+        yield_thread();
+
+    // Keep a few tables no font uses, for fonts made later at the same scale,
+    //  and free the least recently made of the rest.
+    int spare = 0;
+    for (Advances * * p = &m_advances; *p;)
+    {
+        Advances * const a = *p;
+        if (a->values() == advances)
+            --a->refs;
+        if (a->refs == 0 && ++spare > MAX_SPARE_ADVANCES)
+        {
+            *p = a->next;
+            free(a);
+        }
+        else
+            p = &a->next;
+    }
+
+    compare_and_swap(&m_advancesLock, 1, 0);
 }
 
 bool Face::readGlyphs(uint32 faceOptions)
@@ -93,6 +221,7 @@ bool Face::readGlyphs(uint32 faceOptions)
     Error e;
 #ifdef GRAPHITE2_TELEMETRY
     telemetry::category _glyph_cat(tele.glyph);
+    telemetry::phase _glyph_phase(tele.time.glyphs);
 #endif
     error_context(EC_READGLYPHS);
     m_pGlyphFaceCache = new GlyphCache(*this, faceOptions);
@@ -104,10 +233,15 @@ bool Face::readGlyphs(uint32 faceOptions)
         return error(e);
     }
 
-    if (faceOptions & gr_face_cacheCmap)
-        m_cmap = new CachedCmap(*this);
-    else
-        m_cmap = new DirectCmap(*this);
+    {
+#ifdef GRAPHITE2_TELEMETRY
+        telemetry::phase _cmap_phase(tele.time.cmap);
+#endif
+        if (faceOptions & gr_face_cacheCmap)
+            m_cmap = new CachedCmap(*this);
+        else
+            m_cmap = new DirectCmap(*this);
+    }
     if (e.test(!m_cmap, E_OUTOFMEM) || e.test(!*m_cmap, E_BADCMAP))
         return error(e);
 
@@ -117,10 +251,11 @@ bool Face::readGlyphs(uint32 faceOptions)
     return true;
 }
 
-bool Face::readGraphite(const Table & silf)
+bool Face::readGraphite(const Table & silf, uint32 faceOptions)
 {
 #ifdef GRAPHITE2_TELEMETRY
     telemetry::category _silf_cat(tele.silf);
+    telemetry::phase _silf_phase(tele.time.silf);
 #endif
     Error e;
     error_context(EC_READSILF);
@@ -146,21 +281,61 @@ bool Face::readGraphite(const Table & silf)
         if (e.test(next > silf.size() || offset >= next, E_BADSIZE))
             return error(e);
 
-        if (!m_silfs[i].readGraphite(silf + offset, next - offset, *this, version))
+        if (!m_silfs[i].readGraphite(silf + offset, next - offset, *this, version,
+                                     faceOptions & gr_face_lazyRules))
             return false;
 
         if (m_silfs[i].numPasses())
             havePasses = true;
     }
 
+    {
+#ifdef GRAPHITE2_TELEMETRY
+        telemetry::category _glyph_cat(tele.glyph);
+#endif
+        Vector<uint16> attrs;
+        for (int i = 0; i < m_numSilf; i++)
+            m_silfs[i].hotAttrs(attrs);
+        if (e.test(!m_pGlyphFaceCache->cacheAttrs(attrs), E_OUTOFMEM))
+            return error(e);
+    }
+
+    // Take the table over, passes that decode their rules lazily point into it.
+    if (havePasses && (faceOptions & gr_face_lazyRules))
+    {
+        m_silfTable = new Table(silf);
+        if (e.test(!m_silfTable, E_OUTOFMEM)) return error(e);
+    }
+
     return havePasses;
 }
 
 bool Face::readFeatures()
 {
+#ifdef GRAPHITE2_TELEMETRY
+    telemetry::phase _features_phase(tele.time.features);
+#endif
     return m_Sill.readFace(*this);
 }
 
+void Face::memoryUsage(gr_face_memory & usage) const
+{
+    if (m_base)
+    {
+        m_base->memoryUsage(usage);
+        return;
+    }
+    m_pGlyphFaceCache->memoryUsage(usage);
+    if (m_cmap)
+        usage.cmap += m_cmap->memoryUsage();
+    for (int i = 0; i < m_numSilf; i++)
+        m_silfs[i].memoryUsage(usage);
+    if (m_silfTable)
+        usage.tables += m_silfTable->memoryUsage();
+    for (const Advances * a = m_advances; a; a = a->next)
+        usage.advances += sizeof(Advances) + m_pGlyphFaceCache->numGlyphs() * sizeof(float);
+}
+
 bool Face::runGraphite(Segment *seg, const Silf *aSilf) const
 {
 #if !defined GRAPHITE2_NTRACING
@@ -233,6 +408,15 @@ uint16 Face::findPseudo(uint32 uid) const
     return (m_numSilf) ? m_silfs[0].findPseudo(uid) : 0;
 }
 
+void Face::runTasks(gr_task_fn task, void * data, size_t n) const
+{
+    if (m_ops.run_tasks && n > 1)
+        (*m_ops.run_tasks)(m_appFaceHandle, task, data, n);
+    else
+        for (size_t i = 0; i != n; ++i)
+            (*task)(data, i);
+}
+
 int32 Face::getGlyphMetric(uint16 gid, uint8 metric) const
 {
     switch (metrics(metric))
@@ -275,9 +459,12 @@ uint16 Face::languageForLocale(const char * locale) const
 
 
 
-Face::Table::Table(const Face & face, const Tag n, uint32 version) throw()
-: _f(&face), _compressed(false)
+Face::Table::Table(const Face & face, const Tag n, uint32 version, bool lazy) throw()
+: _f(&face), _compressed(false), _src(0), _src_sz(0), _src_pos(0), _decoded(0)
 {
+#ifdef GRAPHITE2_TELEMETRY
+    telemetry::phase _table_phase(_f->tele.time.tables);
+#endif
     size_t sz = 0;
     _p = static_cast<const byte *>((*_f->m_ops.get_table)(_f->m_appFaceHandle, n, &sz));
     _sz = uint32(sz);
@@ -288,8 +475,9 @@ Face::Table::Table(const Face & face, const Tag n, uint32 version) throw()
         return;
     }
 
+    _decoded = _sz;
     if (be::peek<uint32>(_p) >= version)
-        decompress();
+        decompress(lazy);
 }
 
 void Face::Table::releaseBuffers()
@@ -298,7 +486,15 @@ void Face::Table::releaseBuffers()
         free(const_cast<byte *>(_p));
     else if (_p && _f->m_ops.release_table)
         (*_f->m_ops.release_table)(_f->m_appFaceHandle, _p);
-    _p = 0; _sz = 0;
+    releaseSource();
+    _p = 0; _sz = 0; _decoded = 0;
+}
+
+void Face::Table::releaseSource() const
+{
+    if (_src && _f->m_ops.release_table)
+        (*_f->m_ops.release_table)(_f->m_appFaceHandle, _src);
+    _src = 0;
 }
 
 Face::Table & Face::Table::operator = (const Table & rhs) throw()
@@ -310,13 +506,18 @@ Face::Table & Face::Table::operator = (const Table & rhs) throw()
     return *this;
 }
 
-Error Face::Table::decompress()
+Error Face::Table::decompress(bool lazy)
 {
+#ifdef GRAPHITE2_TELEMETRY
+    telemetry::phase _decompress_phase(_f->tele.time.decompress);
+#endif
     Error e;
     if (e.test(_sz < 5 * sizeof(uint32), E_BADSIZE))
         return e;
     byte * uncompressed_table = 0;
-    size_t uncompressed_size = 0;
+    size_t uncompressed_size = 0,
+           in_pos = 0,
+           out_pos = 0;
 
     const byte * p = _p;
     const uint32 version = be::read<uint32>(p);    // Table version number.
@@ -336,7 +537,14 @@ Error Face::Table::decompress()
             memset(uncompressed_table, 0, 4);   // make sure version number is initialised
             // coverity[forward_null : FALSE] - uncompressed_table has been checked so can't be null
             // coverity[checked_return : FALSE] - we test e later
-            e.test(lz4::decompress(p, _sz - 2*sizeof(uint32), uncompressed_table, uncompressed_size) != signed(uncompressed_size), E_SHRINKERFAILED);
+            // Check the whole block now, so a bad one fails the face as it
+            //  would without lazy decompression.
+            if (lazy)
+                e.test(lz4::check(p, _sz - 2*sizeof(uint32), uncompressed_size) != signed(uncompressed_size)
+                    || lz4::decompress(p, _sz - 2*sizeof(uint32), uncompressed_table, uncompressed_size,
+                                       in_pos, out_pos, sizeof(uint32)) < signed(sizeof(uint32)), E_SHRINKERFAILED);
+            else
+                e.test(lz4::decompress(p, _sz - 2*sizeof(uint32), uncompressed_table, uncompressed_size) != signed(uncompressed_size), E_SHRINKERFAILED);
         }
         break;
     }
@@ -351,20 +559,48 @@ Error Face::Table::decompress()
         // coverity[checked_return : FALSE] - we test e later
         e.test(be::peek<uint32>(uncompressed_table) != version, E_SHRINKERFAILED);
 
-    // Tell the provider to release the compressed form since were replacing
-    //   it anyway.
-    releaseBuffers();
+    // Keep the compressed form to carry on from if we've only decompressed
+    //  the start of it, otherwise tell the provider to release it since we're
+    //  replacing it anyway.
+    if (!e && lazy && out_pos < uncompressed_size)
+    {
+        _src = _p;
+        _src_sz = _sz;
+        _src_pos = in_pos;
+    }
+    else
+    {
+        releaseBuffers();
+        out_pos = uncompressed_size;
+    }
 
     if (e)
     {
         free(uncompressed_table);
         uncompressed_table = 0;
         uncompressed_size  = 0;
+        out_pos = 0;
     }
 
     _p = uncompressed_table;
     _sz = uncompressed_size;
+    _decoded = out_pos;
     _compressed = true;
 
     return e;
 }
+
+bool Face::Table::decompressTo(size_t end) const throw()
+{
+#ifdef GRAPHITE2_TELEMETRY
+    telemetry::phase _decompress_phase(_f->tele.time.decompress);
+#endif
+    const size_t in_size = _src_sz - 2*sizeof(uint32);
+    if (lz4::decompress(_src + 2*sizeof(uint32), in_size, const_cast<byte *>(_p), _sz,
+                        _src_pos, _decoded, end) < 0)
+        _decoded = 0;
+    // Once the block is finished, or turns out to be bad, we're done with it.
+    if (_src_pos >= in_size || _decoded == 0)
+        releaseSource();
+    return end <= _decoded;
+}
@@ -235,21 +235,44 @@ bool SillMap::readSill(const Face & face)
         m_langFeats[i].m_lang = langid;
         m_langFeats[i].m_pFeatures = feats;
     }
+
+    if (!m_numLanguages) return true;
+    // Where a language appears twice the first entry wins, so ties are
+    // broken by position.
+    m_langIndex = gralloc<LangIndex>(m_numLanguages);
+    if (!m_langIndex) return false;
+    for (uint16 i = 0; i < m_numLanguages; ++i)
+    {
+        m_langIndex[i].lang = m_langFeats[i].m_lang;
+        m_langIndex[i].index = i;
+    }
+    qsort(m_langIndex, m_numLanguages, sizeof(LangIndex), &cmpLangIndex);
     return true;
 }
 
 
+int SillMap::cmpLangIndex(const void *ap, const void *bp)
+{
+    const LangIndex & a = *static_cast<const LangIndex *>(ap),
+                    & b = *static_cast<const LangIndex *>(bp);
+    if (a.lang != b.lang)   return a.lang < b.lang ? -1 : 1;
+    return a.index < b.index ? -1 : (a.index > b.index ? 1 : 0);
+}
+
 Features* SillMap::cloneFeatures(uint32 langname/*0 means default*/) const
 {
-    if (langname)
+    if (langname && m_langIndex)
     {
-        // the number of languages in a font is usually small e.g. 8 in Doulos
-        // so this loop is not very expensive
-        for (uint16 i = 0; i < m_numLanguages; i++)
+        const LangIndex * lo = m_langIndex,
+                        * hi = m_langIndex + m_numLanguages;
+        while (lo < hi)
         {
-            if (m_langFeats[i].m_lang == langname)
-                return new Features(*m_langFeats[i].m_pFeatures);
+            const LangIndex * const mid = lo + (hi - lo) / 2;
+            if (mid->lang < langname)   lo = mid + 1;
+            else                        hi = mid;
         }
+        if (lo != m_langIndex + m_numLanguages && lo->lang == langname)
+            return new Features(*m_langFeats[lo->index].m_pFeatures);
     }
     return new Features (m_FeatureMap.m_defaultFeatures);
 }
@@ -258,12 +281,16 @@ Features* SillMap::cloneFeatures(uint32 langname/*0 means default*/) const
 
 const FeatureRef *FeatureMap::findFeatureRef(uint32 name) const
 {
-    NameAndFeatureRef *it;
-    
-    for (it = m_pNamedFeats; it < m_pNamedFeats + m_numFeats; ++it)
-        if (it->m_name == name)
-            return it->m_pFRef;
-    return NULL;
+    // m_pNamedFeats is sorted by name when the features are read.
+    const NameAndFeatureRef * lo = m_pNamedFeats,
+                            * hi = m_pNamedFeats + m_numFeats;
+    while (lo < hi)
+    {
+        const NameAndFeatureRef * const mid = lo + (hi - lo) / 2;
+        if (mid->m_name < name) lo = mid + 1;
+        else                    hi = mid;
+    }
+    return lo != m_pNamedFeats + m_numFeats && lo->m_name == name ? lo->m_pFRef : NULL;
 }
 
 bool FeatureRef::applyValToFeature(uint32 val, Features & pDest) const
@@ -275,10 +302,9 @@ bool FeatureRef::applyValToFeature(uint32 val, Features & pDest) const
     else
       if (pDest.m_pMap!=&m_pFace->theSill().theFeatureMap())
         return false;       //incompatible
-    if (m_index >= pDest.size())
-        pDest.resize(m_index+1);
-    pDest[m_index] &= ~m_mask;
-    pDest[m_index] |= (uint32(val) << m_bits);
+    if (m_index >= pDest.size() && !pDest.resize(m_index+1))
+        return false;
+    pDest.set(m_index, (pDest[m_index] & ~m_mask) | (uint32(val) << m_bits));
     return true;
 }
 
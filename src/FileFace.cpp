@@ -30,11 +30,20 @@ of the License or (at your option) any later version.
 
 #ifndef GRAPHITE2_NFILEFACE
 
+#if defined _WIN32
+#include <windows.h>
+#include <io.h>
+#elif defined __unix__ || defined __APPLE__
+#include <sys/mman.h>
+#define GRAPHITE2_FILEMAP
+#endif
+
 using namespace graphite2;
 
 FileFace::FileFace(const char *filename)
 : _file(fopen(filename, "rb")),
   _file_len(0),
+  _map(NULL),
   _header_tbl(NULL),
   _table_dir(NULL)
 {
@@ -46,6 +55,23 @@ FileFace::FileFace(const char *filename)
 
     size_t tbl_offset, tbl_len;
 
+    // Table requests are served straight from a mapping of the file where we
+    // can make one, so we never need the stdio handle again.
+    if (map_file())
+    {
+        fclose(_file);
+        _file = NULL;
+
+        if (!TtfUtil::GetHeaderInfo(tbl_offset, tbl_len) || tbl_offset > _file_len || tbl_len > _file_len - tbl_offset)
+            return;
+        _header_tbl = (TtfUtil::Sfnt::OffsetSubTable*)(_map + tbl_offset);
+        if (!TtfUtil::CheckHeader(_header_tbl)) return;
+        if (!TtfUtil::GetTableDirInfo(_header_tbl, tbl_offset, tbl_len) || tbl_offset > _file_len || tbl_len > _file_len - tbl_offset)
+            return;
+        _table_dir = (TtfUtil::Sfnt::OffsetSubTable::Entry*)(_map + tbl_offset);
+        return;
+    }
+
     // Get the header.
     if (!TtfUtil::GetHeaderInfo(tbl_offset, tbl_len)) return;
     if (fseek(_file, tbl_offset, SEEK_SET)) return;
@@ -70,13 +96,59 @@ FileFace::FileFace(const char *filename)
 
 FileFace::~FileFace()
 {
-    free(_table_dir);
-    free(_header_tbl);
+    if (_map)
+        unmap_file();
+    else
+    {
+        free(_table_dir);
+        free(_header_tbl);
+    }
     if (_file)
         fclose(_file);
 }
 
 
+#if defined _WIN32
+
+bool FileFace::map_file()
+{
+    if (_file_len == 0) return false;
+    HANDLE mapping = CreateFileMapping(HANDLE(_get_osfhandle(_fileno(_file))), NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return false;
+    _map = static_cast<const byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);       // the view keeps the mapping alive
+    return _map != NULL;
+}
+
+void FileFace::unmap_file()
+{
+    UnmapViewOfFile(_map);
+}
+
+#elif defined GRAPHITE2_FILEMAP
+
+bool FileFace::map_file()
+{
+    if (_file_len == 0) return false;
+    void * const p = mmap(NULL, _file_len, PROT_READ, MAP_SHARED, fileno(_file), 0);
+    if (p == MAP_FAILED) return false;
+    _map = static_cast<const byte *>(p);
+    return true;
+}
+
+void FileFace::unmap_file()
+{
+    munmap(const_cast<byte *>(_map), _file_len);
+}
+
+#else
+
+bool FileFace::map_file() { return false; }
+void FileFace::unmap_file() {}
+
+#endif
+
+
 const void *FileFace::get_table_fn(const void* appFaceHandle, unsigned int name, size_t *len)
 {
     if (appFaceHandle == 0)     return 0;
@@ -87,8 +159,16 @@ const void *FileFace::get_table_fn(const void* appFaceHandle, unsigned int name,
     if (!TtfUtil::GetTableInfo(name, file_face._header_tbl, file_face._table_dir, tbl_offset, tbl_len))
         return 0;
 
-    if (tbl_offset > file_face._file_len || tbl_len > file_face._file_len - tbl_offset
-            || fseek(file_face._file, tbl_offset, SEEK_SET) != 0)
+    if (tbl_offset > file_face._file_len || tbl_len > file_face._file_len - tbl_offset)
+        return 0;
+
+    if (file_face._map)
+    {
+        if (len) *len = tbl_len;
+        return file_face._map + tbl_offset;
+    }
+
+    if (fseek(file_face._file, tbl_offset, SEEK_SET) != 0)
         return 0;
 
     tbl = malloc(tbl_len);
@@ -106,10 +186,12 @@ void FileFace::rel_table_fn(const void* appFaceHandle, const void *table_buffer)
 {
     if (appFaceHandle == 0)     return;
 
-    free(const_cast<void *>(table_buffer));
+    // Mapped tables live as long as the face does.
+    if (!static_cast<const FileFace *>(appFaceHandle)->_map)
+        free(const_cast<void *>(table_buffer));
 }
 
-const gr_face_ops FileFace::ops = { sizeof FileFace::ops, &FileFace::get_table_fn, &FileFace::rel_table_fn };
+const gr_face_ops FileFace::ops = { sizeof FileFace::ops, &FileFace::get_table_fn, &FileFace::rel_table_fn, NULL };
 
 
 #endif                  //!GRAPHITE2_NFILEFACE
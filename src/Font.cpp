@@ -27,26 +27,34 @@ of the License or (at your option) any later version.
 #include "inc/Face.h"
 #include "inc/Font.h"
 #include "inc/GlyphCache.h"
+#include "inc/List.h"
 
 using namespace graphite2;
 
 Font::Font(float ppm, const Face & f, const void * appFontHandle, const gr_font_ops * ops)
 : m_appFontHandle(appFontHandle ? appFontHandle : this),
+  m_advances(0),
+  m_hintedAdvances(0),
   m_face(f),
   m_scale(ppm / f.glyphs().unitsPerEm()),
-  m_hinted(appFontHandle && ops && (ops->glyph_advance_x || ops->glyph_advance_y))
+  m_hinted(false)
 {
     memset(&m_ops, 0, sizeof m_ops);
-    if (m_hinted && ops)
+    if (appFontHandle && ops)
         memcpy(&m_ops, ops, min(sizeof m_ops, ops->size));
-    else
-        m_ops.glyph_advance_x = &Face::default_glyph_advance;
+    m_hinted = m_ops.glyph_advance_x || m_ops.glyph_advance_y || m_ops.glyph_advances_x;
+    if (!m_hinted)
+    {
+        // Unhinted advances only depend on the scale, so fonts share them.
+        m_advances = f.acquireAdvances(m_scale);
+        return;
+    }
 
     size_t nGlyphs = f.glyphs().numGlyphs();
-    m_advances = gralloc<float>(nGlyphs);
-    if (m_advances)
+    m_advances = m_hintedAdvances = gralloc<float>(nGlyphs);
+    if (m_hintedAdvances)
     {
-        for (float *advp = m_advances; nGlyphs; --nGlyphs, ++advp)
+        for (float *advp = m_hintedAdvances; nGlyphs; --nGlyphs, ++advp)
             *advp = INVALID_ADVANCE;
     }
 }
@@ -54,8 +62,34 @@ Font::Font(float ppm, const Face & f, const void * appFontHandle, const gr_font_
 
 /*virtual*/ Font::~Font()
 {
-    free(m_advances);
+    if (m_hintedAdvances)
+        free(m_hintedAdvances);
+    else if (m_advances)
+        m_face.releaseAdvances(m_advances);
 }
 
 
+// Get the advances of any of the given glyphs we do not have yet in a single
+//  call, when the font can give several at once.
+void Font::fetchAdvances(const uint16 * glyphids, size_t n) const
+{
+    if (!m_hintedAdvances || !m_ops.glyph_advances_x)
+        return;
 
+    Vector<uint16> missing;
+    for (const uint16 * const end = glyphids + n; glyphids != end; ++glyphids)
+    {
+        float & adv = m_hintedAdvances[*glyphids];
+        if (adv != INVALID_ADVANCE) continue;
+        adv = 0.f;      // so that repeats of this glyph are not asked for again
+        missing.push_back(*glyphids);
+    }
+    if (missing.empty())
+        return;
+
+    Vector<float> advances;
+    advances.resize(missing.size());
+    (*m_ops.glyph_advances_x)(m_appFontHandle, missing.begin(), advances.begin(), missing.size());
+    for (size_t i = 0; i != missing.size(); ++i)
+        m_hintedAdvances[missing[i]] = advances[i];
+}
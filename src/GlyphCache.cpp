@@ -31,6 +31,7 @@ of the License or (at your option) any later version.
 #include "inc/GlyphCache.h"
 #include "inc/GlyphFace.h"
 #include "inc/Endian.h"
+#include "inc/TtfTypes.h"
 #include "inc/bits.h"
 
 using namespace graphite2;
@@ -76,6 +77,11 @@ namespace
 
     typedef _glat_iterator<uint8>   glat_iterator;
     typedef _glat_iterator<uint16>  glat2_iterator;
+
+    // Number of glyphs a preload task reads.
+    const size_t PRELOAD_RUN = 512;
+
+    typedef std::pair<sparse::key_type, sparse::mapped_type> attr_pair;
 }
 
 const SlantBox SlantBox::empty = {0,0,0,0};
@@ -92,11 +98,21 @@ public:
     unsigned short int num_attrs() const throw();
     bool has_boxes() const throw();
 
+    bool decompress_all() const throw();
+    size_t memory_usage() const throw();
+    float advance(unsigned short gid) const throw();
     const GlyphFace * read_glyph(unsigned short gid, GlyphFace &, int *numsubs) const throw();
     GlyphBox * read_box(uint16 gid, GlyphBox *curr, const GlyphFace & face) const throw();
 
+    // For preloading runs of glyphs.
+    bool read_metrics(uint16 first, uint16 last, GlyphFace * glyphs) const throw();
+    size_t attr_bound(uint16 first, uint16 last) const throw();
+    bool read_attrs(uint16 gid, attr_pair * & out, const attr_pair * end, int *numsubs) const throw();
+
     CLASS_NEW_DELETE;
 private:
+    bool glat_extent(unsigned short gid, size_t & glocs, size_t & gloce, int *numsubs) const throw();
+
     Face::Table _head,
                 _hhea,
                 _hmtx,
@@ -120,48 +136,19 @@ GlyphCache::GlyphCache(const Face & face, const uint32 face_options)
         ? grzeroalloc<const GlyphFace *>(_glyph_loader->num_glyphs()) : 0),
   _boxes(_glyph_loader && _glyph_loader->has_boxes() && _glyph_loader->num_glyphs()
         ? grzeroalloc<GlyphBox *>(_glyph_loader->num_glyphs()) : 0),
+  _attr_store(0),
+  _hot_attrs(0),
+  _hot_column(0),
+  _lock(0),
   _num_glyphs(_glyphs ? _glyph_loader->num_glyphs() : 0),
   _num_attrs(_glyphs ? _glyph_loader->num_attrs() : 0),
-  _upem(_glyphs ? _glyph_loader->units_per_em() : 0)
+  _upem(_glyphs ? _glyph_loader->units_per_em() : 0),
+  _num_hot(0)
 {
     if ((face_options & gr_face_preloadGlyphs) && _glyph_loader && _glyphs)
     {
-        int numsubs = 0;
-        GlyphFace * const glyphs = new GlyphFace [_num_glyphs];
-        if (!glyphs)
-            return;
-
-        // The 0 glyph is definately required.
-        _glyphs[0] = _glyph_loader->read_glyph(0, glyphs[0], &numsubs);
-
-        // glyphs[0] has the same address as the glyphs array just allocated,
-        //  thus assigning the &glyphs[0] to _glyphs[0] means _glyphs[0] points
-        //  to the entire array.
-        const GlyphFace * loaded = _glyphs[0];
-        for (uint16 gid = 1; loaded && gid != _num_glyphs; ++gid)
-            _glyphs[gid] = loaded = _glyph_loader->read_glyph(gid, glyphs[gid], &numsubs);
-
-        if (!loaded)
-        {
+        if (!preload(face))
             _glyphs[0] = 0;
-            delete [] glyphs;
-        }
-        else if (numsubs > 0 && _boxes)
-        {
-            GlyphBox * boxes = (GlyphBox *)gralloc<char>(_num_glyphs * sizeof(GlyphBox) + numsubs * 8 * sizeof(float));
-            GlyphBox * currbox = boxes;
-
-            for (uint16 gid = 0; currbox && gid != _num_glyphs; ++gid)
-            {
-                _boxes[gid] = currbox;
-                currbox = _glyph_loader->read_box(gid, currbox, *_glyphs[gid]);
-            }
-            if (!currbox)
-            {
-                free(boxes);
-                _boxes[0] = 0;
-            }
-        }
         delete _glyph_loader;
         _glyph_loader = 0;
     }
@@ -194,6 +181,9 @@ GlyphCache::~GlyphCache()
             delete [] _glyphs[0];
         free(_glyphs);
     }
+    free(_attr_store);
+    free(_hot_attrs);
+    free(_hot_column);
     if (_boxes)
     {
         if (_glyph_loader)
@@ -209,12 +199,305 @@ GlyphCache::~GlyphCache()
     delete _glyph_loader;
 }
 
+void GlyphCache::memoryUsage(gr_face_memory & usage) const
+{
+    usage.glyphs += sizeof(GlyphCache);
+    if (_glyph_loader)
+        usage.tables += _glyph_loader->memory_usage();
+    if (!_glyphs) return;
+
+    usage.glyphs += _num_glyphs * sizeof(GlyphFace *)
+                  + size_t(_num_glyphs) * _num_hot * sizeof(sparse::mapped_type)
+                  + (_hot_column ? _num_attrs : 0);
+    for (const GlyphFace * const * g = _glyphs, * const * const e = g + _num_glyphs; g != e; ++g)
+    {
+        if (!*g) continue;
+        ++usage.glyphs_loaded;
+        usage.glyphs += sizeof(GlyphFace) - sizeof(sparse) + (*g)->attrs()._sizeof();
+    }
+    usage.glyphs_total += _num_glyphs;
+
+    if (!_boxes) return;
+    usage.boxes += _num_glyphs * sizeof(GlyphBox *);
+    for (GlyphBox * const * b = _boxes, * const * const e = b + _num_glyphs; b != e; ++b)
+        if (*b) usage.boxes += sizeof(GlyphBox) + 2 * (*b)->num() * sizeof(Rect);
+}
+
+
+// Move the given attributes of every glyph into a table with a row per glyph
+// so that reading one is a single indexed load. Only done for preloaded glyphs,
+// the rest are still read from each glyph's sparse map.
+bool GlyphCache::cacheAttrs(const Vector<uint16> & attrs)
+{
+    if (_glyph_loader || !_glyphs || !_num_attrs || _hot_column)
+        return true;
+
+    uint16 cols[255];
+    _hot_column = grzeroalloc<uint8>(_num_attrs);
+    if (!_hot_column) return false;
+    for (Vector<uint16>::const_iterator a = attrs.begin(); a != attrs.end() && _num_hot != 255; ++a)
+    {
+        if (*a >= _num_attrs || _hot_column[*a]) continue;
+        cols[_num_hot] = *a;
+        _hot_column[*a] = ++_num_hot;
+    }
+
+    if (_num_hot)
+        _hot_attrs = gralloc<sparse::mapped_type>(size_t(_num_glyphs) * _num_hot);
+    if (!_hot_attrs)
+    {
+        free(_hot_column);
+        _hot_column = 0;
+        const bool ok = _num_hot == 0;
+        _num_hot = 0;
+        return ok;
+    }
+
+    sparse::mapped_type * row = _hot_attrs;
+    size_t num_cold = 0;
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+    {
+        const sparse & s = _glyphs[gid]->attrs();
+        for (uint8 c = 0; c != _num_hot; ++c)
+            *row++ = s[cols[c]];
+        num_cold += s.capacity();
+    }
+
+    stripAttrs(num_cold);
+    return true;
+}
+
+
+// Rebuild the preloaded glyphs' sparse maps without the attributes cacheAttrs
+// has put in the hot table, in a store of their own. If that can't be had the
+// maps are left as they are, which costs memory but reads the same.
+void GlyphCache::stripAttrs(size_t num_cold)
+{
+    GlyphFace * const glyphs = const_cast<GlyphFace *>(_glyphs[0]);
+    attr_pair * const pairs = num_cold ? gralloc<attr_pair>(num_cold) : 0;
+    uint32 * const ends = gralloc<uint32>(_num_glyphs);
+    if (!pairs || !ends)
+    {
+        free(pairs);
+        free(ends);
+        return;
+    }
+
+    attr_pair * out = pairs;
+    size_t store_sz = 0;
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+    {
+        const sparse & s = glyphs[gid].attrs();
+        attr_pair * const begin = out;
+        for (uint16 k = 0, n = uint16(s.capacity()); n && k != _num_attrs; ++k)
+        {
+            const sparse::mapped_type v = s[k];
+            if (!v) continue;
+            --n;
+            if (!_hot_column[k])
+                *out++ = attr_pair(k, v);
+        }
+        store_sz += sparse::storage(begin, out);
+        ends[gid] = uint32(out - pairs);
+    }
+
+    sparse::mapped_type * const store = store_sz ? grzeroalloc<sparse::mapped_type>(store_sz) : 0;
+    if (!store_sz || store)
+    {
+        sparse::mapped_type * p = store;
+        const attr_pair * a = pairs;
+        for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+        {
+            const attr_pair * const e = pairs + ends[gid];
+            GlyphFace & g = glyphs[gid];
+            const Rect bbox = g.theBBox();
+            const Position advance = g.theAdvance();
+            g.~GlyphFace();
+            new (&g) GlyphFace(bbox, advance, a, e, p);
+            a = e;
+        }
+        free(_attr_store);
+        _attr_store = store;
+    }
+    free(pairs);
+    free(ends);
+}
+
+
+// A preload reads the glyphs in runs of PRELOAD_RUN, each run a task that may
+// be run on the face's task executor. It goes in two phases. The first reads
+// each glyph's metrics in one pass over loca, glyf and hmtx, and decodes its
+// attributes from Glat once, into a list for the run. That sizes the run's
+// attributes and boxes, so that each can go in one block for all the glyphs.
+// The second lays the attributes out in their block and reads the boxes.
+struct GlyphCache::Preload
+{
+    enum phase { GLYPHS, PLACE };
+
+    struct Run
+    {
+        attr_pair * attrs;      // the non-zero attributes of the run's glyphs
+        size_t      store,      // attribute storage needed, then its offset
+                    boxes;      // offset of the run's boxes in bytes
+        int         numsubs;
+        bool        ok;
+    };
+
+    GlyphCache    * cache;
+    GlyphFace     * glyphs;
+    GlyphBox      * boxes;
+    Run           * runs;
+    uint32        * ends;       // where each glyph's attributes end in its run's
+    phase           what;
+};
+
+
+void GlyphCache::preloadTask(void * data, size_t index)
+{
+    Preload & job = *static_cast<Preload *>(data);
+    Preload::Run & r = job.runs[index];
+    const Loader & loader = *job.cache->_glyph_loader;
+    const uint16 first = uint16(index * PRELOAD_RUN),
+                 last = uint16(min(index * PRELOAD_RUN + PRELOAD_RUN, size_t(job.cache->_num_glyphs)));
+
+    switch (job.what)
+    {
+    case Preload::GLYPHS:
+    {
+        const size_t bound = loader.attr_bound(first, last);
+        r.attrs = bound ? gralloc<attr_pair>(bound) : 0;
+        r.ok = (!bound || r.attrs) && loader.read_metrics(first, last, job.glyphs);
+        attr_pair * out = r.attrs;
+        for (uint16 gid = first; r.ok && gid != last; ++gid)
+        {
+            attr_pair * const begin = out;
+            r.ok = loader.read_attrs(gid, out, r.attrs + bound, &r.numsubs);
+            r.store += sparse::storage(begin, out);
+            job.ends[gid] = uint32(out - r.attrs);
+        }
+        break;
+    }
+    case Preload::PLACE:
+    {
+        sparse::mapped_type * store = job.cache->_attr_store + r.store;
+        const attr_pair * a = r.attrs;
+        for (uint16 gid = first; gid != last; ++gid)
+        {
+            const attr_pair * const e = r.attrs + job.ends[gid];
+            if (a != e)
+            {
+                GlyphFace & g = job.glyphs[gid];
+                const Rect bbox = g.theBBox();
+                const Position advance = g.theAdvance();
+                new (&g) GlyphFace(bbox, advance, a, e, store);
+            }
+            a = e;
+        }
+        free(r.attrs);
+        r.attrs = 0;
+
+        r.ok = true;
+        if (!job.boxes) break;
+        GlyphBox * curr = reinterpret_cast<GlyphBox *>(reinterpret_cast<char *>(job.boxes) + r.boxes);
+        for (uint16 gid = first; curr && gid != last; ++gid)
+        {
+            job.cache->_boxes[gid] = curr;
+            curr = loader.read_box(gid, curr, job.glyphs[gid]);
+        }
+        r.ok = curr != 0;
+        break;
+    }
+    }
+}
+
+
+bool GlyphCache::preload(const Face & face)
+{
+    const size_t num_runs = (_num_glyphs + PRELOAD_RUN - 1) / PRELOAD_RUN;
+    GlyphFace * const glyphs = new GlyphFace [_num_glyphs];
+    Preload::Run * const runs = grzeroalloc<Preload::Run>(num_runs);
+    uint32 * const ends = gralloc<uint32>(_num_glyphs);
+    // The tasks may only read Glat, so finish any lazy decompression first.
+    bool ok = glyphs && runs && ends && _glyph_loader->decompress_all();
+
+    Preload job = { this, glyphs, 0, runs, ends, Preload::GLYPHS };
+    if (ok)
+        face.runTasks(&GlyphCache::preloadTask, &job, num_runs);
+
+    int numsubs = 0;
+    size_t store_sz = 0, boxes_sz = 0;
+    for (size_t i = 0; ok && i != num_runs; ++i)
+    {
+        Preload::Run & r = runs[i];
+        ok = r.ok;
+        const size_t n = r.store;
+        r.store = store_sz;
+        store_sz += n;
+        r.boxes = boxes_sz;
+        boxes_sz += min(PRELOAD_RUN, _num_glyphs - i * PRELOAD_RUN) * sizeof(GlyphBox)
+                  + r.numsubs * 2 * sizeof(Rect);
+        numsubs += r.numsubs;
+    }
+    if (ok && store_sz)
+        ok = (_attr_store = grzeroalloc<sparse::mapped_type>(store_sz)) != 0;
+    if (!ok)
+    {
+        for (size_t i = 0; runs && i != num_runs; ++i)
+            free(runs[i].attrs);
+        delete [] glyphs;
+        free(_attr_store);
+        _attr_store = 0;
+        free(ends);
+        free(runs);
+        return false;
+    }
+
+    // glyphs[0] has the same address as the glyphs array just allocated,
+    //  thus assigning the &glyphs[0] to _glyphs[0] means _glyphs[0] points
+    //  to the entire array.
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+        _glyphs[gid] = glyphs + gid;
+
+    if (numsubs > 0 && _boxes)
+        job.boxes = reinterpret_cast<GlyphBox *>(gralloc<char>(boxes_sz));
+    job.what = Preload::PLACE;
+    face.runTasks(&GlyphCache::preloadTask, &job, num_runs);
+    for (size_t i = 0; job.boxes && i != num_runs; ++i)
+        if (!runs[i].ok)
+        {
+            free(job.boxes);
+            job.boxes = 0;
+        }
+    if (_boxes && !job.boxes)
+        memset(_boxes, 0, _num_glyphs * sizeof(GlyphBox *));
+    free(ends);
+    free(runs);
+    return true;
+}
+
+
 const GlyphFace *GlyphCache::glyph(unsigned short glyphid) const      //result may be changed by subsequent call with a different glyphid
 { 
     if (glyphid >= numGlyphs())
         return _glyphs[0];
-    const GlyphFace * & p = _glyphs[glyphid];
+    // A glyph is published with store_release once it and its box are read.
+    const GlyphFace * p = load_acquire(_glyphs + glyphid);
     if (p == 0 && _glyph_loader)
+        p = loadGlyph(glyphid);
+    return p;
+}
+
+
+// Faces made with gr_make_shared_face share this cache, so glyphs may be asked
+// for on several threads at once. Reading one may decompress more of Glat, so
+// the whole read is done under the lock.
+const GlyphFace *GlyphCache::loadGlyph(unsigned short glyphid) const
+{
+    while (compare_and_swap(&_lock, 0, 1) != 0)
+        yield_thread();
+
+    const GlyphFace * p = _glyphs[glyphid];
+    if (p == 0)
     {
         int numsubs = 0;
         GlyphFace * g = new GlyphFace();
@@ -222,23 +505,42 @@ const GlyphFace *GlyphCache::glyph(unsigned short glyphid) const      //result m
         if (!p)
         {
             delete g;
-            return *_glyphs;
+            p = *_glyphs;
         }
-        if (_boxes)
+        else
         {
-            _boxes[glyphid] = (GlyphBox *)gralloc<char>(sizeof(GlyphBox) + 8 * numsubs * sizeof(float));
-            if (!_glyph_loader->read_box(glyphid, _boxes[glyphid], *_glyphs[glyphid]))
+            if (_boxes)
             {
-                free(_boxes[glyphid]);
-                _boxes[glyphid] = 0;
+                _boxes[glyphid] = (GlyphBox *)gralloc<char>(sizeof(GlyphBox) + 8 * numsubs * sizeof(float));
+                if (!_glyph_loader->read_box(glyphid, _boxes[glyphid], *g))
+                {
+                    free(_boxes[glyphid]);
+                    _boxes[glyphid] = 0;
+                }
             }
+            store_release(_glyphs + glyphid, p);
         }
     }
+
+    compare_and_swap(&_lock, 1, 0);
     return p;
 }
 
 
 
+// Fill advances with every glyph's advance times scale. Glyphs not read yet,
+// which can only be so when loading lazily, have theirs taken straight from
+// hmtx rather than being loaded.
+void GlyphCache::advances(float scale, float * advances) const
+{
+    for (unsigned short gid = 0; gid != _num_glyphs; ++gid)
+    {
+        const GlyphFace * const g = load_acquire(_glyphs + gid);
+        advances[gid] = (g ? g->theAdvance().x : _glyph_loader->advance(gid)) * scale;
+    }
+}
+
+
 GlyphCache::Loader::Loader(const Face & face, const bool dumb_font)
 : _head(face, Tag::head),
   _hhea(face, Tag::hhea),
@@ -267,7 +569,7 @@ GlyphCache::Loader::Loader(const Face & face, const bool dumb_font)
 
     if (!dumb_font)
     {
-        if ((m_pGlat = Face::Table(face, Tag::Glat, 0x00030000)) == NULL
+        if ((m_pGlat = Face::Table(face, Tag::Glat, 0x00030000, true)) == NULL
             || (m_pGloc = Face::Table(face, Tag::Gloc)) == NULL
             || m_pGloc.size() < 8)
         {
@@ -299,7 +601,7 @@ GlyphCache::Loader::Loader(const Face & face, const bool dumb_font)
         _num_glyphs_attributes = static_cast<unsigned short>(tmpnumgattrs);
         p = m_pGlat;
         version = be::read<uint32>(p);
-        if (version >= 0x00040000 || (version >= 0x00030000 && m_pGlat.size() < 8))       // reject Glat tables that are too new
+        if (version >= 0x00040000 || (version >= 0x00030000 && (m_pGlat.size() < 8 || !m_pGlat.available(8))))       // reject Glat tables that are too new
         {
             _head = Face::Table();
             return;
@@ -344,6 +646,87 @@ bool GlyphCache::Loader::has_boxes () const throw()
     return _has_boxes;
 }
 
+inline
+bool GlyphCache::Loader::decompress_all() const throw()
+{
+    return m_pGlat.available(m_pGlat.size());
+}
+
+size_t GlyphCache::Loader::memory_usage() const throw()
+{
+    return sizeof(Loader) + _head.memoryUsage() + _hhea.memoryUsage() + _hmtx.memoryUsage()
+         + _glyf.memoryUsage() + _loca.memoryUsage() + m_pGlat.memoryUsage() + m_pGloc.memoryUsage();
+}
+
+// Find where a glyph's attributes lie in Glat, past any octabox in front of them.
+bool GlyphCache::Loader::glat_extent(unsigned short glyphid, size_t & glocs, size_t & gloce, int *numsubs) const throw()
+{
+    const byte * gloc = m_pGloc;
+    glocs = gloce = 0;
+
+    be::skip<uint32>(gloc);
+    be::skip<uint16>(gloc,2);
+    if (_long_fmt)
+    {
+        if (8 + glyphid * sizeof(uint32) > m_pGloc.size())
+            return false;
+        be::skip<uint32>(gloc, glyphid);
+        glocs = be::read<uint32>(gloc);
+        gloce = be::peek<uint32>(gloc);
+    }
+    else
+    {
+        if (8 + glyphid * sizeof(uint16) > m_pGloc.size())
+            return false;
+        be::skip<uint16>(gloc, glyphid);
+        glocs = be::read<uint16>(gloc);
+        gloce = be::peek<uint16>(gloc);
+    }
+
+    if (glocs >= m_pGlat.size() - 1 || gloce > m_pGlat.size()
+        || !m_pGlat.available(gloce))
+        return false;
+
+    const uint32 glat_version = be::peek<uint32>(m_pGlat);
+    if (glat_version >= 0x00030000)
+    {
+        if (glocs >= gloce)
+            return false;
+        const byte * p = m_pGlat + glocs;
+        uint16 bmap = be::read<uint16>(p);
+        int num = bit_set_count((uint32)bmap);
+        if (numsubs) *numsubs += num;
+        glocs += 6 + 8 * num;
+        if (glocs > gloce)
+            return false;
+    }
+    if (glat_version < 0x00020000)
+    {
+        if (gloce - glocs < 2*sizeof(byte)+sizeof(uint16)
+            || gloce - glocs > _num_attrs*(2*sizeof(byte)+sizeof(uint16)))
+                return false;
+    }
+    else
+    {
+        if (gloce - glocs < 3*sizeof(uint16)        // can a glyph have no attributes? why not?
+            || gloce - glocs > _num_attrs*3*sizeof(uint16)
+            || glocs > m_pGlat.size() - 2*sizeof(uint16))
+                return false;
+    }
+    return true;
+}
+
+// The advance read_glyph would give the glyph, without reading the rest of it.
+float GlyphCache::Loader::advance(unsigned short glyphid) const throw()
+{
+    int nLsb;
+    unsigned int nAdvWid;
+    if (glyphid < _num_glyphs_graphics
+            && TtfUtil::HorMetrics(glyphid, _hmtx, _hmtx.size(), _hhea, nLsb, nAdvWid))
+        return static_cast<float>(nAdvWid);
+    return 0.f;
+}
+
 const GlyphFace * GlyphCache::Loader::read_glyph(unsigned short glyphid, GlyphFace & glyph, int *numsubs) const throw()
 {
     Rect        bbox;
@@ -373,63 +756,134 @@ const GlyphFace * GlyphCache::Loader::read_glyph(unsigned short glyphid, GlyphFa
 
     if (glyphid < _num_glyphs_attributes)
     {
-        const byte * gloc = m_pGloc;
-        size_t      glocs = 0, gloce = 0;
+        size_t glocs, gloce;
+        if (!glat_extent(glyphid, glocs, gloce, numsubs))
+            return 0;
 
-        be::skip<uint32>(gloc);
-        be::skip<uint16>(gloc,2);
-        if (_long_fmt)
+        if (be::peek<uint32>(m_pGlat) < 0x00020000)
         {
-            if (8 + glyphid * sizeof(uint32) > m_pGloc.size())
-                return 0;
-            be::skip<uint32>(gloc, glyphid);
-            glocs = be::read<uint32>(gloc);
-            gloce = be::peek<uint32>(gloc);
+            const glat_iterator first(m_pGlat + glocs), last(m_pGlat + gloce);
+            new (&glyph) GlyphFace(bbox, advance, first, last);
         }
         else
         {
-            if (8 + glyphid * sizeof(uint16) > m_pGloc.size())
-                return 0;
-            be::skip<uint16>(gloc, glyphid);
-            glocs = be::read<uint16>(gloc);
-            gloce = be::peek<uint16>(gloc);
+            const glat2_iterator first(m_pGlat + glocs), last(m_pGlat + gloce);
+            new (&glyph) GlyphFace(bbox, advance, first, last);
         }
-
-        if (glocs >= m_pGlat.size() - 1 || gloce > m_pGlat.size())
+        if (!glyph.attrs() || glyph.attrs().capacity() > _num_attrs)
             return 0;
+    }
+    return &glyph;
+}
+
+// Reads the bounding boxes and advances of glyphs first to last as read_glyph
+// would, giving each glyph no attributes. The offsets of consecutive glyphs in
+// loca are read once, and the checks on each table made once for the run.
+bool GlyphCache::Loader::read_metrics(uint16 first, uint16 last, GlyphFace * glyphs) const throw()
+{
+    using namespace TtfUtil;
+    const attr_pair * const none = 0;
+    const uint16 end = min(last, _num_glyphs_graphics);
+    const int loca_format = _glyf ? be::swap(reinterpret_cast<const Sfnt::FontHeader *>(
+                                        static_cast<const byte *>(_head))->index_to_loc_format) : -1;
+    const size_t num_loca = loca_format == Sfnt::FontHeader::ShortIndexLocFormat ? _loca.size() >> 1
+                          : loca_format == Sfnt::FontHeader::LongIndexLocFormat ? _loca.size() >> 2 : 0;
+    const size_t num_long = be::swap(reinterpret_cast<const Sfnt::HorizontalHeader *>(
+                                        static_cast<const byte *>(_hhea))->num_long_hor_metrics);
+    const byte * const hmtx = _hmtx;
+    const size_t hmtx_size = _hmtx.size();
+
+    size_t next = 0;
+    if (first + 1u < num_loca)
+        next = loca_format ? be::peek<uint32>(_loca + first * 4) : size_t(be::peek<uint16>(_loca + first * 2)) << 1;
+    for (uint16 gid = first; gid != end; ++gid)
+    {
+        Rect        bbox;
+        Position    advance;
+
+        if (gid + 1u < num_loca)
+        {
+            const size_t loc = next;
+            next = loca_format ? be::peek<uint32>(_loca + (gid + 1) * 4) : size_t(be::peek<uint16>(_loca + (gid + 1) * 2)) << 1;
+            if (loc != next && loc + sizeof(Sfnt::Glyph) < _glyf.size())
+            {
+                const Sfnt::Glyph & g = *reinterpret_cast<const Sfnt::Glyph *>(_glyf + loc);
+                const int xMin = int16(be::swap(g.x_min)), yMin = int16(be::swap(g.y_min)),
+                          xMax = int16(be::swap(g.x_max)), yMax = int16(be::swap(g.y_max));
+                if ((xMin > xMax) || (yMin > yMax))
+                    return false;
+                bbox = Rect(Position(static_cast<float>(xMin), static_cast<float>(yMin)),
+                    Position(static_cast<float>(xMax), static_cast<float>(yMax)));
+            }
+        }
 
-        const uint32 glat_version = be::peek<uint32>(m_pGlat);
-        if (glat_version >= 0x00030000)
+        if (gid < num_long)
         {
-            if (glocs >= gloce)
-                return 0;
-            const byte * p = m_pGlat + glocs;
-            uint16 bmap = be::read<uint16>(p);
-            int num = bit_set_count((uint32)bmap);
-            if (numsubs) *numsubs += num;
-            glocs += 6 + 8 * num;
-            if (glocs > gloce)
-                return 0;
+            if ((gid + 1) * sizeof(Sfnt::HorizontalMetric) <= hmtx_size)
+                advance = Position(be::peek<uint16>(hmtx + gid * sizeof(Sfnt::HorizontalMetric)), 0);
         }
-        if (glat_version < 0x00020000)
+        else if (sizeof(Sfnt::HorizontalMetric) * num_long + sizeof(int16) * (gid - num_long) < hmtx_size - sizeof(int16)
+                 && num_long != 0)
+            advance = Position(be::peek<uint16>(hmtx + (num_long - 1) * sizeof(Sfnt::HorizontalMetric)), 0);
+
+        new (glyphs + gid) GlyphFace(bbox, advance, none, none);
+    }
+    for (uint16 gid = end; gid < last; ++gid)
+        new (glyphs + gid) GlyphFace(Rect(), Position(), none, none);
+    return true;
+}
+
+// An upper bound on the number of attributes glyphs first to last have, from
+// the extent of their Glat entries, where each value takes two bytes.
+size_t GlyphCache::Loader::attr_bound(uint16 first, uint16 last) const throw()
+{
+    last = min(last, _num_glyphs_attributes);
+    if (first >= last)
+        return 0;
+    const byte * const gloc = m_pGloc + 8;
+    const size_t s = _long_fmt ? be::peek<uint32>(gloc + first * 4) : be::peek<uint16>(gloc + first * 2),
+                 e = min(_long_fmt ? size_t(be::peek<uint32>(gloc + last * 4)) : be::peek<uint16>(gloc + last * 2),
+                         m_pGlat.size());
+    return (e > s ? (e - s) / 2 : 0) + (last - first);
+}
+
+// Decodes a glyph's non-zero attributes from Glat into out, which is advanced
+// past them. Fails where read_glyph would, or if they would pass end.
+bool GlyphCache::Loader::read_attrs(uint16 glyphid, attr_pair * & out, const attr_pair * end, int *numsubs) const throw()
+{
+    if (glyphid >= _num_glyphs_attributes)
+        return true;
+
+    size_t glocs, gloce;
+    if (!glat_extent(glyphid, glocs, gloce, numsubs)
+            || size_t(end - out) < (gloce - glocs) / 2 + 1)
+        return false;
+
+    attr_pair * const begin = out;
+    long lastkey = -1;
+    if (be::peek<uint32>(m_pGlat) < 0x00020000)
+    {
+        for (glat_iterator a(m_pGlat + glocs), e(m_pGlat + gloce); a != e; ++a)
         {
-            if (gloce - glocs < 2*sizeof(byte)+sizeof(uint16)
-                || gloce - glocs > _num_attrs*(2*sizeof(byte)+sizeof(uint16)))
-                    return 0;
-            new (&glyph) GlyphFace(bbox, advance, glat_iterator(m_pGlat + glocs), glat_iterator(m_pGlat + gloce));
+            const attr_pair v = *a;
+            if (v.second == 0)          continue;
+            if (v.first <= lastkey)     return false;
+            lastkey = v.first;
+            *out++ = v;
         }
-        else
+    }
+    else
+    {
+        for (glat2_iterator a(m_pGlat + glocs), e(m_pGlat + gloce); a != e; ++a)
         {
-            if (gloce - glocs < 3*sizeof(uint16)        // can a glyph have no attributes? why not?
-                || gloce - glocs > _num_attrs*3*sizeof(uint16)
-                || glocs > m_pGlat.size() - 2*sizeof(uint16))
-                    return 0;
-            new (&glyph) GlyphFace(bbox, advance, glat2_iterator(m_pGlat + glocs), glat2_iterator(m_pGlat + gloce));
+            const attr_pair v = *a;
+            if (v.second == 0)          continue;
+            if (v.first <= lastkey)     return false;
+            lastkey = v.first;
+            *out++ = v;
         }
-        if (!glyph.attrs() || glyph.attrs().capacity() > _num_attrs)
-            return 0;
     }
-    return &glyph;
+    return size_t(out - begin) <= _num_attrs;
 }
 
 inline float scale_to(uint8 t, float zmin, float zmax)
@@ -465,7 +919,7 @@ GlyphBox * GlyphCache::Loader::read_box(uint16 gid, GlyphBox *curr, const GlyphF
         gloce = be::peek<uint16>(gloc);
     }
 
-    if (gloce > m_pGlat.size() || glocs + 6 >= gloce)
+    if (gloce > m_pGlat.size() || glocs + 6 >= gloce || !m_pGlat.available(gloce))
         return 0;
 
     const byte * p = m_pGlat + glocs;
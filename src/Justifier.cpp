@@ -70,6 +70,9 @@ float Segment::justify(Slot *pSlot, const Font *font, float width, GR_MAYBE_UNUS
     if (width < 0 && !(silf()->flags()))
         return width;
 
+    // Justification changes slots behind positionSlots' back and positions
+    // sub-ranges as if they were the whole segment.
+    invalidatePositions();
     if ((m_dir & 1) != m_silf->dir() && m_silf->bidiPass() != m_silf->numPasses())
     {
         reverseSlots();
@@ -98,6 +101,26 @@ float Segment::justify(Slot *pSlot, const Font *font, float width, GR_MAYBE_UNUS
 
     int icount = 0;
     int numLevels = silf()->numJustLevels();
+    if (!numLevels && !hasJustification() && !(silf()->flags() & 1)
+            && m_silf->justificationPass() == m_silf->positionPass()
+#if !defined GRAPHITE2_NTRACING
+            && !m_face->logger()
+#endif
+            && justifyWhitespace(pSlot, pFirst, end, width, base, scale))
+    {
+        // Nothing but whitespace stretching to do, so skip the general machinery.
+        Slot *oldFirst = m_first;
+        Slot *oldLast = m_last;
+        m_first = pSlot;
+        m_last = pLast;
+        res = positionSlots(font, pSlot, pLast, m_dir);
+        m_first = oldFirst;
+        m_last = oldLast;
+        invalidatePositions();
+        if ((m_dir & 1) != m_silf->dir() && m_silf->bidiPass() != m_silf->numPasses())
+            reverseSlots();
+        return res.x;
+    }
     if (!numLevels)
     {
         for (s = pSlot; s && s != end; s = s->nextSibling())
@@ -185,9 +208,17 @@ float Segment::justify(Slot *pSlot, const Font *font, float width, GR_MAYBE_UNUS
     Slot *oldLast = m_last;
     if (silf()->flags() & 1)
     {
-        m_first = pSlot = addLineEnd(pSlot);
-        m_last = pLast = addLineEnd(end);
-        if (!m_first || !m_last) return -1.0;
+        Slot * const eFirst = addLineEnd(pSlot),
+             * const eLast = eFirst ? addLineEnd(end) : NULL;
+        if (!eLast)
+        {
+            if (eFirst) delLineEnd(eFirst);
+            if ((m_dir & 1) != m_silf->dir() && m_silf->bidiPass() != m_silf->numPasses())
+                reverseSlots();
+            return -1.0;
+        }
+        m_first = pSlot = eFirst;
+        m_last = pLast = eLast;
     }
     else
     {
@@ -229,12 +260,189 @@ float Segment::justify(Slot *pSlot, const Font *font, float width, GR_MAYBE_UNUS
     }
     m_first = oldFirst;
     m_last = oldLast;
+    invalidatePositions();
 
     if ((m_dir & 1) != m_silf->dir() && m_silf->bidiPass() != m_silf->numPasses())
         reverseSlots();
     return res.x;
 }
 
+// Distributes the extra width equally over the whitespace clusters, or over
+// every cluster if there is no whitespace. This gives the same result as
+// justify() does for a font with no justification levels, but works the
+// weights out on the fly instead of storing them in SlotJustify blocks.
+// Returns false, having changed nothing, if the general code is needed.
+bool Segment::justifyWhitespace(Slot *pSlot, Slot *pFirst, Slot *end, float width, float base, float scale)
+{
+    Slot *s;
+    bool all = true,
+         reached = (pFirst == end);
+    for (s = pSlot; s && s != end; s = s->nextSibling())
+    {
+        if (isWhitespace(charinfo(s->before())->unicodeChar()))
+            all = false;
+        if (s == pFirst)
+            reached = true;
+    }
+    // The weights belong to the clusters from pSlot on, so only clusters
+    // that are also among those can be stretched.
+    if (!reached)
+        return false;
+
+    float currWidth = 0.;
+    int tWeight = 0;
+    for (s = pFirst; s && s != end; s = s->nextSibling())
+    {
+        float w = s->origin().x / scale + s->advance() - base;
+        if (w > currWidth) currWidth = w;
+        if (all || isWhitespace(charinfo(s->before())->unicodeChar()))
+            ++tWeight;
+        s->just(0);
+    }
+    if (width < 0.0f || !tWeight)
+        return true;
+
+    float error;
+    do {
+        error = 0.;
+        const float diff = width - currWidth;
+        const float diffpw = diff / tWeight;
+        tWeight = 0;
+        for (s = pFirst; s && s != end; s = s->nextSibling())
+        {
+            if (!all && !isWhitespace(charinfo(s->before())->unicodeChar()))
+                continue;
+            float pref = diffpw + error;
+            if (pref > 0)
+            {
+                float max = uint16(-1) - s->just();
+                if (pref > max) pref = max;
+                else ++tWeight;
+            }
+            else
+            {
+                float max = s->just();
+                if (-pref > max) pref = -max;
+                else ++tWeight;
+            }
+            int actual = int(pref);
+            if (actual)
+            {
+                error += diffpw - actual;
+                s->just(s->just() + actual);
+            }
+        }
+        currWidth += diff - error;
+    } while (int(std::abs(error)) > 0 && tWeight);
+    return true;
+}
+
+// The weight of a line break before the given slot, taking the better of
+// breaking after the previous character and before this one. 0 means no break.
+int Segment::breakWeightBefore(const Slot *s) const
+{
+    const Slot *p = s->prev();
+    if (!p || !s->isInsertBefore())
+        return 0;
+    const CharInfo *ca = charinfo(p->after()),
+                   *cb = charinfo(s->before());
+    const int wafter = ca ? ca->breakWeight() : 0,
+              wbefore = cb ? -cb->breakWeight() : 0;
+    if (wbefore > 0 && (wafter <= 0 || wbefore < wafter))
+        return wbefore;
+    return wafter > 0 ? wafter : 0;
+}
+
+bool Segment::breakLines(const Font *font, float width, gr_line_width_fn widthFn, void *appData, int maxBreak, bool justifyLast, Vector<Slot *> &lines)
+{
+    if (!m_first)
+    {
+        lines.push_back(NULL);      // one empty line
+        return true;
+    }
+
+    Slot * const oldFirst = m_first;
+    Slot * const oldLast = m_last;
+    const float scale = font ? font->scale() : 1.0f;
+    const bool rtl = currdir();
+    Vector<Slot *> ends, siblings;
+    Vector<float> widths;
+
+    // Find the breaks from the positions the segment already has, and chop
+    // the slot list at each one.
+    Slot *start = m_first;
+    float lineWidth = widthFn ? float((*widthFn)(appData, 0)) : width;
+    float lineStart = rtl ? start->origin().x + start->advance() * scale : start->origin().x;
+    lines.push_back(start);
+    widths.push_back(lineWidth);
+    for (Slot *s = start->next(); s; s = s->next())
+    {
+        const float x = rtl ? lineStart - s->origin().x - s->advance() * scale : s->origin().x - lineStart;
+        if (x <= lineWidth)
+            continue;
+
+        Slot *b, *fallback = NULL;
+        for (b = s; b != start; b = b->prev())
+        {
+            const int weight = breakWeightBefore(b);
+            if (weight > 0 && weight <= maxBreak)
+                break;
+            if (!fallback && b->isInsertBefore())
+                fallback = b;
+        }
+        if (b == start)
+            b = fallback;
+        if (!b)     // nowhere to break within the width, so break as soon after as we can
+        {
+            for (b = s->next(); b && !b->isInsertBefore(); b = b->next()) {}
+            if (!b)
+                break;
+        }
+
+        ends.push_back(b->prev());
+        siblings.push_back(b->prev()->nextSibling());
+        b->prev()->sibling(NULL);
+        b->prev()->next(NULL);
+        b->prev(NULL);
+        start = s = b;
+        lineWidth = widthFn ? float((*widthFn)(appData, lines.size())) : width;
+        lineStart = rtl ? start->origin().x + start->advance() * scale : start->origin().x;
+        lines.push_back(start);
+        widths.push_back(lineWidth);
+    }
+    ends.push_back(oldLast);
+
+    // Position each line on its own, as if it were the whole segment. A last
+    // line that isn't justified still needs the justification passes to see
+    // its line ends if the font has line end contextuals.
+    bool ok = true;
+    for (size_t i = 0; ok && i != lines.size(); ++i)
+    {
+        m_first = lines[i];
+        m_last = ends[i];
+        if (i + 1 < lines.size() || justifyLast)
+            ok = justify(lines[i], font, widths[i], justFlags(0), NULL, ends[i]) != -1.0f || widths[i] == -1.0f;
+        else if (silf()->flags() & 1)
+            ok = justify(lines[i], font, -1.0f, justFlags(0), NULL, ends[i]) != -1.0f;
+        else
+            positionSlots(font, lines[i], ends[i], m_dir);
+    }
+    m_first = oldFirst;
+    m_last = oldLast;
+    invalidatePositions();
+    if (ok) return true;
+
+    // Out of slots for the line end glyphs, so join the lines up again.
+    for (size_t i = 0; i + 1 < lines.size(); ++i)
+    {
+        ends[i]->next(lines[i + 1]);
+        ends[i]->nextSibling(siblings[i]);
+        lines[i + 1]->prev(ends[i]);
+    }
+    lines.clear();
+    return false;
+}
+
 Slot *Segment::addLineEnd(Slot *nSlot)
 {
     Slot *eSlot = newSlot();
@@ -38,10 +38,34 @@ of the License or (at your option) any later version.
 #include "inc/Error.h"
 #include "inc/Collider.h"
 
+#if defined _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
 using namespace graphite2;
 using vm::Machine;
 typedef Machine::Code  Code;
 
+namespace
+{
+    // The states of a pass's rules, which several threads shaping with the
+    // same face may race to decode.
+    enum { RULES_UNDECODED, RULES_DECODING, RULES_DECODED, RULES_FAILED };
+}
+
+void graphite2::yield_thread()
+{
+#if defined _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
 enum KernCollison
 {
     None       = 0,
@@ -60,6 +84,11 @@ Pass::Pass()
   m_states(0),
   m_codes(0),
   m_progs(0),
+  m_oConstraint(0),
+  m_oAction(0),
+  m_rcData(0),
+  m_acData(0),
+  m_rulesState(RULES_DECODED),
   m_numCollRuns(0),
   m_kernColls(0),
   m_iMaxLoop(0),
@@ -73,7 +102,8 @@ Pass::Pass()
   m_minPreCtxt(0),
   m_maxPreCtxt(0),
   m_colThreshold(0),
-  m_isReverseDir(false)
+  m_isReverseDir(false),
+  m_passType(0)
 {
 }
 
@@ -90,20 +120,44 @@ Pass::~Pass()
     free(m_progs);
 }
 
+size_t Pass::memoryUsage() const
+{
+    size_t n = sizeof(Pass) + m_cPConstraint.memoryUsage();
+    if (m_cols)         n += m_numGlyphs * sizeof(uint16);
+    if (m_startStates)  n += (m_maxPreCtxt - m_minPreCtxt + 1) * sizeof(uint16);
+    if (m_transitions)  n += m_numTransition * m_numColumns * sizeof(uint16);
+    if (m_rules)        n += m_numRules * sizeof(Rule);
+    if (m_states)
+    {
+        n += m_numStates * sizeof(State);
+        const RuleEntry * rule_map_end = m_ruleMap;
+        for (const State * s = m_states, * const e = s + m_numStates; s != e; ++s)
+            if (s->rules_end > rule_map_end) rule_map_end = s->rules_end;
+        n += (rule_map_end - m_ruleMap) * sizeof(RuleEntry);
+    }
+    if (m_codes)
+        for (const vm::Machine::Code * c = m_codes, * const e = c + m_numRules * 2; c != e; ++c)
+            n += sizeof(vm::Machine::Code) + c->memoryUsage();
+    return n;
+}
+
 bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t subtable_base,
-        GR_MAYBE_UNUSED Face & face, passtype pt, GR_MAYBE_UNUSED uint32 version, Error &e)
+        GR_MAYBE_UNUSED Face & face, passtype pt, GR_MAYBE_UNUSED uint32 version, bool lazyRules, Error &e)
 {
+#ifdef GRAPHITE2_TELEMETRY
+    telemetry::phase _pass_phase(face.tele.time.passes);
+#endif
     const byte * p              = pass_start,
                * const pass_end = p + pass_length;
     size_t numRanges;
 
-    if (e.test(pass_length < 40, E_BADPASSLENGTH)) return face.error(e); 
+    if (e.test(pass_length < 40, E_BADPASSLENGTH)) return false; 
     // Read in basic values
     const byte flags = be::read<byte>(p);
     if (e.test((flags & 0x1f) && 
             (pt < PASS_TYPE_POSITIONING || !m_silf->aCollision() || !face.glyphs().hasBoxes() || !(m_silf->flags() & 0x20)),
             E_BADCOLLISIONPASS))
-        return face.error(e);
+        return false;
     m_numCollRuns = flags & 0x7;
     m_kernColls   = (flags >> 3) & 0x3;
     m_isReverseDir = (flags >> 5) & 0x1;
@@ -111,7 +165,7 @@ bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t su
     if (m_iMaxLoop < 1) m_iMaxLoop = 1;
     be::skip<byte>(p,2); // skip maxContext & maxBackup
     m_numRules = be::read<uint16>(p);
-    if (e.test(!m_numRules && m_numCollRuns == 0, E_BADEMPTYPASS)) return face.error(e);
+    if (e.test(!m_numRules && m_numCollRuns == 0, E_BADEMPTYPASS)) return false;
     be::skip<uint16>(p);   // fsmOffset - not sure why we would want this
     const byte * const pcCode = pass_start + be::read<uint32>(p) - subtable_base,
                * const rcCode = pass_start + be::read<uint32>(p) - subtable_base,
@@ -130,11 +184,11 @@ bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t su
             || e.test(m_numSuccess + m_numTransition < m_numStates, E_BADNUMSTATES)
             || e.test(m_numRules && numRanges == 0, E_NORANGES)
             || e.test(m_numColumns > 0x7FFF, E_BADNUMCOLUMNS))
-        return face.error(e);
+        return false;
 
     m_successStart = m_numStates - m_numSuccess;
     // test for beyond end - 1 to account for reading uint16
-    if (e.test(p + numRanges * 6 - 2 > pass_end, E_BADPASSLENGTH)) return face.error(e);
+    if (e.test(p + numRanges * 6 - 2 > pass_end, E_BADPASSLENGTH)) return false;
     m_numGlyphs = be::peek<uint16>(p + numRanges * 6 - 4) + 1;
     // Calculate the start of various arrays.
     const byte * const ranges = p;
@@ -145,15 +199,15 @@ bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t su
     // More sanity checks
     if (e.test(reinterpret_cast<const byte *>(o_rule_map + m_numSuccess*sizeof(uint16)) > pass_end
             || p > pass_end, E_BADRULEMAPLEN))
-        return face.error(e);
+        return false;
     const size_t numEntries = be::peek<uint16>(o_rule_map + m_numSuccess*sizeof(uint16));
     const byte * const   rule_map = p;
     be::skip<uint16>(p, numEntries);
 
-    if (e.test(p + 2*sizeof(uint8) > pass_end, E_BADPASSLENGTH)) return face.error(e);
+    if (e.test(p + 2*sizeof(uint8) > pass_end, E_BADPASSLENGTH)) return false;
     m_minPreCtxt = be::read<uint8>(p);
     m_maxPreCtxt = be::read<uint8>(p);
-    if (e.test(m_minPreCtxt > m_maxPreCtxt, E_BADCTXTLENBOUNDS)) return face.error(e);
+    if (e.test(m_minPreCtxt > m_maxPreCtxt, E_BADCTXTLENBOUNDS)) return false;
     const byte * const start_states = p;
     be::skip<int16>(p, m_maxPreCtxt - m_minPreCtxt + 1);
     const uint16 * const sort_keys = reinterpret_cast<const uint16 *>(p);
@@ -161,7 +215,7 @@ bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t su
     const byte * const precontext = p;
     be::skip<byte>(p, m_numRules);
 
-    if (e.test(p + sizeof(uint16) + sizeof(uint8) > pass_end, E_BADCTXTLENS)) return face.error(e);
+    if (e.test(p + sizeof(uint16) + sizeof(uint8) > pass_end, E_BADCTXTLENS)) return false;
     m_colThreshold = be::read<uint8>(p);
     if (m_colThreshold == 0) m_colThreshold = 10;       // A default
     const size_t pass_constraint_len = be::read<uint16>(p);
@@ -171,36 +225,36 @@ bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t su
     const uint16 * const o_actions = reinterpret_cast<const uint16 *>(p);
     be::skip<uint16>(p, m_numRules + 1);
     const byte * const states = p;
-    if (e.test(2u*m_numTransition*m_numColumns >= (unsigned)(pass_end - p), E_BADPASSLENGTH)) return face.error(e);
+    if (e.test(2u*m_numTransition*m_numColumns >= (unsigned)(pass_end - p), E_BADPASSLENGTH)) return false;
     be::skip<int16>(p, m_numTransition*m_numColumns);
     be::skip<uint8>(p);
-    if (e.test(p != pcCode, E_BADPASSCCODEPTR)) return face.error(e);
+    if (e.test(p != pcCode, E_BADPASSCCODEPTR)) return false;
     be::skip<byte>(p, pass_constraint_len);
     if (e.test(p != rcCode, E_BADRULECCODEPTR)
-        || e.test(size_t(rcCode - pcCode) != pass_constraint_len, E_BADCCODELEN)) return face.error(e);
+        || e.test(size_t(rcCode - pcCode) != pass_constraint_len, E_BADCCODELEN)) return false;
     be::skip<byte>(p, be::peek<uint16>(o_constraint + m_numRules));
-    if (e.test(p != aCode, E_BADACTIONCODEPTR)) return face.error(e);
+    if (e.test(p != aCode, E_BADACTIONCODEPTR)) return false;
     be::skip<byte>(p, be::peek<uint16>(o_actions + m_numRules));
 
     // We should be at the end or within the pass
-    if (e.test(p > pass_end, E_BADPASSLENGTH)) return face.error(e);
+    if (e.test(p > pass_end, E_BADPASSLENGTH)) return false;
 
     // Load the pass constraint if there is one.
     if (pass_constraint_len)
     {
-        face.error_context(face.error_context() + 1);
+        e.context(e.context() + 1);
         m_cPConstraint = vm::Machine::Code(true, pcCode, pcCode + pass_constraint_len, 
                                   precontext[0], be::peek<uint16>(sort_keys), *m_silf, face, PASS_TYPE_UNKNOWN);
         if (e.test(!m_cPConstraint, E_OUTOFMEM)
                 || e.test(m_cPConstraint.status() != Code::loaded, m_cPConstraint.status() + E_CODEFAILURE))
-            return face.error(e);
-        face.error_context(face.error_context() - 1);
+            return false;
+        e.context(e.context() - 1);
     }
     if (m_numRules)
     {
-        if (!readRanges(ranges, numRanges, e)) return face.error(e);
+        if (!readRanges(ranges, numRanges, e)) return false;
         if (!readRules(rule_map, numEntries,  precontext, sort_keys,
-                   o_constraint, rcCode, o_actions, aCode, face, pt, e)) return false;
+                   o_constraint, rcCode, o_actions, aCode, face, pt, lazyRules, e)) return false;
     }
 #ifdef GRAPHITE2_TELEMETRY
     telemetry::category _states_cat(face.tele.states);
@@ -213,68 +267,127 @@ bool Pass::readRules(const byte * rule_map, const size_t num_entries,
                      const byte *precontext, const uint16 * sort_key,
                      const uint16 * o_constraint, const byte *rc_data,
                      const uint16 * o_action,     const byte * ac_data,
-                     Face & face, passtype pt, Error &e)
+                     Face & face, passtype pt, bool lazy, Error &e)
 {
     const byte * const ac_data_end = ac_data + be::peek<uint16>(o_action + m_numRules);
     const byte * const rc_data_end = rc_data + be::peek<uint16>(o_constraint + m_numRules);
 
-    precontext += m_numRules;
-    sort_key   += m_numRules;
-    o_constraint += m_numRules;
-    o_action += m_numRules;
+    m_oConstraint = o_constraint;
+    m_oAction     = o_action;
+    m_rcData      = rc_data;
+    m_acData      = ac_data;
+    m_passType    = pt;
+
+    m_rules = new Rule [m_numRules];
+    if (e.test(!m_rules, E_OUTOFMEM)) return false;
+    for (size_t n = 0; n != m_numRules; ++n)
+    {
+        m_rules[n].preContext = precontext[n];
+        m_rules[n].sort       = be::peek<uint16>(sort_key + n);
+#ifndef NDEBUG
+        m_rules[n].rule_idx   = n;
+#endif
+    }
+
+    // decodeRules checks each rule as it decodes it, so that a bad font
+    // reports the same error it always has. Lazily decoded rules get the
+    // same checks now, bar those of their code.
+    if (!lazy)
+    {
+        if (!decodeRules(face, e))
+            return false;
+    }
+    else
+    {
+        o_constraint += m_numRules;
+        o_action += m_numRules;
+
+        const byte * ac_begin = 0, * rc_begin = 0,
+                   * ac_end = ac_data + be::peek<uint16>(o_action),
+                   * rc_end = rc_data + be::peek<uint16>(o_constraint);
+        Rule * r = m_rules + m_numRules - 1;
+        for (size_t n = m_numRules; r >= m_rules; --n, --r, ac_end = ac_begin, rc_end = rc_begin)
+        {
+            e.context((e.context() & 0xFFFF00) + EC_ARULE + ((n - 1) << 24));
+            if (r->sort > 63 || r->preContext >= r->sort || r->preContext > m_maxPreCtxt || r->preContext < m_minPreCtxt)
+                return false;
+            ac_begin      = ac_data + be::peek<uint16>(--o_action);
+            --o_constraint;
+            rc_begin      = be::peek<uint16>(o_constraint) ? rc_data + be::peek<uint16>(o_constraint) : rc_end;
+
+            if (ac_begin > ac_end || ac_begin > ac_data_end || ac_end > ac_data_end
+                    || rc_begin > rc_end || rc_begin > rc_data_end || rc_end > rc_data_end)
+                return false;
+        }
+        m_rulesState = RULES_UNDECODED;
+    }
+
+    // Load the rule entries map
+    e.context((e.context() & 0xFFFF00) + EC_APASS);
+    //TODO: Coverty: 1315804: FORWARD_NULL
+    RuleEntry * re = m_ruleMap = gralloc<RuleEntry>(num_entries);
+    if (e.test(!re, E_OUTOFMEM)) return false;
+    for (size_t n = num_entries; n; --n, ++re)
+    {
+        const ptrdiff_t rn = be::read<uint16>(rule_map);
+        if (e.test(rn >= m_numRules, E_BADRULENUM))  return false;
+        re->rule = m_rules + rn;
+    }
+
+    return true;
+}
 
-    // Load rules.
+// Check every rule and decode its action and constraint code.
+bool Pass::decodeRules(const Face & face, Error &e)
+{
+    const uint16 * o_constraint = m_oConstraint + m_numRules,
+                 * o_action     = m_oAction + m_numRules;
+    const byte * const ac_data_end = m_acData + be::peek<uint16>(o_action);
+    const byte * const rc_data_end = m_rcData + be::peek<uint16>(o_constraint);
     const byte * ac_begin = 0, * rc_begin = 0,
-               * ac_end = ac_data + be::peek<uint16>(o_action),
-               * rc_end = rc_data + be::peek<uint16>(o_constraint);
+               * ac_end = ac_data_end,
+               * rc_end = rc_data_end;
 
     // Allocate pools
-    m_rules = new Rule [m_numRules];
     m_codes = new Code [m_numRules*2];
     int totalSlots = 0;
-    const uint16 *tsort = sort_key;
-    for (int i = 0; i < m_numRules; ++i)
-        totalSlots += be::peek<uint16>(--tsort);
-    const size_t prog_pool_sz = vm::Machine::Code::estimateCodeDataOut(ac_end - ac_data + rc_end - rc_data, 2 * m_numRules, totalSlots);
+    for (const Rule * r = m_rules; r != m_rules + m_numRules; ++r)
+        totalSlots += r->sort;
+    const size_t prog_pool_sz = vm::Machine::Code::estimateCodeDataOut(ac_end - m_acData + rc_end - m_rcData, 2 * m_numRules, totalSlots);
     m_progs = gralloc<byte>(prog_pool_sz);
     byte * prog_pool_free = m_progs,
          * prog_pool_end  = m_progs + prog_pool_sz;
-    if (e.test(!(m_rules && m_codes && m_progs), E_OUTOFMEM)) return face.error(e);
+    if (e.test(!(m_codes && m_progs), E_OUTOFMEM)) return false;
 
     Rule * r = m_rules + m_numRules - 1;
     for (size_t n = m_numRules; r >= m_rules; --n, --r, ac_end = ac_begin, rc_end = rc_begin)
     {
-        face.error_context((face.error_context() & 0xFFFF00) + EC_ARULE + ((n - 1) << 24));
-        r->preContext = *--precontext;
-        r->sort       = be::peek<uint16>(--sort_key);
-#ifndef NDEBUG
-        r->rule_idx   = n - 1;
-#endif
+        e.context((e.context() & 0xFFFF00) + EC_ARULE + ((n - 1) << 24));
         if (r->sort > 63 || r->preContext >= r->sort || r->preContext > m_maxPreCtxt || r->preContext < m_minPreCtxt)
             return false;
-        ac_begin      = ac_data + be::peek<uint16>(--o_action);
+        ac_begin      = m_acData + be::peek<uint16>(--o_action);
         --o_constraint;
-        rc_begin      = be::peek<uint16>(o_constraint) ? rc_data + be::peek<uint16>(o_constraint) : rc_end;
+        rc_begin      = be::peek<uint16>(o_constraint) ? m_rcData + be::peek<uint16>(o_constraint) : rc_end;
 
         if (ac_begin > ac_end || ac_begin > ac_data_end || ac_end > ac_data_end
                 || rc_begin > rc_end || rc_begin > rc_data_end || rc_end > rc_data_end
                 || vm::Machine::Code::estimateCodeDataOut(ac_end - ac_begin + rc_end - rc_begin, 2, r->sort) > size_t(prog_pool_end - prog_pool_free))
             return false;
-        r->action     = new (m_codes+n*2-2) vm::Machine::Code(false, ac_begin, ac_end, r->preContext, r->sort, *m_silf, face, pt, &prog_pool_free);
-        r->constraint = new (m_codes+n*2-1) vm::Machine::Code(true,  rc_begin, rc_end, r->preContext, r->sort, *m_silf, face, pt, &prog_pool_free);
+        r->action     = new (m_codes+n*2-2) vm::Machine::Code(false, ac_begin, ac_end, r->preContext, r->sort, *m_silf, face, passtype(m_passType), &prog_pool_free);
+        r->constraint = new (m_codes+n*2-1) vm::Machine::Code(true,  rc_begin, rc_end, r->preContext, r->sort, *m_silf, face, passtype(m_passType), &prog_pool_free);
 
         if (e.test(!r->action || !r->constraint, E_OUTOFMEM)
                 || e.test(r->action->status() != Code::loaded, r->action->status() + E_CODEFAILURE)
                 || e.test(r->constraint->status() != Code::loaded, r->constraint->status() + E_CODEFAILURE)
                 || e.test(!r->constraint->immutable(), E_MUTABLECCODE))
-            return face.error(e);
+            return false;
     }
 
     byte * moved_progs = static_cast<byte *>(realloc(m_progs, prog_pool_free - m_progs));
     if (e.test(!moved_progs, E_OUTOFMEM))
     {
         if (prog_pool_free - m_progs == 0) m_progs = 0;
-        return face.error(e);
+        return false;
     }
 
     if (moved_progs != m_progs)
@@ -285,20 +398,30 @@ bool Pass::readRules(const byte * rule_map, const size_t num_entries,
         }
         m_progs = moved_progs;
     }
+    return true;
+}
 
-    // Load the rule entries map
-    face.error_context((face.error_context() & 0xFFFF00) + EC_APASS);
-    //TODO: Coverty: 1315804: FORWARD_NULL
-    RuleEntry * re = m_ruleMap = gralloc<RuleEntry>(num_entries);
-    if (e.test(!re, E_OUTOFMEM)) return face.error(e);
-    for (size_t n = num_entries; n; --n, ++re)
+// Make sure the rules are decoded before running them. Only the first
+// thread to get here decodes them, any others wait for it to finish.
+bool Pass::rulesDecoded(const Face & face) const
+{
+    long state = load_acquire(&m_rulesState);
+    if (state == RULES_UNDECODED
+            && (state = compare_and_swap(&m_rulesState, RULES_UNDECODED, RULES_DECODING)) == RULES_UNDECODED)
     {
-        const ptrdiff_t rn = be::read<uint16>(rule_map);
-        if (e.test(rn >= m_numRules, E_BADRULENUM))  return face.error(e);
-        re->rule = m_rules + rn;
+#ifdef GRAPHITE2_TELEMETRY
+        telemetry::phase _pass_phase(face.tele.time.passes);
+#endif
+        Error e;
+        state = const_cast<Pass *>(this)->decodeRules(face, e) ? RULES_DECODED : RULES_FAILED;
+        compare_and_swap(&m_rulesState, RULES_DECODING, state);
     }
-
-    return true;
+    while (state == RULES_DECODING)
+    {
+        yield_thread();
+        state = load_acquire(&m_rulesState);
+    }
+    return state == RULES_DECODED;
 }
 
 static int cmpRuleEntry(const void *a, const void *b) { return (*(RuleEntry *)a < *(RuleEntry *)b ? -1 :
@@ -319,7 +442,7 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
 #endif
     m_transitions      = gralloc<uint16>(m_numTransition * m_numColumns);
 
-    if (e.test(!m_startStates || !m_states || !m_transitions, E_OUTOFMEM)) return face.error(e);
+    if (e.test(!m_startStates || !m_states || !m_transitions, E_OUTOFMEM)) return false;
     // load start states
     for (uint16 * s = m_startStates,
                 * const s_end = s + m_maxPreCtxt - m_minPreCtxt + 1; s != s_end; ++s)
@@ -327,8 +450,8 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
         *s = be::read<uint16>(starts);
         if (e.test(*s >= m_numStates, E_BADSTATE))
         {
-            face.error_context((face.error_context() & 0xFFFF00) + EC_ASTARTS + ((s - m_startStates) << 24));
-            return face.error(e); // true;
+            e.context((e.context() & 0xFFFF00) + EC_ASTARTS + ((s - m_startStates) << 24));
+            return false;
         }
     }
 
@@ -339,8 +462,8 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
         *t = be::read<uint16>(states);
         if (e.test(*t >= m_numStates, E_BADSTATE))
         {
-            face.error_context((face.error_context() & 0xFFFF00) + EC_ATRANS + (((t - m_transitions) / m_numColumns) << 8));
-            return face.error(e);
+            e.context((e.context() & 0xFFFF00) + EC_ATRANS + (((t - m_transitions) / m_numColumns) << 8));
+            return false;
         }
     }
 
@@ -354,8 +477,8 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
 
         if (e.test(begin >= rule_map_end || end > rule_map_end || begin > end, E_BADRULEMAPPING))
         {
-            face.error_context((face.error_context() & 0xFFFF00) + EC_ARULEMAP + (n << 24));
-            return face.error(e);
+            e.context((e.context() & 0xFFFF00) + EC_ARULEMAP + (n << 24));
+            return false;
         }
         s->rules = begin;
         s->rules_end = (end - begin <= FiniteStateMachine::MAX_RULES)? end :
@@ -394,8 +517,16 @@ bool Pass::readRanges(const byte * ranges, size_t num_ranges, Error &e)
 
 bool Pass::runGraphite(vm::Machine & m, FiniteStateMachine & fsm, bool reverse) const
 {
-    Slot *s = m.slotMap().segment.first();
-    if (!s || !testPassConstraint(m)) return true;
+    Segment & seg = m.slotMap().segment;
+    Slot *s = seg.first();
+    if (!s) return true;
+    // Where features vary across the segment the constraint is tested for each
+    // set of them, and rules only start at slots whose features pass it.
+    bool featsPass[256], mixed = false;
+    if (m_cPConstraint && seg.numFeatures() > 1 ? !testPassConstraints(m, featsPass, mixed)
+                                                : !testPassConstraint(m, s))
+        return true;
+    if (m_numRules && !rulesDecoded(*m.slotMap().segment.getFace())) return false;
     if (reverse)
     {
         m.slotMap().segment.reverseSlots();
@@ -414,7 +545,10 @@ bool Pass::runGraphite(vm::Machine & m, FiniteStateMachine & fsm, bool reverse)
         int lc = m_iMaxLoop;
         do
         {
-            findNDoRule(s, m, fsm);
+            if (mixed && !featsPass[seg.charinfo(s->original())->fid()])
+                s = s->next();
+            else
+                findNDoRule(s, m, fsm);
             if (m.status() != Machine::finished) return false;
             if (s && (s == m.slotMap().highwater() || m.slotMap().highpassed() || --lc == 0)) {
                 if (!lc)
@@ -611,14 +745,14 @@ void Pass::dumpRuleEventOutput(const FiniteStateMachine & fsm, const Rule & r, S
 
 
 inline
-bool Pass::testPassConstraint(Machine & m) const
+bool Pass::testPassConstraint(Machine & m, Slot * s) const
 {
     if (!m_cPConstraint) return true;
 
     assert(m_cPConstraint.constraint());
 
-    m.slotMap().reset(*m.slotMap().segment.first(), 0);
-    m.slotMap().pushSlot(m.slotMap().segment.first());
+    m.slotMap().reset(*s, 0);
+    m.slotMap().pushSlot(s);
     vm::slotref * map = m.slotMap().begin();
     const uint32 ret = m_cPConstraint.run(m, map);
 
@@ -632,6 +766,30 @@ bool Pass::testPassConstraint(Machine & m) const
 }
 
 
+// Tests the constraint from the first slot with each set of features, setting
+// passes[] by feature index. Returns whether any pass and sets mixed if some
+// fail too.
+bool Pass::testPassConstraints(Machine & m, bool * passes, bool & mixed) const
+{
+    Segment & seg = m.slotMap().segment;
+    bool tested[256] = {false},
+         any = false,
+         fail = false;
+    size_t n = seg.numFeatures();
+    for (Slot * s = seg.first(); s && n; s = s->next())
+    {
+        const uint8 fid = seg.charinfo(s->original())->fid();
+        if (tested[fid]) continue;
+        tested[fid] = true;
+        --n;
+        passes[fid] = testPassConstraint(m, s);
+        if (passes[fid])    any = true;
+        else                fail = true;
+    }
+    mixed = any && fail;
+    return any;
+}
+
 bool Pass::testConstraint(const Rule & r, Machine & m) const
 {
     const uint16 curr_context = m.slotMap().context();
@@ -680,6 +838,8 @@ int Pass::doAction(const Code *codeptr, Slot * & slot_out, vm::Machine & m) cons
     smap.highpassed(false);
 
     int32 ret = codeptr->run(m, map);
+    // Rules may restructure the slot stream, so positions must be redone in full.
+    smap.segment.invalidatePositions();
 
     if (m.status() != Machine::finished)
     {
@@ -730,6 +890,50 @@ void Pass::adjustSlot(int delta, Slot * & slot_out, SlotMap & smap) const
     }
 }
 
+// A run of slots from a collision start to just past its matching
+// collision end, and the state collision fixing carries out of it.
+struct graphite2::CollisionRange
+{
+    Slot  * start,
+          * end;
+    bool    moved,
+            hasCollisions,
+            ok;
+};
+
+namespace
+{
+    struct CollisionShiftJob
+    {
+        const Pass        * pass;
+        Segment           * seg;
+        CollisionRange    * ranges;
+        const size_t      * todo;   // maps task index to range index
+        int                 dir;
+        int                 phase;
+    };
+
+    Slot * nextCollisionStart(const Segment *seg, Slot *end)
+    {
+        for (Slot *s = end->prev(); s; s = s->next())
+        {
+            if (seg->collisionInfo(s)->flags() & SlotCollision::COLL_START)
+                return s;
+        }
+        return NULL;
+    }
+
+    Slot * collisionRangeEnd(const Segment *seg, Slot *start)
+    {
+        for (Slot *s = start->next(); s; s = s->next())
+        {
+            if (seg->collisionInfo(s)->flags() & SlotCollision::COLL_END)
+                return s->next();
+        }
+        return NULL;
+    }
+}
+
 bool Pass::collisionShift(Segment *seg, int dir, json * const dbgout) const
 {
     ShiftCollider shiftcoll(dbgout);
@@ -743,122 +947,245 @@ bool Pass::collisionShift(Segment *seg, int dir, json * const dbgout) const
     if (dbgout)
         *dbgout << "collisions" << json::array
             << json::flat << json::object << "num-loops" << m_numCollRuns << json::close;
+    else
 #endif
+    if (seg->getFace()->canRunTasks())
+    {
+        Vector<CollisionRange> ranges;
+        if (findIndependentRanges(seg, ranges))
+            return collisionShiftConcurrent(seg, dir, ranges);
+    }
 
     while (start)
     {
+        hasCollisions = false;
+        if (!collisionShiftRange(seg, start, end, shiftcoll, dir, moved, hasCollisions, dbgout)
+                || !collisionShiftLoops(seg, start, end, shiftcoll, dir, moved, hasCollisions, dbgout))
+            return false;
+        if (!end)
+            break;
+        start = nextCollisionStart(seg, end);
+    }
+    return true;
+}
+
+// phase 1 : position shiftable glyphs, ignoring kernable glyphs. Finds the
+// end of the range as it goes.
+bool Pass::collisionShiftRange(Segment *seg, Slot *start, Slot * &end, ShiftCollider &shiftcoll,
+        int dir, bool &moved, bool &hasCollisions, json * const dbgout) const
+{
 #if !defined GRAPHITE2_NTRACING
-        if (dbgout)  *dbgout << json::object << "phase" << "1" << "moves" << json::array;
+    if (dbgout)  *dbgout << json::object << "phase" << "1" << "moves" << json::array;
 #endif
-        hasCollisions = false;
-        end = NULL;
-        // phase 1 : position shiftable glyphs, ignoring kernable glyphs
-        for (Slot *s = start; s; s = s->next())
+    end = NULL;
+    for (Slot *s = start; s; s = s->next())
+    {
+        const SlotCollision * c = seg->collisionInfo(s);
+        if (start && (c->flags() & (SlotCollision::COLL_FIX | SlotCollision::COLL_KERN)) == SlotCollision::COLL_FIX
+                  && !resolveCollisions(seg, s, start, shiftcoll, false, dir, moved, hasCollisions, dbgout))
+            return false;
+        if (s != start && (c->flags() & SlotCollision::COLL_END))
         {
-            const SlotCollision * c = seg->collisionInfo(s);
-            if (start && (c->flags() & (SlotCollision::COLL_FIX | SlotCollision::COLL_KERN)) == SlotCollision::COLL_FIX
-                      && !resolveCollisions(seg, s, start, shiftcoll, false, dir, moved, hasCollisions, dbgout))
-                return false;
-            if (s != start && (c->flags() & SlotCollision::COLL_END))
-            {
-                end = s->next();
-                break;
-            }
+            end = s->next();
+            break;
         }
+    }
 
 #if !defined GRAPHITE2_NTRACING
-        if (dbgout)
-            *dbgout << json::close << json::close; // phase-1
+    if (dbgout)
+        *dbgout << json::close << json::close; // phase-1
 #endif
+    return true;
+}
 
-        // phase 2 : loop until happy. 
-        for (int i = 0; i < m_numCollRuns - 1; ++i)
+// phase 2 : loop until happy.
+bool Pass::collisionShiftLoops(Segment *seg, Slot *start, Slot *end, ShiftCollider &shiftcoll,
+        int dir, bool &moved, bool &hasCollisions, json * const dbgout) const
+{
+    for (int i = 0; i < m_numCollRuns - 1; ++i)
+    {
+        if (hasCollisions || moved)
         {
-            if (hasCollisions || moved)
-            {
 
 #if !defined GRAPHITE2_NTRACING
-                if (dbgout)
-                    *dbgout << json::object << "phase" << "2a" << "loop" << i << "moves" << json::array;
+            if (dbgout)
+                *dbgout << json::object << "phase" << "2a" << "loop" << i << "moves" << json::array;
 #endif
-                // phase 2a : if any shiftable glyphs are in collision, iterate backwards,
-                // fixing them and ignoring other non-collided glyphs. Note that this handles ONLY
-                // glyphs that are actually in collision from phases 1 or 2b, and working backwards
-                // has the intended effect of breaking logjams.
-                if (hasCollisions)
+            // phase 2a : if any shiftable glyphs are in collision, iterate backwards,
+            // fixing them and ignoring other non-collided glyphs. Note that this handles ONLY
+            // glyphs that are actually in collision from phases 1 or 2b, and working backwards
+            // has the intended effect of breaking logjams.
+            if (hasCollisions)
+            {
+                hasCollisions = false;
+                #if 0
+                moved = true;
+                for (Slot *s = start; s != end; s = s->next())
                 {
-                    hasCollisions = false;
-                    #if 0
-                    moved = true;
-                    for (Slot *s = start; s != end; s = s->next())
-                    {
-                        SlotCollision * c = seg->collisionInfo(s);
-                        c->setShift(Position(0, 0));
-                    }
-                    #endif
-                    Slot *lend = end ? end->prev() : seg->last();
-                    Slot *lstart = start->prev();
-                    for (Slot *s = lend; s != lstart; s = s->prev())
+                    SlotCollision * c = seg->collisionInfo(s);
+                    c->setShift(Position(0, 0));
+                }
+                #endif
+                Slot *lend = end ? end->prev() : seg->last();
+                Slot *lstart = start->prev();
+                for (Slot *s = lend; s != lstart; s = s->prev())
+                {
+                    SlotCollision * c = seg->collisionInfo(s);
+                    if (start && (c->flags() & (SlotCollision::COLL_FIX | SlotCollision::COLL_KERN | SlotCollision::COLL_ISCOL))
+                                    == (SlotCollision::COLL_FIX | SlotCollision::COLL_ISCOL)) // ONLY if this glyph is still colliding
                     {
-                        SlotCollision * c = seg->collisionInfo(s);
-                        if (start && (c->flags() & (SlotCollision::COLL_FIX | SlotCollision::COLL_KERN | SlotCollision::COLL_ISCOL))
-                                        == (SlotCollision::COLL_FIX | SlotCollision::COLL_ISCOL)) // ONLY if this glyph is still colliding
-                        {
-                            if (!resolveCollisions(seg, s, lend, shiftcoll, true, dir, moved, hasCollisions, dbgout))
-                                return false;
-                            c->setFlags(c->flags() | SlotCollision::COLL_TEMPLOCK);
-                        }
+                        if (!resolveCollisions(seg, s, lend, shiftcoll, true, dir, moved, hasCollisions, dbgout))
+                            return false;
+                        c->setFlags(c->flags() | SlotCollision::COLL_TEMPLOCK);
                     }
                 }
+            }
 
 #if !defined GRAPHITE2_NTRACING
-                if (dbgout)
-                    *dbgout << json::close << json::close // phase 2a
-                        << json::object << "phase" << "2b" << "loop" << i << "moves" << json::array;
+            if (dbgout)
+                *dbgout << json::close << json::close // phase 2a
+                    << json::object << "phase" << "2b" << "loop" << i << "moves" << json::array;
 #endif
 
-                // phase 2b : redo basic diacritic positioning pass for ALL glyphs. Each successive loop adjusts 
-                // glyphs from their current adjusted position, which has the effect of gradually minimizing the  
-                // resulting adjustment; ie, the final result will be gradually closer to the original location.  
-                // Also it allows more flexibility in the final adjustment, since it is moving along the  
-                // possible 8 vectors from successively different starting locations.
-                if (moved)
+            // phase 2b : redo basic diacritic positioning pass for ALL glyphs. Each successive loop adjusts 
+            // glyphs from their current adjusted position, which has the effect of gradually minimizing the  
+            // resulting adjustment; ie, the final result will be gradually closer to the original location.  
+            // Also it allows more flexibility in the final adjustment, since it is moving along the  
+            // possible 8 vectors from successively different starting locations.
+            if (moved)
+            {
+                moved = false;
+                for (Slot *s = start; s != end; s = s->next())
                 {
-                    moved = false;
-                    for (Slot *s = start; s != end; s = s->next())
-                    {
-                        SlotCollision * c = seg->collisionInfo(s);
-                        if (start && (c->flags() & (SlotCollision::COLL_FIX | SlotCollision::COLL_TEMPLOCK
-                                                        | SlotCollision::COLL_KERN)) == SlotCollision::COLL_FIX
-                                  && !resolveCollisions(seg, s, start, shiftcoll, false, dir, moved, hasCollisions, dbgout))
-                            return false;
-                        else if (c->flags() & SlotCollision::COLL_TEMPLOCK)
-                            c->setFlags(c->flags() & ~SlotCollision::COLL_TEMPLOCK);
-                    }
+                    SlotCollision * c = seg->collisionInfo(s);
+                    if (start && (c->flags() & (SlotCollision::COLL_FIX | SlotCollision::COLL_TEMPLOCK
+                                                    | SlotCollision::COLL_KERN)) == SlotCollision::COLL_FIX
+                              && !resolveCollisions(seg, s, start, shiftcoll, false, dir, moved, hasCollisions, dbgout))
+                        return false;
+                    else if (c->flags() & SlotCollision::COLL_TEMPLOCK)
+                        c->setFlags(c->flags() & ~SlotCollision::COLL_TEMPLOCK);
                 }
-        //      if (!hasCollisions) // no, don't leave yet because phase 2b will continue to improve things
-        //          break;
+            }
+    //      if (!hasCollisions) // no, don't leave yet because phase 2b will continue to improve things
+    //          break;
 #if !defined GRAPHITE2_NTRACING
-                if (dbgout)
-                    *dbgout << json::close << json::close; // phase 2
+            if (dbgout)
+                *dbgout << json::close << json::close; // phase 2
 #endif
-            }
         }
-        if (!end)
+    }
+    return true;
+}
+
+// Collect the collision ranges of the segment. Returns true only if there is
+// more than one and no range touches a slot, or a cluster, belonging to
+// another, so that they may be resolved in any order.
+bool Pass::findIndependentRanges(Segment *seg, Vector<CollisionRange> &ranges) const
+{
+    const GlyphCache & gc = seg->getFace()->glyphs();
+    Vector<int> owner(seg->slotCount(), -1);
+
+    for (Slot *start = seg->first(); start; )
+    {
+        const CollisionRange r = { start, collisionRangeEnd(seg, start), false, false, true };
+        for (Slot *s = start; s != r.end; s = s->next())
+        {
+            if (s->index() >= owner.size())
+                return false;
+            owner[s->index()] = int(ranges.size());
+            // Make sure every glyph the range might look at is loaded now
+            // rather than lazily from several threads at once.
+            gc.glyphSafe(s->gid());
+            gc.glyphSafe(s->glyph());
+            // Exclusion glyphs are merged via a scratch slot taken from the
+            // segment, which cannot be shared between threads.
+            if (seg->collisionInfo(s)->exclGlyph() > 0)
+                return false;
+        }
+        ranges.push_back(r);
+        if (!r.end)
             break;
-        start = NULL;
-        for (Slot *s = end->prev(); s; s = s->next())
+        start = nextCollisionStart(seg, r.end);
+        // A slot that both ends one range and starts the next is seen by both,
+        // so it must be one that neither will move.
+        if (start && start == r.end->prev()
+                && ((seg->collisionInfo(start)->flags() & SlotCollision::COLL_FIX)
+                    || start->attachedTo() || start->firstChild()))
+            return false;
+    }
+    if (ranges.size() < 2)
+        return false;
+
+    for (const CollisionRange *r = ranges.begin(); r != ranges.end(); ++r)
+    {
+        for (Slot *s = r->start; s != r->end; s = s->next())
         {
-            if (seg->collisionInfo(s)->flags() & SlotCollision::COLL_START)
-            {
-                start = s;
-                break;
-            }
+            const Slot *base = s;
+            for (int depth = 0; base->attachedTo() && depth < 100; ++depth)
+                base = base->attachedTo();
+            if (base != s && (base->index() >= owner.size() || owner[base->index()] != int(r - ranges.begin())))
+                return false;
         }
     }
     return true;
 }
 
+// Resolve each range on the face's task executor. Phase 1 of every range and
+// phase 2 of every range that moved in phase 1 are independent. The phase 2
+// of any other range depends on whether the range before it ended having
+// moved, so those are finished in order afterwards.
+bool Pass::collisionShiftConcurrent(Segment *seg, int dir, Vector<CollisionRange> &ranges) const
+{
+    Vector<size_t> todo;
+    for (size_t i = 0; i != ranges.size(); ++i)
+        todo.push_back(i);
+
+    CollisionShiftJob job = { this, seg, ranges.begin(), todo.begin(), dir, 1 };
+    seg->getFace()->runTasks(&Pass::collisionShiftTask, &job, todo.size());
+
+    todo.clear();
+    for (size_t i = 0; i != ranges.size(); ++i)
+    {
+        if (!ranges[i].ok)
+            return false;
+        if (ranges[i].moved)
+            todo.push_back(i);
+    }
+    job.todo = todo.begin();
+    job.phase = 2;
+    seg->getFace()->runTasks(&Pass::collisionShiftTask, &job, todo.size());
+
+    bool moved = false;
+    ShiftCollider shiftcoll(NULL);
+    const size_t * done = todo.begin();
+    for (CollisionRange *r = ranges.begin(); r != ranges.end(); ++r)
+    {
+        if (done != todo.end() && *done == size_t(r - ranges.begin()))
+            ++done;
+        else
+        {
+            r->moved = moved;
+            r->ok = collisionShiftLoops(seg, r->start, r->end, shiftcoll, dir, r->moved, r->hasCollisions, NULL);
+        }
+        if (!r->ok)
+            return false;
+        moved = r->moved;
+    }
+    return true;
+}
+
+void Pass::collisionShiftTask(void *data, size_t index)
+{
+    CollisionShiftJob & job = *static_cast<CollisionShiftJob *>(data);
+    CollisionRange & r = job.ranges[job.todo[index]];
+    ShiftCollider shiftcoll(NULL);
+
+    if (job.phase == 1)
+        r.ok = job.pass->collisionShiftRange(job.seg, r.start, r.end, shiftcoll, job.dir, r.moved, r.hasCollisions, NULL);
+    else
+        r.ok = job.pass->collisionShiftLoops(job.seg, r.start, r.end, shiftcoll, job.dir, r.moved, r.hasCollisions, NULL);
+}
+
 bool Pass::collisionKern(Segment *seg, int dir, json * const dbgout) const
 {
     Slot *start = seg->first();
@@ -911,6 +1238,7 @@ bool Pass::collisionFinish(Segment *seg, GR_MAYBE_UNUSED json * const dbgout) co
             const Position nullPosition(0, 0);
             c->setOffset(newOffset + c->offset());
             c->setShift(nullPosition);
+            seg->markDirty(s);
         }
     }
 //    seg->positionSlots();
@@ -999,6 +1327,7 @@ bool Pass::resolveCollisions(Segment *seg, Slot *slotFix, Slot *start,
                 Position here = slotFix->origin() + shift;
                 float clusterMin = here.x;
                 slotFix->firstChild()->finalise(seg, NULL, here, bbox, 0, clusterMin, rtl, false);
+                seg->markDirty(slotFix);
             }
         }
     }
@@ -1097,6 +1426,7 @@ float Pass::resolveKern(Segment *seg, Slot *slotFix, GR_MAYBE_UNUSED Slot *start
         Position delta = slotFix->advancePos() + mv - cFix->shift();
         slotFix->advance(delta);
         cFix->setShift(mv);
+        seg->markDirty(slotFix);
         return mv.x;
     }
     return 0.;
@@ -69,6 +69,40 @@ void SegCache::freeLevel(SegCacheStore * store, SegCachePrefixArray prefixes, si
     free(prefixes.raw);
 }
 
+size_t SegCache::levelMemoryUsage(const SegCacheStore * store, const Silf & silf,
+                                  SegCachePrefixArray prefixes, size_t level) const
+{
+    if (!prefixes.raw) return 0;
+    size_t n = (store->maxCmapGid() + 2) * sizeof(void*);
+    for (size_t i = 0; i < store->maxCmapGid(); i++)
+    {
+        if (!prefixes.array[i].raw) continue;
+        if (level + 1 < ePrefixLength)
+            n += levelMemoryUsage(store, silf, prefixes.array[i], level + 1);
+        else
+            n += prefixes.prefixEntries[i]->memoryUsage(silf);
+    }
+    return n;
+}
+
+size_t SegCache::memoryUsage(const SegCacheStore * store, const Silf & silf) const
+{
+    return sizeof(SegCache) + levelMemoryUsage(store, silf, m_prefixes, 0);
+}
+
+size_t SegCachePrefixEntry::memoryUsage(const Silf & silf) const
+{
+    size_t n = sizeof(SegCachePrefixEntry);
+    for (size_t j = 0; j < eMaxSpliceSize; j++)
+    {
+        if (!m_entryCounts[j]) continue;
+        n += ((m_entryBSIndex[j] << 1) - 1) * sizeof(SegCacheEntry);
+        for (size_t k = 0; k < m_entryCounts[j]; k++)
+            n += m_entries[j][k].memoryUsage(j + 1, silf);
+    }
+    return n;
+}
+
 void SegCache::clear(SegCacheStore * store)
 {
     freeLevel(store, m_prefixes, 0);
@@ -92,6 +92,21 @@ SegCacheEntry::SegCacheEntry(const uint16* cmapGlyphs, size_t length, Segment *
 }
 
 
+// The memory this entry's arrays take, length is the number of glyphs it
+// was cached for.
+size_t SegCacheEntry::memoryUsage(size_t length, const Silf & silf) const
+{
+    size_t n = (m_unicode ? length * sizeof(uint16) : 0)
+             + m_glyphLength * (sizeof(Slot) + silf.numUser() * sizeof(int16));
+    if (m_justs)
+    {
+        const size_t sizeof_sjust = SlotJustify::size_of(silf.numJustLevels());
+        for (const Slot * s = m_glyph, * const e = s + m_glyphLength; s != e; ++s)
+            if (s->m_justs) n += sizeof_sjust;
+    }
+    return n;
+}
+
 void SegCacheEntry::clear()
 {
     free(m_unicode);
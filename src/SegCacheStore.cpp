@@ -43,5 +43,21 @@ SegCacheStore::SegCacheStore(const Face & face, unsigned int numSilf, size_t max
 {
 }
 
+size_t SilfSegCache::memoryUsage(const SegCacheStore * cacheStore, const Silf & silf) const
+{
+    size_t n = m_cacheCount * sizeof(SegCache *);
+    for (size_t i = 0; i < m_cacheCount; i++)
+        n += m_caches[i]->memoryUsage(cacheStore, silf);
+    return n;
+}
+
+size_t SegCacheStore::memoryUsage(const Silf * silfs) const
+{
+    size_t n = sizeof(SegCacheStore) + m_numSilf * sizeof(SilfSegCache);
+    for (size_t i = 0; i < m_numSilf; i++)
+        n += m_caches[i].memoryUsage(this, silfs[i]);
+    return n;
+}
+
 #endif
 
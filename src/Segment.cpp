@@ -36,6 +36,7 @@ of the License or (at your option) any later version.
 #include "inc/Slot.h"
 #include "inc/Main.h"
 #include "inc/CmapCache.h"
+#include "inc/Font.h"
 #include "inc/Collider.h"
 #include "graphite2/Segment.h"
 
@@ -149,7 +150,7 @@ void Segment::appendSlot(int id, int cid, int gid, int iFeats, size_t coffset)
     m_charinfo[id].feats(iFeats);
     m_charinfo[id].base(coffset);
     const GlyphFace * theGlyph = m_face->glyphs().glyphSafe(gid);
-    m_charinfo[id].breakWeight(theGlyph ? theGlyph->attrs()[m_silf->aBreak()] : 0);
+    m_charinfo[id].breakWeight(glyphAttr(gid, m_silf->aBreak()));
     
     aSlot->child(NULL);
     aSlot->setGlyph(this, gid, theGlyph);
@@ -161,8 +162,8 @@ void Segment::appendSlot(int id, int cid, int gid, int iFeats, size_t coffset)
     m_last = aSlot;
     if (!m_first) m_first = aSlot;
     if (theGlyph && m_silf->aPassBits())
-        m_passBits &= theGlyph->attrs()[m_silf->aPassBits()] 
-                    | (m_silf->numPasses() > 16 ? (theGlyph->attrs()[m_silf->aPassBits() + 1] << 16) : 0);
+        m_passBits &= uint16(glyphAttr(gid, m_silf->aPassBits()))
+                    | (m_silf->numPasses() > 16 ? (uint16(glyphAttr(gid, m_silf->aPassBits() + 1)) << 16) : 0);
 }
 
 Slot *Segment::newSlot()
@@ -413,6 +414,9 @@ Position Segment::positionSlots(const Font *font, Slot * iStart, Slot * iEnd, bo
     float clusterMin = 0.;
     Rect bbox;
     bool reorder = (currdir() != isRtl);
+    const uint8 posState = SEG_POSITIONED | (isRtl ? SEG_POSRTL : 0) | (isFinal ? SEG_POSFINAL : 0)
+                            | (currdir() ? SEG_POSCURRDIR : 0);
+    const uint8 posMask = SEG_POSITIONED | SEG_POSRTL | SEG_POSFINAL | SEG_POSCURRDIR;
 
     if (reorder)
     {
@@ -428,24 +432,41 @@ Position Segment::positionSlots(const Font *font, Slot * iStart, Slot * iEnd, bo
     if (!iStart || !iEnd)   // only true for empty segments
         return currpos;
 
-    if (isRtl)
+    // A whole segment unscaled pass records where each cluster left the pen.
+    // If nothing but some clusters has changed since the last such pass, we
+    // only need to redo clusters from the first dirty one until the pen
+    // position coming out of a cluster matches the one recorded for it.
+    // This only helps the repeated positioning done between passes while
+    // shaping. finalise() positions with the font once, and justify()
+    // invalidates the recorded positions first, so both always run in full.
+    const bool whole = !font && iStart == m_first && iEnd == m_last;
+    const bool incremental = whole && (m_flags & posMask) == posState;
+    bool inSync = true;
+
+    for (Slot * s = isRtl ? iEnd : iStart, * const end = isRtl ? iStart->prev() : iEnd->next();
+            s && s != end; s = isRtl ? s->prev() : s->next())
     {
-        for (Slot * s = iEnd, * const end = iStart->prev(); s && s != end; s = s->prev())
+        if (!s->isBase())   continue;
+
+        if (incremental && inSync && !s->isDirty())
         {
-            if (s->isBase())
-                currpos = s->finalise(this, font, currpos, bbox, 0, clusterMin = currpos.x, isRtl, isFinal);
+            currpos = s->m_clusterEnd;
+            continue;
         }
-    }
-    else
-    {
-        for (Slot * s = iStart, * const end = iEnd->next(); s && s != end; s = s->next())
+        currpos = s->finalise(this, font, currpos, bbox, 0, clusterMin = currpos.x, isRtl, isFinal);
+        if (whole)
         {
-            if (s->isBase())
-                currpos = s->finalise(this, font, currpos, bbox, 0, clusterMin = currpos.x, isRtl, isFinal);
+            inSync = currpos.x == s->m_clusterEnd.x && currpos.y == s->m_clusterEnd.y;
+            s->m_clusterEnd = currpos;
+            s->markDirty(false);
         }
     }
     if (reorder)
         reverseSlots();
+
+    m_flags &= ~posMask;
+    if (whole)
+        m_flags |= posState;
     return currpos;
 }
 
@@ -487,24 +508,37 @@ void Segment::associateChars(int offset, int numChars)
 }
 
 
-template <typename utf_iter>
-inline void process_utf_data(Segment & seg, const Face & face, const int fid, utf_iter c, size_t n_chars)
+template <typename C>
+inline void process_utf_data(Segment & seg, const Face & face, const int fid, const void * text, size_t n_chars)
 {
+    typedef typename utf<C>::codeunit_t codeunit_t;
     const Cmap    & cmap = face.cmap();
     int slotid = 0;
 
-    const typename utf_iter::codeunit_type * const base = c;
-    for (; n_chars; --n_chars, ++c, ++slotid)
+    // Decode a block of characters at a time, then map them.
+    uchar_t usvs[64];
+    size_t  offsets[64];
+    uint16  gids[64];
+    const codeunit_t * const base = static_cast<const codeunit_t *>(text);
+    const codeunit_t * cp = base;
+    while (n_chars)
     {
-        const uint32 usv = *c;
-        uint16 gid = cmap[usv];
-        if (!gid)   gid = face.findPseudo(usv);
-        seg.appendSlot(slotid, usv, gid, fid, c - base);
+        const size_t n = min(n_chars, sizeof(usvs)/sizeof(*usvs));
+        utf<C>::decode(cp, base, usvs, offsets, n);
+        cmap.lookup(usvs, gids, n);
+        for (size_t i = 0; i != n; ++i, ++slotid)
+        {
+            const uint32 usv = usvs[i];
+            const uint16 gid = gids[i] ? gids[i] : face.findPseudo(usv);
+            seg.appendSlot(slotid, usv, gid, fid, offsets[i]);
+        }
+        n_chars -= n;
     }
 }
 
 
-bool Segment::read_text(const Face *face, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void* pStart, size_t nChars)
+bool Segment::read_text(const Face *face, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void* pStart, size_t nChars,
+                        const gr_feature_run *runs, size_t nRuns)
 {
     assert(face);
     assert(pFeats);
@@ -513,13 +547,50 @@ bool Segment::read_text(const Face *face, const Features* pFeats/*must not be NU
     // utf iterator is self recovering so we don't care about the error state of the iterator.
     switch (enc)
     {
-    case gr_utf8:   process_utf_data(*this, *face, addFeatures(*pFeats), utf8::const_iterator(pStart), nChars); break;
-    case gr_utf16:  process_utf_data(*this, *face, addFeatures(*pFeats), utf16::const_iterator(pStart), nChars); break;
-    case gr_utf32:  process_utf_data(*this, *face, addFeatures(*pFeats), utf32::const_iterator(pStart), nChars); break;
+    case gr_utf8:   process_utf_data<uint8>(*this, *face, addFeatures(*pFeats), pStart, nChars); break;
+    case gr_utf16:  process_utf_data<uint16>(*this, *face, addFeatures(*pFeats), pStart, nChars); break;
+    case gr_utf32:  process_utf_data<uint32>(*this, *face, addFeatures(*pFeats), pStart, nChars); break;
+    }
+
+    // Later runs override earlier ones, so apply them in order.
+    for (const gr_feature_run * const end = runs + nRuns; runs != end; ++runs)
+    {
+        if (runs->first >= m_numCharinfo || runs->length == 0) continue;
+        const Features & feats = runs->feats ? *static_cast<const Features *>(runs->feats)
+                                             : face->theSill().theFeatureMap().defaultFeatures();
+        const int fid = findOrAddFeatures(feats);
+        if (fid < 0) return false;
+        const size_t last = runs->length < m_numCharinfo - runs->first ? runs->first + runs->length : m_numCharinfo;
+        for (size_t i = runs->first; i != last; ++i)
+            m_charinfo[i].feats(fid);
     }
     return true;
 }
 
+int Segment::findOrAddFeatures(const Features & feats)
+{
+    for (FeatureList::const_iterator f = m_feats.begin(), end = m_feats.end(); f != end; ++f)
+        if (*f == feats) return int(f - m_feats.begin());
+    // CharInfo holds the feature index in a byte.
+    if (m_feats.size() > 0xFF) return -1;
+    return addFeatures(feats);
+}
+
+// Have the font get the hinted advances it lacks for all our glyphs in one go,
+//  rather than one at a time as the slots are positioned.
+void Segment::fetchAdvances(const Font *font) const
+{
+    if (!font->fetchesAdvances()) return;
+
+    const uint16 numGlyphs = m_face->glyphs().numGlyphs();
+    Vector<uint16> glyphs;
+    glyphs.reserve(slotCount());
+    for (const Slot * s = m_first; s; s = s->next())
+        if (s->glyph() < numGlyphs)
+            glyphs.push_back(s->glyph());
+    font->fetchAdvances(glyphs.begin(), glyphs.size());
+}
+
 void Segment::doMirror(uint16 aMirror)
 {
     Slot * s;
@@ -36,13 +36,55 @@ of the License or (at your option) any later version.
 
 using namespace graphite2;
 
-namespace { static const uint32 ERROROFFSET = 0xFFFFFFFF; }
+namespace
+{
+    static const uint32 ERROROFFSET = 0xFFFFFFFF;
+
+    // The outcome of reading one pass, kept apart so passes can be read in
+    // any order and the first failure reported as if they were read in turn.
+    struct PassLoad
+    {
+        uint32  start,
+                end;
+        Error   e;
+        bool    ok;
+    };
+
+    struct PassLoadJob
+    {
+        Silf          * silf;
+        Pass          * passes;
+        PassLoad      * loads;
+        const byte    * silf_start;
+        Face          * face;
+        uint32          version;
+        bool            lazy_rules;
+    };
+
+    static const uint16 NO_INDEX = 0xFFFF;
+
+    inline uint32 hash_bucket(uint32 key, uint8 bits)
+    {
+        return (key * 0x9E3779B1u) >> (32 - bits);
+    }
+
+    inline uint8 hash_bits(uint32 n)
+    {
+        uint8 bits = 1;
+        while ((1u << bits) < 2 * n)
+            ++bits;
+        return bits;
+    }
+}
 
 Silf::Silf() throw()
 : m_passes(0),
   m_pseudos(0),
+  m_pseudoIndex(0),
   m_classOffsets(0),
   m_classData(0),
+  m_classIndex(0),
+  m_classIndexData(0),
   m_justs(0),
   m_numPasses(0),
   m_numJusts(0),
@@ -60,6 +102,7 @@ Silf::Silf() throw()
   m_aPassBits(0),
   m_iMaxComp(0),
   m_aCollision(0),
+  m_pseudoBits(0),
   m_aLig(0),
   m_numPseudo(0),
   m_nClass(0),
@@ -78,18 +121,24 @@ void Silf::releaseBuffers() throw()
 {
     delete [] m_passes;
     delete [] m_pseudos;
+    free(m_pseudoIndex);
     free(m_classOffsets);
     free(m_classData);
+    free(m_classIndex);
+    free(m_classIndexData);
     free(m_justs);
     m_passes= 0;
     m_pseudos = 0;
+    m_pseudoIndex = 0;
     m_classOffsets = 0;
     m_classData = 0;
+    m_classIndex = 0;
+    m_classIndexData = 0;
     m_justs = 0;
 }
 
 
-bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face, uint32 version)
+bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face, uint32 version, bool lazyRules)
 {
     const byte * p = silf_start,
                * const silf_end = p + lSilf;
@@ -188,38 +237,65 @@ bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face,
         m_pseudos[i].uid = be::read<uint32>(p);
         m_pseudos[i].gid = be::read<uint16>(p);
     }
+    if (e.test(!indexPseudos(), E_OUTOFMEM))
+    {
+        releaseBuffers(); return face.error(e);
+    }
 
     const size_t clen = readClassMap(p, passes_start + silf_start - p, version, e);
     m_passes = new Pass[m_numPasses];
     if (e || e.test(clen > unsigned(passes_start + silf_start - p), E_BADPASSESSTART)
           || e.test(!m_passes, E_OUTOFMEM))
     { releaseBuffers(); return face.error(e); }
+    indexClasses();
 
-    for (size_t i = 0; i < m_numPasses; ++i)
+    // Check where every pass lies first, after that the passes can be read
+    //  in any order, and concurrently if the face has a task executor.
+    Vector<PassLoad> loads(m_numPasses);
+    size_t num_checked = 0;
+    for (; num_checked < m_numPasses; ++num_checked)
     {
-        uint32 pass_start = be::read<uint32>(o_passes);
-        uint32 pass_end = be::peek<uint32>(o_passes);
-        face.error_context((face.error_context() & 0xFF00) + EC_ASILF + (i << 16));
-        if (e.test(pass_start > pass_end, E_BADPASSSTART) 
-                || e.test(pass_start < passes_start, E_BADPASSSTART)
-                || e.test(pass_end > lSilf, E_BADPASSEND)) {
-            releaseBuffers(); return face.error(e);
+        PassLoad & l = loads[num_checked];
+        l.start = be::read<uint32>(o_passes);
+        l.end = be::peek<uint32>(o_passes);
+        l.e.context((face.error_context() & 0xFF00) + EC_ASILF + (num_checked << 16));
+        if (e.test(l.start > l.end, E_BADPASSSTART)
+                || e.test(l.start < passes_start, E_BADPASSSTART)
+                || e.test(l.end > lSilf, E_BADPASSEND))
+        {
+            e.context(l.e.context());
+            break;
         }
+        m_passes[num_checked].init(this);
+    }
 
-        enum passtype pt = PASS_TYPE_UNKNOWN;
-        if (i >= m_jPass) pt = PASS_TYPE_JUSTIFICATION;
-        else if (i >= m_pPass) pt = PASS_TYPE_POSITIONING;
-        else if (i >= m_sPass) pt = PASS_TYPE_SUBSTITUTE;
-        else pt = PASS_TYPE_LINEBREAK;
+    PassLoadJob job = { this, m_passes, loads.begin(), silf_start, &face, version, lazyRules };
+#ifndef GRAPHITE2_TELEMETRY
+    if (face.canRunTasks())
+        face.runTasks(&Silf::readPassTask, &job, num_checked);
+    else
+#endif
+    for (size_t i = 0; i != num_checked; ++i)
+    {
+        readPassTask(&job, i);
+        if (!loads[i].ok) break;
+    }
 
-        m_passes[i].init(this);
-        if (!m_passes[i].readPass(silf_start + pass_start, pass_end - pass_start, pass_start, face, pt,
-            version, e))
+    for (size_t i = 0; i != num_checked; ++i)
+    {
+        if (!loads[i].ok)
         {
+            face.error_context(loads[i].e.context());
             releaseBuffers();
-            return false;
+            return face.error(loads[i].e);
         }
     }
+    if (num_checked != m_numPasses)
+    {
+        face.error_context(e.context());
+        releaseBuffers();
+        return face.error(e);
+    }
 
     // fill in gr_faceinfo
     m_silfinfo.upem = face.glyphs().unitsPerEm();
@@ -230,6 +306,22 @@ bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face,
     return true;
 }
 
+void Silf::readPassTask(void *data, size_t index)
+{
+    PassLoadJob & job = *static_cast<PassLoadJob *>(data);
+    const Silf & silf = *job.silf;
+    PassLoad & l = job.loads[index];
+
+    enum passtype pt = PASS_TYPE_UNKNOWN;
+    if (index >= silf.m_jPass) pt = PASS_TYPE_JUSTIFICATION;
+    else if (index >= silf.m_pPass) pt = PASS_TYPE_POSITIONING;
+    else if (index >= silf.m_sPass) pt = PASS_TYPE_SUBSTITUTE;
+    else pt = PASS_TYPE_LINEBREAK;
+
+    l.ok = job.passes[index].readPass(job.silf_start + l.start, l.end - l.start, l.start, *job.face, pt,
+                                       job.version, job.lazy_rules, l.e);
+}
+
 template<typename T> inline uint32 Silf::readClassOffsets(const byte *&p, size_t data_len, Error &e)
 {
     const T cls_off = 2*sizeof(uint16) + sizeof(T)*(m_nClass+1);
@@ -301,17 +393,218 @@ size_t Silf::readClassMap(const byte *p, size_t data_len, uint32 version, Error
     return max_off;
 }
 
-uint16 Silf::findPseudo(uint32 uid) const
+// Gives lookup classes a gid to index map that takes constant time to search,
+// and an index to gid table, within a memory budget proportional to the class
+// data. Classes spanning a small range of glyphs get a dense table, others with
+// enough glyphs to make searching them slow get a hash. The maps give exactly
+// what searching the class data would, so a class whose glyphs are not strictly
+// sorted is left to be searched. Linear classes are output classes and are only
+// searched if a font misuses one, so they are not indexed.
+void Silf::indexClasses()
 {
+    const uint16 nLookup = m_nClass - m_nLinear;
+    if (!nLookup)   return;
+
+    m_classIndex = grzeroalloc<ClassIndex>(nLookup);
+    if (!m_classIndex)  return;
+
+    const size_t budget = 4096 + 2 * size_t(m_classOffsets[m_nClass]);
+    size_t total = 0;
+    for (uint16 cid = m_nLinear; cid < m_nClass; ++cid)
+    {
+        ClassIndex & ci = m_classIndex[cid - m_nLinear];
+        const uint32 loc = m_classOffsets[cid];
+        const uint16 * const pairs = m_classData + loc + 4;
+
+        // getClassGlyph scans the pairs up to the next class's offset.
+        const uint32 end = m_classOffsets[cid + 1];
+        uint32 num_glyphs = end > loc + 4 ? (end - loc - 4) / 2 : 0;
+        for (uint32 i = 0; i < num_glyphs; ++i)
+            if (pairs[2*i + 1] >= num_glyphs)
+                num_glyphs = 0;
+        if (num_glyphs && total + num_glyphs <= budget)
+        {
+            ci.num_glyphs = num_glyphs;
+            total += num_glyphs;
+        }
+
+        const uint32 n = m_classData[loc];
+        uint16 lo = 0xFFFF, hi = 0;
+        bool sorted = true;
+        for (uint32 i = 0; i < n; ++i)
+        {
+            sorted &= i == 0 || pairs[2*i - 2] < pairs[2*i];
+            lo = min(lo, pairs[2*i]);
+            hi = max(hi, pairs[2*i]);
+        }
+        if (!sorted) continue;
+
+        const uint32 range = hi - lo + 1;
+        if (range <= 4 * n + 16 && total + range <= budget)
+        {
+            ci.base = lo;
+            ci.size = range;
+            total += range;
+        }
+        else if (n > 8 && total + 2 * (1u << hash_bits(n)) <= budget)
+        {
+            ci.bits = hash_bits(n);
+            ci.size = 1u << ci.bits;
+            total += 2 * ci.size;
+        }
+    }
+
+    m_classIndexData = gralloc<uint16>(total);
+    if (!m_classIndexData)
+    {
+        free(m_classIndex);
+        m_classIndex = 0;
+        return;
+    }
+
+    uint16 * d = m_classIndexData;
+    for (uint16 cid = m_nLinear; cid < m_nClass; ++cid)
+    {
+        ClassIndex & ci = m_classIndex[cid - m_nLinear];
+        const uint32 loc = m_classOffsets[cid];
+        const uint16 * const pairs = m_classData + loc + 4;
+        if (ci.num_glyphs)
+        {
+            // The first pair with an index wins, so fill from the back.
+            ci.glyphs = d;
+            d += ci.num_glyphs;
+            memset(ci.glyphs, 0, ci.num_glyphs * sizeof(uint16));
+            for (uint32 i = ci.num_glyphs; i--;)
+                ci.glyphs[pairs[2*i + 1]] = pairs[2*i];
+        }
+        if (!ci.size) continue;
+
+        const uint32 len = ci.bits ? 2 * ci.size : ci.size,
+                     mask = ci.size - 1;
+        ci.table = d;
+        d += len;
+        memset(ci.table, 0xFF, len * sizeof(uint16));
+        for (uint32 i = 0, n = m_classData[loc]; i < n; ++i)
+        {
+            const uint16 gid = pairs[2*i], index = pairs[2*i + 1];
+            if (!ci.bits)
+            {
+                ci.table[gid - ci.base] = index;
+                continue;
+            }
+            if (index == NO_INDEX) continue;
+            uint32 b = hash_bucket(gid, ci.bits);
+            while (ci.table[2*b + 1] != NO_INDEX)
+                b = (b + 1) & mask;
+            ci.table[2*b] = gid;
+            ci.table[2*b + 1] = index;
+        }
+    }
+}
+
+// Hashes the pseudo glyphs by code point into an open addressed table of
+// indices into m_pseudos, at most half full. Where a code point appears more
+// than once the first entry wins, as it did when the list was searched in order.
+bool Silf::indexPseudos()
+{
+    if (!m_numPseudo)   return true;
+
+    m_pseudoBits = hash_bits(m_numPseudo);
+    m_pseudoIndex = grzeroalloc<uint16>(size_t(1) << m_pseudoBits);
+    if (!m_pseudoIndex) return false;
+
+    const uint32 mask = (1u << m_pseudoBits) - 1;
     for (int i = 0; i < m_numPseudo; i++)
-        if (m_pseudos[i].uid == uid) return m_pseudos[i].gid;
+    {
+        uint32 b = hash_bucket(m_pseudos[i].uid, m_pseudoBits);
+        while (m_pseudoIndex[b] && m_pseudos[m_pseudoIndex[b] - 1].uid != m_pseudos[i].uid)
+            b = (b + 1) & mask;
+        if (!m_pseudoIndex[b])
+            m_pseudoIndex[b] = uint16(i + 1);
+    }
+    return true;
+}
+
+uint16 Silf::findPseudo(uint32 uid) const
+{
+    if (!m_pseudoIndex) return 0;
+
+    const uint32 mask = (1u << m_pseudoBits) - 1;
+    for (uint32 b = hash_bucket(uid, m_pseudoBits); m_pseudoIndex[b]; b = (b + 1) & mask)
+    {
+        const Pseudo & ps = m_pseudos[m_pseudoIndex[b] - 1];
+        if (ps.uid == uid) return ps.gid;
+    }
     return 0;
 }
 
+void Silf::memoryUsage(gr_face_memory & usage) const
+{
+    usage.classes += sizeof(Silf) + m_numPseudo * sizeof(Pseudo) + m_numJusts * sizeof(Justinfo);
+    if (m_pseudoIndex)
+        usage.classes += (size_t(1) << m_pseudoBits) * sizeof(uint16);
+    if (m_classIndex)
+    {
+        usage.classes += (m_nClass - m_nLinear) * sizeof(ClassIndex);
+        for (const ClassIndex * ci = m_classIndex, * const e = ci + m_nClass - m_nLinear; ci != e; ++ci)
+            usage.classes += (ci->num_glyphs + (ci->bits ? 2 * ci->size : ci->size)) * sizeof(uint16);
+    }
+    if (m_classOffsets && m_classData)
+        usage.classes += (m_nClass + 1) * sizeof(uint32) + m_classOffsets[m_nClass] * sizeof(uint16);
+    for (int i = 0; i < m_numPasses; ++i)
+        usage.passes += m_passes[i].memoryUsage();
+}
+
+// Add the glyph attributes the engine itself reads for each slot.
+void Silf::hotAttrs(Vector<uint16> & attrs) const
+{
+    attrs.push_back(m_aPseudo);
+    attrs.push_back(m_aBreak);
+    attrs.push_back(m_aBidi);
+    attrs.push_back(m_aMirror);
+    attrs.push_back(m_aMirror + 1);
+    if (m_aPassBits)
+    {
+        attrs.push_back(m_aPassBits);
+        if (m_numPasses > 16)
+            attrs.push_back(m_aPassBits + 1);
+    }
+    if (m_aCollision)
+        for (uint16 i = 0; i != 16; ++i)
+            attrs.push_back(m_aCollision + i);
+    for (const Justinfo * j = m_justs, * const e = m_justs + m_numJusts; j != e; ++j)
+    {
+        attrs.push_back(j->attrStretch());
+        attrs.push_back(j->attrShrink());
+        attrs.push_back(j->attrStep());
+        attrs.push_back(j->attrWeight());
+    }
+}
+
 uint16 Silf::findClassIndex(uint16 cid, uint16 gid) const
 {
     if (cid > m_nClass) return -1;
 
+    if (m_classIndex && cid >= m_nLinear && cid < m_nClass && m_classIndex[cid - m_nLinear].table)
+    {
+        const ClassIndex & ci = m_classIndex[cid - m_nLinear];
+        if (!ci.bits)
+        {
+            const unsigned int i = unsigned(gid) - ci.base;
+            return i < ci.size ? ci.table[i] : NO_INDEX;
+        }
+        const uint32 mask = ci.size - 1;
+        for (uint32 b = hash_bucket(gid, ci.bits); ci.table[2*b + 1] != NO_INDEX; b = (b + 1) & mask)
+            if (ci.table[2*b] == gid) return ci.table[2*b + 1];
+        return NO_INDEX;
+    }
+    return searchClassIndex(cid, gid);
+}
+
+uint16 Silf::searchClassIndex(uint16 cid, uint16 gid) const
+{
+    if (cid > m_nClass) return -1;
+
     const uint16 * cls = m_classData + m_classOffsets[cid];
     if (cid < m_nLinear)        // output class being used for input, shouldn't happen
     {
@@ -338,6 +631,18 @@ uint16 Silf::getClassGlyph(uint16 cid, unsigned int index) const
 {
     if (cid > m_nClass) return 0;
 
+    if (m_classIndex && cid >= m_nLinear && cid < m_nClass && m_classIndex[cid - m_nLinear].glyphs)
+    {
+        const ClassIndex & ci = m_classIndex[cid - m_nLinear];
+        return index < ci.num_glyphs ? ci.glyphs[index] : 0;
+    }
+    return searchClassGlyph(cid, index);
+}
+
+uint16 Silf::searchClassGlyph(uint16 cid, unsigned int index) const
+{
+    if (cid > m_nClass) return 0;
+
     uint32 loc = m_classOffsets[cid];
     if (cid < m_nLinear)
     {
@@ -401,7 +706,10 @@ bool Silf::runGraphite(Segment *seg, uint8 firstPass, uint8 lastPass, int dobidi
             if (seg->currdir() != (m_dir & 1))
                 seg->reverseSlots();
             if (m_aMirror && (seg->dir() & 3) == 3)
+            {
                 seg->doMirror(m_aMirror);
+                seg->invalidatePositions();
+            }
         --i;
         lbidi = lastPass;
         --lastPass;
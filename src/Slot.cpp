@@ -34,12 +34,14 @@ of the License or (at your option) any later version.
 
 using namespace graphite2;
 
+#define MAX_CLUSTER_DEPTH   100
+
 Slot::Slot(int16 *user_attrs) :
     m_next(NULL), m_prev(NULL),
     m_glyphid(0), m_realglyphid(0), m_original(0), m_before(0), m_after(0),
     m_index(0), m_parent(NULL), m_child(NULL), m_sibling(NULL),
     m_position(0, 0), m_shift(0, 0), m_advance(0, 0),
-    m_attach(0, 0), m_with(0, 0), m_just(0.),
+    m_attach(0, 0), m_with(0, 0), m_clusterEnd(0, 0), m_just(0.),
     m_flags(0), m_attLevel(0), m_bidiCls(-1), m_bidiLevel(0), 
     m_userAttr(user_attrs), m_justs(NULL)
 {
@@ -85,70 +87,125 @@ void Slot::update(int /*numGrSlots*/, int numCharInfo, Position &relpos)
     m_position = m_position + relpos;
 }
 
+// Walks the cluster hanging off this slot: each slot, then its attachments,
+// then its later siblings, using an explicit stack rather than recursion.
 Position Slot::finalise(const Segment *seg, const Font *font, Position & base, Rect & bbox, uint8 attrLevel, float & clusterMin, bool rtl, bool isFinal, int depth)
 {
-    SlotCollision *coll = NULL;
-    if (depth > 100 || (attrLevel && m_attLevel > attrLevel)) return Position(0, 0);
-    float scale = font ? font->scale() : 1.0f;
-    Position shift(m_shift.x * (rtl * -2 + 1) + m_just, m_shift.y);
-    float tAdvance = m_advance.x + m_just;
-    if (isFinal && (coll = seg->collisionInfo(this)))
-    {
-        const Position &collshift = coll->offset();
-        if (!(coll->flags() & SlotCollision::COLL_KERN) || rtl)
-            shift = shift + collshift;
-    }
-    const GlyphFace * glyphFace = seg->getFace()->glyphs().glyphSafe(glyph());
-    if (font)
+    enum { VISIT, AFTER_CHILD, AFTER_SIBLING };
+    struct Frame
     {
-        scale = font->scale();
-        shift *= scale;
-        if (font->isHinted() && glyphFace)
-            tAdvance = (m_advance.x - glyphFace->theAdvance().x + m_just) * scale + font->advance(glyph());
-        else
-            tAdvance *= scale;
-    }    
+        Slot       * slot;
+        Position    base,
+                    res;
+        int         depth;
+        int         stage;
+    } stack[MAX_CLUSTER_DEPTH + 2];
+
+    const float scale = font ? font->scale() : 1.0f;
+    const GlyphCache & gc = seg->getFace()->glyphs();
     Position res;
+    int top = 0;
+    stack[0].slot = this;
+    stack[0].base = base;
+    stack[0].depth = depth;
+    stack[0].stage = VISIT;
 
-    m_position = base + shift;
-    if (!m_parent)
-    {
-        res = base + Position(tAdvance, m_advance.y * scale);
-        clusterMin = m_position.x;
-    }
-    else
+    while (top >= 0)
     {
-        float tAdv;
-        m_position += (m_attach - m_with) * scale;
-        tAdv = m_advance.x >= 0.5f ? m_position.x + tAdvance - shift.x : 0.f;
-        res = Position(tAdv, 0);
-        if ((m_advance.x >= 0.5f || m_position.x < 0) && m_position.x < clusterMin) clusterMin = m_position.x;
-    }
+        Frame & f = stack[top];
+        Slot * const s = f.slot;
 
-    if (glyphFace)
-    {
-        Rect ourBbox = glyphFace->theBBox() * scale + m_position;
-        bbox = bbox.widen(ourBbox);
-    }
+        switch (f.stage)
+        {
+        case VISIT:
+        {
+            if (f.depth > MAX_CLUSTER_DEPTH || (attrLevel && s->m_attLevel > attrLevel))
+            {
+                res = Position(0, 0);
+                --top;
+                continue;
+            }
+            SlotCollision *coll = NULL;
+            Position shift(s->m_shift.x * (rtl * -2 + 1) + s->m_just, s->m_shift.y);
+            float tAdvance = s->m_advance.x + s->m_just;
+            if (isFinal && (coll = seg->collisionInfo(s)))
+            {
+                const Position &collshift = coll->offset();
+                if (!(coll->flags() & SlotCollision::COLL_KERN) || rtl)
+                    shift = shift + collshift;
+            }
+            const GlyphFace * glyphFace = gc.glyphSafe(s->glyph());
+            if (font)
+            {
+                shift *= scale;
+                if (font->isHinted() && glyphFace)
+                    tAdvance = (s->m_advance.x - glyphFace->theAdvance().x + s->m_just) * scale + font->advance(s->glyph());
+                else
+                    tAdvance *= scale;
+            }
 
-    if (m_child && m_child != this && m_child->attachedTo() == this)
-    {
-        Position tRes = m_child->finalise(seg, font, m_position, bbox, attrLevel, clusterMin, rtl, isFinal, depth + 1);
-        if ((!m_parent || m_advance.x >= 0.5f) && tRes.x > res.x) res = tRes;
-    }
+            s->m_position = f.base + shift;
+            if (!s->m_parent)
+            {
+                f.res = f.base + Position(tAdvance, s->m_advance.y * scale);
+                clusterMin = s->m_position.x;
+            }
+            else
+            {
+                s->m_position += (s->m_attach - s->m_with) * scale;
+                f.res = Position(s->m_advance.x >= 0.5f ? s->m_position.x + tAdvance - shift.x : 0.f, 0);
+                if ((s->m_advance.x >= 0.5f || s->m_position.x < 0) && s->m_position.x < clusterMin) clusterMin = s->m_position.x;
+            }
 
-    if (m_parent && m_sibling && m_sibling != this && m_sibling->attachedTo() == m_parent)
-    {
-        Position tRes = m_sibling->finalise(seg, font, base, bbox, attrLevel, clusterMin, rtl, isFinal, depth + 1);
-        if (tRes.x > res.x) res = tRes;
-    }
-    
-    if (!m_parent && clusterMin < base.x)
-    {
-        Position adj = Position(m_position.x - clusterMin, 0.);
-        res += adj;
-        m_position += adj;
-        if (m_child) m_child->floodShift(adj);
+            if (glyphFace)
+            {
+                Rect ourBbox = glyphFace->theBBox() * scale + s->m_position;
+                bbox = bbox.widen(ourBbox);
+            }
+
+            if (s->m_child && s->m_child != s && s->m_child->attachedTo() == s)
+            {
+                f.stage = AFTER_CHILD;
+                Frame & next = stack[++top];
+                next.slot = s->m_child;
+                next.base = s->m_position;
+                next.depth = f.depth + 1;
+                next.stage = VISIT;
+                continue;
+            }
+        }
+        // no attachments, so move straight on to the siblings
+        /* fallthrough */
+        case AFTER_CHILD:
+            if (f.stage == AFTER_CHILD && (!s->m_parent || s->m_advance.x >= 0.5f) && res.x > f.res.x)
+                f.res = res;
+
+            if (s->m_parent && s->m_sibling && s->m_sibling != s && s->m_sibling->attachedTo() == s->m_parent)
+            {
+                f.stage = AFTER_SIBLING;
+                Frame & next = stack[++top];
+                next.slot = s->m_sibling;
+                next.base = f.base;
+                next.depth = f.depth + 1;
+                next.stage = VISIT;
+                continue;
+            }
+            break;
+
+        case AFTER_SIBLING:
+            if (res.x > f.res.x) f.res = res;
+            break;
+        }
+
+        if (!s->m_parent && clusterMin < f.base.x)
+        {
+            Position adj = Position(s->m_position.x - clusterMin, 0.);
+            f.res += adj;
+            s->m_position += adj;
+            if (s->m_child) s->m_child->floodShift(adj);
+        }
+        res = f.res;
+        --top;
     }
     return res;
 }
@@ -161,6 +218,7 @@ int32 Slot::clusterMetric(const Segment *seg, uint8 metric, uint8 attrLevel, boo
     Rect bbox = seg->theGlyphBBoxTemporary(glyph());
     float clusterMin = 0.;
     Position res = finalise(seg, NULL, base, bbox, attrLevel, clusterMin, rtl, false);
+    markDirty(true);
 
     switch (metrics(metric))
     {
@@ -468,7 +526,7 @@ void Slot::setGlyph(Segment *seg, uint16 glyphid, const GlyphFace * theGlyph)
             return;
         }
     }
-    m_realglyphid = theGlyph->attrs()[seg->silf()->aPseudo()];
+    m_realglyphid = seg->glyphAttr(glyphid, seg->silf()->aPseudo());
     if (m_realglyphid > seg->getFace()->glyphs().numGlyphs())
         m_realglyphid = 0;
     const GlyphFace *aGlyph = theGlyph;
@@ -480,15 +538,15 @@ void Slot::setGlyph(Segment *seg, uint16 glyphid, const GlyphFace * theGlyph)
     m_advance = Position(aGlyph->theAdvance().x, 0.);
     if (seg->silf()->aPassBits())
     {
-        seg->mergePassBits(theGlyph->attrs()[seg->silf()->aPassBits()]);
+        seg->mergePassBits(uint16(seg->glyphAttr(glyphid, seg->silf()->aPassBits())));
         if (seg->silf()->numPasses() > 16)
-            seg->mergePassBits(theGlyph->attrs()[seg->silf()->aPassBits()+1] << 16);
+            seg->mergePassBits(uint16(seg->glyphAttr(glyphid, seg->silf()->aPassBits()+1)) << 16);
     }
 }
 
 void Slot::floodShift(Position adj, int depth)
 {
-    if (depth > 100)
+    if (depth > MAX_CLUSTER_DEPTH)
         return;
     m_position += adj;
     if (m_child) m_child->floodShift(adj, depth + 1);
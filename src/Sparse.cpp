@@ -34,7 +34,7 @@ const sparse::chunk sparse::empty_chunk = {0,0};
 
 sparse::~sparse() throw()
 {
-    if (m_array.map == &empty_chunk) return;
+    if (m_array.map == &empty_chunk || m_external) return;
     free(m_array.values);
 }
 
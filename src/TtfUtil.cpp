@@ -1080,6 +1080,68 @@ unsigned int CmapSubtable4NextCodepoint(const void *pCmap31, unsigned int nUnico
     return (iRange + 1 >= nRange) ? 0xFFFF : be::peek<uint16>(pStartCode + iRange + 1);
 }
 
+/*----------------------------------------------------------------------------------------------
+    Return true if the subtable's segments are well formed and sorted in ascending order
+    without overlapping, as the spec requires. Range keys from CmapSubtable4RangeKey are
+    only reliable for such tables.
+----------------------------------------------------------------------------------------------*/
+bool CmapSubtable4Ordered(const void * pCmap31)
+{
+    const Sfnt::CmapSubTableFormat4 * pTable = reinterpret_cast<const Sfnt::CmapSubTableFormat4 *>(pCmap31);
+
+    uint16 nRange = be::swap(pTable->seg_count_x2) >> 1;
+    const uint16 * pStartCode = pTable->end_code + nRange + 1;
+    for (uint16 i = 0; i < nRange; ++i)
+    {
+        uint16 chStart = be::peek<uint16>(pStartCode + i);
+        if (chStart > be::peek<uint16>(pTable->end_code + i)
+         || (i > 0 && chStart <= be::peek<uint16>(pTable->end_code + i - 1)))
+            return false;
+    }
+    return true;
+}
+
+/*----------------------------------------------------------------------------------------------
+    Return the range key CmapSubtable4Lookup should use for the given Unicode ID, and set
+    nFirst and nLast to the span of code points that share that key, so that a caller can
+    reuse it for nearby characters. Return -1 if no segment covers the Unicode ID, in which
+    case the span is the gap between segments that contains it.
+----------------------------------------------------------------------------------------------*/
+int CmapSubtable4RangeKey(const void * pCmap31, unsigned int nUnicodeId,
+        unsigned int & nFirst, unsigned int & nLast)
+{
+    const Sfnt::CmapSubTableFormat4 * pTable = reinterpret_cast<const Sfnt::CmapSubTableFormat4 *>(pCmap31);
+
+    uint16 nRange = be::swap(pTable->seg_count_x2) >> 1;
+
+    // Find the first segment whose end code is not below the Unicode ID.
+    unsigned int iLow = 0, iHigh = nRange;
+    while (iLow < iHigh)
+    {
+        const unsigned int iMid = (iLow + iHigh) >> 1;
+        if (be::peek<uint16>(pTable->end_code + iMid) < nUnicodeId)
+            iLow = iMid + 1;
+        else
+            iHigh = iMid;
+    }
+
+    nFirst = iLow ? be::peek<uint16>(pTable->end_code + iLow - 1) + 1 : 0;
+    if (iLow == nRange)
+    {
+        nLast = ~0u;
+        return -1;
+    }
+    unsigned int nStartCode = be::peek<uint16>(pTable->end_code + nRange + 1 + iLow);
+    if (nUnicodeId < nStartCode)
+    {
+        nLast = nStartCode - 1;
+        return -1;
+    }
+    nFirst = nStartCode;
+    nLast = be::peek<uint16>(pTable->end_code + iLow);
+    return iLow;
+}
+
 /*----------------------------------------------------------------------------------------------
     Check the Microsoft UCS-4 subtable for expected values.
 ----------------------------------------------------------------------------------------------*/
@@ -1199,6 +1261,67 @@ unsigned int CmapSubtable12NextCodepoint(const void *pCmap310, unsigned int nUni
     return (iRange + 1 >= nRange) ? 0x10FFFF : be::swap(pTable->group[iRange + 1].start_char_code);
 }
 
+/*----------------------------------------------------------------------------------------------
+    Return true if the subtable's groups are well formed and sorted in ascending order
+    without overlapping, as the spec requires. Range keys from CmapSubtable12RangeKey are
+    only reliable for such tables.
+----------------------------------------------------------------------------------------------*/
+bool CmapSubtable12Ordered(const void * pCmap310)
+{
+    const Sfnt::CmapSubTableFormat12 * pTable = reinterpret_cast<const Sfnt::CmapSubTableFormat12 *>(pCmap310);
+
+    uint32 ucGroups = be::swap(pTable->num_groups);
+    for (uint32 i = 0; i < ucGroups; ++i)
+    {
+        uint32 uStartCode = be::swap(pTable->group[i].start_char_code);
+        if (uStartCode > be::swap(pTable->group[i].end_char_code)
+         || (i > 0 && uStartCode <= be::swap(pTable->group[i-1].end_char_code)))
+            return false;
+    }
+    return true;
+}
+
+/*----------------------------------------------------------------------------------------------
+    Return the range key CmapSubtable12Lookup should use for the given Unicode ID, and set
+    uFirst and uLast to the span of code points that share that key, so that a caller can
+    reuse it for nearby characters. Return -1 if no group covers the Unicode ID, in which
+    case the span is the gap between groups that contains it.
+----------------------------------------------------------------------------------------------*/
+int CmapSubtable12RangeKey(const void * pCmap310, unsigned int uUnicodeId,
+        unsigned int & uFirst, unsigned int & uLast)
+{
+    const Sfnt::CmapSubTableFormat12 * pTable = reinterpret_cast<const Sfnt::CmapSubTableFormat12 *>(pCmap310);
+
+    uint32 ucGroups = be::swap(pTable->num_groups);
+
+    // Find the first group whose end code is not below the Unicode ID.
+    uint32 iLow = 0, iHigh = ucGroups;
+    while (iLow < iHigh)
+    {
+        const uint32 iMid = (iLow + iHigh) >> 1;
+        if (be::swap(pTable->group[iMid].end_char_code) < uUnicodeId)
+            iLow = iMid + 1;
+        else
+            iHigh = iMid;
+    }
+
+    uFirst = iLow ? be::swap(pTable->group[iLow-1].end_char_code) + 1 : 0;
+    if (iLow == ucGroups)
+    {
+        uLast = ~0u;
+        return -1;
+    }
+    uint32 uStartCode = be::swap(pTable->group[iLow].start_char_code);
+    if (uUnicodeId < uStartCode)
+    {
+        uLast = uStartCode - 1;
+        return -1;
+    }
+    uFirst = uStartCode;
+    uLast = be::swap(pTable->group[iLow].end_char_code);
+    return iLow;
+}
+
 /*----------------------------------------------------------------------------------------------
     Return the offset stored in the loca table for the given Glyph ID.
     (This offset is into the glyf table.)
@@ -45,6 +45,7 @@ namespace
     {
 #ifdef GRAPHITE2_TELEMETRY
         telemetry::category _misc_cat(face.tele.misc);
+        telemetry::phase _misc_phase(face.tele.time.misc);
 #endif
         Face::Table silf(face, Tag::Silf, 0x00050000);
         if (silf)   options &= ~gr_face_dumbRendering;
@@ -56,7 +57,7 @@ namespace
 
         if (silf)
         {
-            if (!face.readFeatures() || !face.readGraphite(silf))
+            if (!face.readFeatures() || !face.readGraphite(silf, options))
             {
 #if !defined GRAPHITE2_NTRACING
                 if (global_log)
@@ -95,7 +96,7 @@ gr_face* gr_make_face_with_ops(const void* appFaceHandle/*non-NULL*/, const gr_f
 
 gr_face* gr_make_face(const void* appFaceHandle/*non-NULL*/, gr_get_table_fn tablefn, unsigned int faceOptions)
 {
-    const gr_face_ops ops = {sizeof(gr_face_ops), tablefn, NULL};
+    const gr_face_ops ops = {sizeof(gr_face_ops), tablefn, NULL, NULL};
     return gr_make_face_with_ops(appFaceHandle, &ops, faceOptions);
 }
 
@@ -116,7 +117,7 @@ gr_face* gr_make_face_with_seg_cache_and_ops(const void* appFaceHandle/*non-NULL
 
 gr_face* gr_make_face_with_seg_cache(const void* appFaceHandle/*non-NULL*/, gr_get_table_fn getTable, unsigned int cacheSize, unsigned int faceOptions)
 {
-    const gr_face_ops ops = {sizeof(gr_face_ops), getTable, NULL};
+    const gr_face_ops ops = {sizeof(gr_face_ops), getTable, NULL, NULL};
     return gr_make_face_with_seg_cache_and_ops(appFaceHandle, &ops, cacheSize, faceOptions);
 }
 #endif
@@ -193,9 +194,16 @@ gr_uint32 gr_face_lang_by_index(const gr_face* pFace, gr_uint16 i)
 }
 
 
+gr_face* gr_make_shared_face(const gr_face *face)
+{
+    if (!face) return NULL;
+    return static_cast<gr_face *>(new Face(face));
+}
+
+
 void gr_face_destroy(gr_face *face)
 {
-    delete face;
+    if (face) face->release();
 }
 
 
@@ -228,11 +236,22 @@ int gr_face_is_char_supported(const gr_face* pFace, gr_uint32 usv, gr_uint32 scr
     if (!gid)
     {
         const Silf * silf = pFace->chooseSilf(script);
-        gid = silf->findPseudo(usv);
+        if (silf) gid = silf->findPseudo(usv);
     }
     return (gid != 0);
 }
 
+int gr_face_memory_usage(const gr_face *pFace, gr_face_memory *usage)
+{
+    if (!pFace || !usage) return 0;
+    gr_face_memory all;
+    memset(&all, 0, sizeof all);
+    pFace->memoryUsage(all);
+    all.size = min(usage->size, sizeof all);
+    memcpy(usage, &all, all.size);
+    return 1;
+}
+
 #ifndef GRAPHITE2_NFILEFACE
 gr_face* gr_make_file_face(const char *filename, unsigned int faceOptions)
 {
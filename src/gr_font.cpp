@@ -55,7 +55,7 @@ gr_font* gr_make_font_with_ops(float ppm/*pixels per em*/, const void* appFontHa
 
 gr_font* gr_make_font_with_advance_fn(float ppm/*pixels per em*/, const void* appFontHandle/*non-NULL*/, gr_advance_fn getAdvance, const gr_face * face/*needed for scaling*/)
 {
-    const gr_font_ops ops = {sizeof(gr_font_ops), getAdvance, NULL};
+    const gr_font_ops ops = {sizeof(gr_font_ops), getAdvance, NULL, NULL};
     return gr_make_font_with_ops(ppm, appFontHandle, &ops, face);
 }
 
@@ -36,6 +36,8 @@ of the License or (at your option) any later version.
 
 #if defined _WIN32
 #include "windows.h"
+#elif defined GRAPHITE2_TELEMETRY
+#include <time.h>
 #endif
 
 using namespace graphite2;
@@ -135,6 +137,22 @@ void graphite_stop_logging()
 
 #ifdef GRAPHITE2_TELEMETRY
 size_t   * graphite2::telemetry::_category = 0UL;
+double   * graphite2::telemetry::_phase = 0;
+double     graphite2::telemetry::_phase_start = 0;
+
+double graphite2::telemetry::now() throw()
+{
+#if defined _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return double(count.QuadPart) / double(freq.QuadPart);
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
 #endif
 
 #if !defined GRAPHITE2_NTRACING
@@ -153,6 +171,16 @@ json & graphite2::operator << (json & j, const telemetry & t) throw()
             << "code"   << t.code
             << "misc"   << t.misc
             << "total"  << (t.silf + t.states + t.starts + t.transitions + t.glyph + t.code + t.misc)
+            << "time"   << json::flat << json::object
+                << "tables"     << t.time.tables
+                << "decompress" << t.time.decompress
+                << "glyphs"     << t.time.glyphs
+                << "cmap"       << t.time.cmap
+                << "features"   << t.time.features
+                << "silf"       << t.time.silf
+                << "passes"     << t.time.passes
+                << "misc"       << t.time.misc
+                << json::close
         << json::close;
     return j;
 }
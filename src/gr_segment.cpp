@@ -33,7 +33,8 @@ using namespace graphite2;
 namespace 
 {
 
-  gr_segment* makeAndInitialize(const Font *font, const Face *face, uint32 script, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void* pStart, size_t nChars, int dir)
+  gr_segment* makeAndInitialize(const Font *font, const Face *face, uint32 script, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void* pStart, size_t nChars, int dir,
+                                const gr_feature_run *runs = 0, size_t nRuns = 0)
   {
       if (script == 0x20202020) script = 0;
       else if ((script & 0x00FFFFFF) == 0x00202020) script = script & 0xFF000000;
@@ -43,7 +44,7 @@ namespace
       Segment* pRes=new Segment(nChars, face, script, dir);
 
       
-      if (!pRes->read_text(face, pFeats, enc, pStart, nChars) || !pRes->runGraphite())
+      if (!pRes->read_text(face, pFeats, enc, pStart, nChars, runs, nRuns) || !pRes->runGraphite())
       {
         delete pRes;
         return NULL;
@@ -99,13 +100,17 @@ size_t gr_count_unicode_characters(gr_encform enc, const void* buffer_begin, con
 
 gr_segment* gr_make_seg(const gr_font *font, const gr_face *face, gr_uint32 script, const gr_feature_val* pFeats, gr_encform enc, const void* pStart, size_t nChars, int dir)
 {
-    const gr_feature_val * tmp_feats = 0;
     if (pFeats == 0)
-        pFeats = tmp_feats = static_cast<const gr_feature_val*>(face->theSill().cloneFeatures(0));
-    gr_segment * seg = makeAndInitialize(font, face, script, pFeats, enc, pStart, nChars, dir);
-    delete tmp_feats;
+        pFeats = static_cast<const gr_feature_val*>(&face->theSill().theFeatureMap().defaultFeatures());
+    return makeAndInitialize(font, face, script, pFeats, enc, pStart, nChars, dir);
+}
+
 
-    return seg;
+gr_segment* gr_make_seg_with_feature_runs(const gr_font *font, const gr_face *face, gr_uint32 script, const gr_feature_val* pFeats, const gr_feature_run* runs, size_t nRuns, gr_encform enc, const void* pStart, size_t nChars, int dir)
+{
+    if (pFeats == 0)
+        pFeats = static_cast<const gr_feature_val*>(&face->theSill().theFeatureMap().defaultFeatures());
+    return makeAndInitialize(font, face, script, pFeats, enc, pStart, nChars, dir, runs, nRuns);
 }
 
 
@@ -167,4 +172,15 @@ float gr_seg_justify(gr_segment* pSeg/*not NULL*/, const gr_slot* pSlot/*not NUL
     return pSeg->justify(const_cast<gr_slot *>(pSlot), pFont, float(width), justFlags(flags), const_cast<gr_slot *>(pFirst), const_cast<gr_slot *>(pLast));
 }
 
+unsigned int gr_seg_break_lines(gr_segment* pSeg/*not NULL*/, const gr_font *pFont, double width, gr_line_width_fn widthFn, void *appData, int maxBreak, int justifyLast, const gr_slot** pLines, unsigned int maxLines)
+{
+    assert(pSeg);
+    Vector<Slot *> lines;
+    if (!pSeg->breakLines(pFont, float(width), widthFn, appData, maxBreak, justifyLast != 0, lines))
+        return 0;
+    for (unsigned int i = 0; i < maxLines && i < lines.size(); ++i)
+        pLines[i] = static_cast<const gr_slot *>(lines[i]);
+    return static_cast<unsigned int>(lines.size());
+}
+
 } // extern "C"
@@ -45,6 +45,7 @@ public:
     bool setupCache(unsigned int cacheSize);
     virtual ~CachedFace();
     virtual bool runGraphite(Segment *seg, const Silf *silf) const;
+    virtual void memoryUsage(gr_face_memory & usage) const;
     SegCacheStore * cacheStore() { return m_cacheStore; }
 private:
     SegCacheStore * m_cacheStore;
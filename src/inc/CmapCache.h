@@ -28,6 +28,7 @@ of the License or (at your option) any later version.
 
 #include "inc/Main.h"
 #include "inc/Face.h"
+#include "inc/List.h"
 
 namespace graphite2 {
 
@@ -41,8 +42,13 @@ public:
 
     virtual uint16 operator [] (const uint32) const throw() { return 0; }
 
+    // Map n code points to glyph ids in one call, avoiding a virtual call per character.
+    virtual void lookup(const uint32 * usv, uint16 * gids, size_t n) const throw();
+
     virtual operator bool () const throw() { return false; }
 
+    virtual size_t memoryUsage() const throw() { return sizeof(Cmap); }
+
     CLASS_NEW_DELETE;
 };
 
@@ -54,15 +60,23 @@ class DirectCmap : public Cmap
 public:
     DirectCmap(const Face &);
     virtual uint16 operator [] (const uint32 usv) const throw();
+    virtual void lookup(const uint32 * usv, uint16 * gids, size_t n) const throw();
     virtual operator bool () const throw();
+    virtual size_t memoryUsage() const throw();
 
     CLASS_NEW_DELETE;
 private:
     const Face::Table   _cmap;
     const void        * _smp,
                       * _bmp;
+    bool                _smpOrdered,
+                        _bmpOrdered;
 };
 
+// Caches glyph ids in 256 code point pages indexed by block. A page is built
+// the first time a character in its block is looked up. Empty blocks share a
+// single zero page, blocks that map to consecutive glyph ids are stored as just
+// their first glyph id, and blocks with identical contents share a page.
 class CachedCmap : public Cmap
 {
     CachedCmap(const CachedCmap &);
@@ -72,11 +86,30 @@ public:
     CachedCmap(const Face &);
     virtual ~CachedCmap() throw();
     virtual uint16 operator [] (const uint32 usv) const throw();
+    virtual void lookup(const uint32 * usv, uint16 * gids, size_t n) const throw();
     virtual operator bool () const throw();
+    virtual size_t memoryUsage() const throw();
     CLASS_NEW_DELETE;
 private:
-    bool m_isBmpOnly;
-    uint16 ** m_blocks;
+    struct Page
+    {
+        uint32   hash;
+        uint16 * glyphs;
+    };
+
+    inline uint16 glyph(const uint32 usv) const throw();
+    uintptr buildBlock(const uint32 block) const throw();
+    uintptr internPage(const uint16 * glyphs) const throw();
+
+    const Face::Table       m_cmap;
+    const void            * m_smp,
+                          * m_bmp;
+    bool                    m_smpOrdered,
+                            m_bmpOrdered;
+    uint32                  m_numBlocks;
+    uintptr               * m_blocks;
+    mutable Vector<Page>    m_pages;
+    mutable volatile long   m_lock;
 };
 
 } // namespace graphite2
@@ -101,6 +101,7 @@ public:
     bool          constraint() const throw()        { return _constraint; }
     size_t        dataSize() const throw()          { return _data_size; }
     size_t        instructionCount() const throw()  { return _instr_count; }
+    size_t        memoryUsage() const throw();
     bool          immutable() const throw()         { return !(_delete || _modify); }
     bool          deletes() const throw()           { return _delete; }
     size_t        maxRef() const throw()            { return _max_ref; }
@@ -51,6 +51,32 @@ namespace lz4
 //      size        -  Actual number of bytes decompressed.
 int decompress(void const *in, size_t in_size, void *out, size_t out_size);
 
+// decompress part of an LZ4 block, carrying on from where an earlier call
+//  stopped.
+// Parameters:
+//      @in_pos     -   Offset into @in to carry on decoding from, 0 to start.
+//                      Updated to where this call stopped.
+//      @out_pos    -   Number of bytes already decompressed into @out, 0 to
+//                      start. Updated to the number now available.
+//      @limit      -   Stop once at least this many bytes are available.
+//                      Bytes just past @out_pos may have been overwritten.
+//      Other parameters and invariants are as above, and @in and @out must
+//      be the same buffers every call.
+// Return:
+//      -1          -  Decompression failed.
+//      size        -  Number of bytes decompressed so far, the same as
+//                     @out_pos. This is the full size once the block ends.
+int decompress(void const *in, size_t in_size, void *out, size_t out_size,
+               size_t & in_pos, size_t & out_pos, size_t limit);
+
+// check an LZ4 block decompresses without error, by walking its sequences
+//  without writing any output.
+// Parameters and invariants are as for decompress.
+// Return:
+//      -1          -  Decompression would fail.
+//      size        -  Number of bytes decompression would produce.
+int check(void const *in, size_t in_size, size_t out_size);
+
 } // end of namespace shrinker
 
 
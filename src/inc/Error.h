@@ -34,14 +34,17 @@ namespace graphite2
 class Error
 {
 public:
-    Error() : _e(0) {};
+    Error() : _e(0), _c(0) {};
     operator bool() { return (_e != 0); }
     int error() { return _e; }
     void error(int e) { _e = e; }
     bool test(bool pr, int err) { return (_e = int(pr) * err); }
+    unsigned int context() const { return _c; }
+    void context(unsigned int c) { _c = c; }
 
 private:
     int _e;
+    unsigned int _c;    // an errcontext plus the numbers it refers to
 };
 
 enum errcontext {
@@ -58,16 +58,19 @@ class Face
 
 public:
     class Table;
-    static float default_glyph_advance(const void* face_ptr, gr_uint16 glyphid);
 
     Face(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops);
+    explicit Face(const Face * base/*non-NULL*/);
     virtual ~Face();
 
+    void                release() const;
+
     virtual bool        runGraphite(Segment *seg, const Silf *silf) const;
+    virtual void        memoryUsage(gr_face_memory & usage) const;
 
 public:
     bool                readGlyphs(uint32 faceOptions);
-    bool                readGraphite(const Table & silf);
+    bool                readGraphite(const Table & silf, uint32 faceOptions);
     bool                readFeatures();
     void                takeFileFace(FileFace* pFileFace/*takes ownership*/);
 
@@ -90,14 +93,24 @@ public:
     int32  getGlyphMetric(uint16 gid, uint8 metric) const;
     uint16 findPseudo(uint32 uid) const;
 
+    // Advances scaled by a font's scale, shared by every font at that scale
+    const float       * acquireAdvances(float scale) const;
+    void                releaseAdvances(const float * advances) const;
+
+    // Task execution
+    bool                canRunTasks() const { return m_ops.run_tasks != 0; }
+    void                runTasks(gr_task_fn task, void * data, size_t n) const;
+
     // Errors
     unsigned int        error() const { return m_error; }
     bool                error(Error e) { m_error = e.error(); return false; }
-    unsigned int        error_context() const { return m_error; }
+    unsigned int        error_context() const { return m_errcntxt; }
     void                error_context(unsigned int errcntxt) { m_errcntxt = errcntxt; }
 
     CLASS_NEW_DELETE;
 private:
+    struct Advances;
+
     SillMap                 m_Sill;
     gr_face_ops             m_ops;
     const void            * m_appFaceHandle;    // non-NULL
@@ -106,6 +119,11 @@ private:
     mutable Cmap          * m_cmap;             // cmap cache if available
     mutable NameTable     * m_pNames;
     mutable json          * m_logger;
+    Table                 * m_silfTable;        // kept for passes that decode their rules lazily
+    const Face            * m_base;             // face whose loaded data we share, if any
+    mutable volatile long   m_refs;             // this face and the faces sharing its data
+    mutable Advances      * m_advances;         // scaled advance tables, most recent first
+    mutable volatile long   m_advancesLock;
     unsigned int            m_error;
     unsigned int            m_errcntxt;
 protected:
@@ -125,25 +143,25 @@ public:
 inline
 const SillMap & Face::theSill() const
 {
-    return m_Sill;
+    return m_base ? m_base->m_Sill : m_Sill;
 }
 
 inline
 uint16 Face::numFeatures() const
 {
-    return m_Sill.theFeatureMap().numFeats();
+    return theSill().theFeatureMap().numFeats();
 }
 
 inline
 const FeatureRef * Face::featureById(uint32 id) const
 {
-    return m_Sill.theFeatureMap().findFeatureRef(id);
+    return theSill().theFeatureMap().findFeatureRef(id);
 }
 
 inline
 const FeatureRef *Face::feature(uint16 index) const
 {
-    return m_Sill.theFeatureMap().feature(index);
+    return theSill().theFeatureMap().feature(index);
 }
 
 inline
@@ -172,14 +190,20 @@ class Face::Table
     mutable const byte *    _p;
     uint32                  _sz;
     bool                    _compressed;
+    mutable const byte *    _src;       // compressed table, while still being decompressed
+    uint32                  _src_sz;
+    mutable size_t          _src_pos,
+                            _decoded;   // bytes of _p available so far
 
-    Error decompress();
+    Error decompress(bool lazy);
+    bool  decompressTo(size_t end) const throw();
 
     void releaseBuffers();
+    void releaseSource() const;
 
 public:
     Table() throw();
-    Table(const Face & face, const Tag n, uint32 version=0xffffffff) throw();
+    Table(const Face & face, const Tag n, uint32 version=0xffffffff, bool lazy=false) throw();
     Table(const Table & rhs) throw();
     ~Table() throw();
 
@@ -187,19 +211,25 @@ public:
 
     Table & operator = (const Table & rhs) throw();
     size_t  size() const throw();
+    bool    available(size_t end) const throw();
+    size_t  memoryUsage() const throw();
+
+    CLASS_NEW_DELETE;
 };
 
 inline
 Face::Table::Table() throw()
-: _f(0), _p(0), _sz(0), _compressed(false)
+: _f(0), _p(0), _sz(0), _compressed(false), _src(0), _src_sz(0), _src_pos(0), _decoded(0)
 {
 }
 
 inline
 Face::Table::Table(const Table & rhs) throw()
-: _f(rhs._f), _p(rhs._p), _sz(rhs._sz), _compressed(rhs._compressed)
+: _f(rhs._f), _p(rhs._p), _sz(rhs._sz), _compressed(rhs._compressed),
+  _src(rhs._src), _src_sz(rhs._src_sz), _src_pos(rhs._src_pos), _decoded(rhs._decoded)
 {
     rhs._p = 0;
+    rhs._src = 0;
 }
 
 inline
@@ -220,6 +250,21 @@ size_t  Face::Table::size() const throw()
     return _sz;
 }
 
+// The bytes of table data this holds that are not the client's.
+inline
+size_t Face::Table::memoryUsage() const throw()
+{
+    return _compressed ? _sz : 0;
+}
+
+// A table decompressed lazily only has its first bytes ready to start with,
+// call this before reading any further into it.
+inline
+bool Face::Table::available(size_t end) const throw()
+{
+    return end <= _decoded || (_src && decompressTo(end));
+}
+
 } // namespace graphite2
 
 struct gr_face : public graphite2::Face {};
@@ -65,7 +65,7 @@ public:
     bool applyValToFeature(uint32 val, Features& pDest) const; //defined in GrFaceImp.h
     void maskFeature(Features & pDest) const {
     if (m_index < pDest.size())                 //defensive
-        pDest[m_index] |= m_mask; 
+        pDest.set(m_index, pDest[m_index] | m_mask);
     }
 
     uint32 getFeatureVal(const Features& feats) const; //defined in GrFaceImp.h
@@ -136,6 +136,7 @@ public:
     //GrFeatureRef *featureRef(byte index) { return index < m_numFeats ? m_feats + index : NULL; }
     const FeatureRef *featureRef(byte index) const { return index < m_numFeats ? m_feats + index : NULL; }
     FeatureVal* cloneFeatures(uint32 langname/*0 means default*/) const;      //call destroy_Features when done.
+    const Features & defaultFeatures() const { return m_defaultFeatures; }
     uint16 numFeats() const { return m_numFeats; };
     CLASS_NEW_DELETE
 private:
@@ -168,9 +169,17 @@ private:
         Features* m_pFeatures;      //owns
         CLASS_NEW_DELETE
     };
+
+    // The languages sorted by tag, for finding one by binary search.
+    struct LangIndex
+    {
+        uint32 lang;
+        uint16 index;
+    };
+    static int cmpLangIndex(const void *ap, const void *bp);
 public:
-    SillMap() : m_langFeats(NULL), m_numLanguages(0) {}
-    ~SillMap() { delete[] m_langFeats; }
+    SillMap() : m_langFeats(NULL), m_langIndex(NULL), m_numLanguages(0) {}
+    ~SillMap() { delete[] m_langFeats; free(m_langIndex); }
     bool readFace(const Face & face);
     bool readSill(const Face & face);
     FeatureVal* cloneFeatures(uint32 langname/*0 means default*/) const;      //call destroy_Features when done.
@@ -181,6 +190,7 @@ public:
 private:
     FeatureMap m_FeatureMap;        //of face
     LangFeaturePair * m_langFeats;
+    LangIndex * m_langIndex;
     uint16 m_numLanguages;
 
 private:        //defensive on m_langFeats
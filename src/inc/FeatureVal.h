@@ -28,38 +28,113 @@ of the License or (at your option) any later version.
 #include <cstring>
 #include <cassert>
 #include "inc/Main.h"
-#include "inc/List.h"
 
 namespace graphite2 {
 
 class FeatureRef;
 class FeatureMap;
 
-class FeatureVal : public Vector<uint32>
+class FeatureVal
 {
+    // Most fonts' feature values fit in this many words, which are then held
+    // in the FeatureVal itself, so copying one does not allocate.
+    static const size_t NUM_INLINE = 6;
+
 public:
-    FeatureVal() : m_pMap(0) { }
-    FeatureVal(int num, const FeatureMap & pMap) : Vector<uint32>(num), m_pMap(&pMap) {}
-    FeatureVal(const FeatureVal & rhs) : Vector<uint32>(rhs), m_pMap(rhs.m_pMap) {}
+    typedef const uint32 *  const_iterator;
+
+    FeatureVal() : m_heap(0), m_size(0), m_hash(0), m_pMap(0) { }
+    FeatureVal(int num, const FeatureMap & pMap) : m_heap(0), m_size(0), m_hash(0), m_pMap(&pMap) { resize(num); }
+    FeatureVal(const FeatureVal & rhs) : m_heap(0), m_size(0), m_hash(0), m_pMap(0) { *this = rhs; }
+    ~FeatureVal() { free(m_heap); }
+
+    FeatureVal & operator = (const FeatureVal & rhs);
 
-    FeatureVal & operator = (const FeatureVal & rhs) { Vector<uint32>::operator = (rhs); m_pMap = rhs.m_pMap; return *this; }
+    size_t          size() const    { return m_size; }
+    const_iterator  begin() const   { return m_heap ? m_heap : m_inline; }
+    const_iterator  end() const     { return begin() + m_size; }
+    uint32          operator [] (size_t n) const { assert(n < m_size); return begin()[n]; }
+
+    // A hash of the values, kept up to date as they change.
+    uint32          hash() const    { return m_hash; }
 
     bool operator ==(const FeatureVal & b) const
     {
-        size_t n = size();
-        if (n != b.size())      return false;
-        
-        for(const_iterator l = begin(), r = b.begin(); n && *l == *r; --n, ++l, ++r);
-        
-        return n == 0;
+        return m_hash == b.m_hash && m_size == b.m_size
+            && !memcmp(begin(), b.begin(), m_size * sizeof(uint32));
     }
 
     CLASS_NEW_DELETE
 private:
-    friend class FeatureRef;        //so that FeatureRefs can manipulate m_vec directly
-    const FeatureMap* m_pMap;
+    friend class FeatureRef;        //so that FeatureRefs can manipulate the values directly
+
+    uint32 * data() { return m_heap ? m_heap : m_inline; }
+    bool resize(size_t n);
+    void set(size_t n, uint32 val)
+    {
+        uint32 & v = data()[n];
+        m_hash ^= mix(v, n) ^ mix(val, n);
+        v = val;
+    }
+    // Zero words contribute nothing, so extending the values leaves the hash alone.
+    static uint32 mix(uint32 v, size_t n)
+    {
+        const uint32 h = v * 0x9E3779B1u;
+        const unsigned int r = (n * 7) & 31;
+        return r ? (h << r) | (h >> (32 - r)) : h;
+    }
+
+    uint32              m_inline[NUM_INLINE];
+    uint32            * m_heap;
+    uint32              m_size,
+                        m_hash;
+    const FeatureMap  * m_pMap;
 };
 
+inline
+FeatureVal & FeatureVal::operator = (const FeatureVal & rhs)
+{
+    if (this == &rhs)   return *this;
+
+    m_size = 0;
+    m_hash = 0;
+    m_pMap = rhs.m_pMap;
+    if (rhs.m_size > NUM_INLINE)
+    {
+        uint32 * const p = static_cast<uint32 *>(realloc(m_heap, rhs.m_size * sizeof(uint32)));
+        if (!p) return *this;
+        m_heap = p;
+    }
+    else
+    {
+        free(m_heap);
+        m_heap = 0;
+    }
+    memcpy(data(), rhs.begin(), rhs.m_size * sizeof(uint32));
+    m_size = rhs.m_size;
+    m_hash = rhs.m_hash;
+    return *this;
+}
+
+inline
+bool FeatureVal::resize(size_t n)
+{
+    if (n > NUM_INLINE && n > m_size)
+    {
+        uint32 * const p = static_cast<uint32 *>(realloc(m_heap, n * sizeof(uint32)));
+        if (!p) return false;
+        if (!m_heap)    memcpy(p, m_inline, m_size * sizeof(uint32));
+        m_heap = p;
+    }
+    uint32 * const d = data();
+    for (size_t i = n; i < m_size; ++i)
+        m_hash ^= mix(d[i], i);
+    if (n > m_size)
+        memset(d + m_size, 0, (n - m_size) * sizeof(uint32));
+    m_size = uint32(n);
+    return true;
+}
+
 typedef FeatureVal Features;
 
 } // namespace graphite2
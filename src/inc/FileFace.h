@@ -59,8 +59,12 @@ public:
     CLASS_NEW_DELETE;
 
 private:        //defensive
+    bool map_file();
+    void unmap_file();
+
     FILE          * _file;
     size_t          _file_len;
+    const byte    * _map;       // read-only mapping of the whole file, if we could make one
 
     TtfUtil::Sfnt::OffsetSubTable         * _header_tbl;
     TtfUtil::Sfnt::OffsetSubTable::Entry  * _table_dir;
@@ -72,7 +76,7 @@ private:        //defensive
 inline
 FileFace::operator bool() const throw()
 {
-    return _file && _header_tbl && _table_dir;
+    return (_file || _map) && _header_tbl && _table_dir;
 }
 
 } // namespace graphite2
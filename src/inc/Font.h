@@ -41,15 +41,18 @@ public:
     virtual ~Font();
 
     float advance(unsigned short glyphid) const;
+    void fetchAdvances(const uint16 * glyphids, size_t n) const;
     float scale() const;
     bool isHinted() const;
+    bool fetchesAdvances() const;
     const Face & face() const;
 
     CLASS_NEW_DELETE;
 private:
     gr_font_ops         m_ops;
     const void  * const m_appFontHandle;
-    float             * m_advances;  // One advance per glyph in pixels. Nan if not defined
+    const float       * m_advances;  // One advance per glyph in pixels, shared with the face unless hinted
+    float             * m_hintedAdvances; // m_advances when hinted, INVALID_ADVANCE until asked for
     const Face        & m_face;
     float               m_scale;      // scales from design units to ppm
     bool                m_hinted;
@@ -61,8 +64,13 @@ private:
 inline
 float Font::advance(unsigned short glyphid) const
 {
-    if (m_advances[glyphid] == INVALID_ADVANCE)
-        m_advances[glyphid] = (*m_ops.glyph_advance_x)(m_appFontHandle, glyphid);
+    if (m_hintedAdvances && m_hintedAdvances[glyphid] == INVALID_ADVANCE)
+    {
+        if (m_ops.glyph_advance_x)
+            m_hintedAdvances[glyphid] = (*m_ops.glyph_advance_x)(m_appFontHandle, glyphid);
+        else
+            fetchAdvances(&glyphid, 1);
+    }
     return m_advances[glyphid];
 }
 
@@ -78,6 +86,12 @@ bool Font::isHinted() const
     return m_hinted;
 }
 
+inline
+bool Font::fetchesAdvances() const
+{
+    return m_hintedAdvances && m_ops.glyph_advances_x;
+}
+
 inline
 const Face & Font::face() const
 {
@@ -89,6 +89,7 @@ private:
 class GlyphCache
 {
     class Loader;
+    struct Preload;
 
     GlyphCache(const GlyphCache&);
     GlyphCache& operator=(const GlyphCache&);
@@ -103,6 +104,10 @@ public:
 
     const GlyphFace *glyph(unsigned short glyphid) const;      //result may be changed by subsequent call with a different glyphid
     const GlyphFace *glyphSafe(unsigned short glyphid) const;
+    int16            glyphAttr(unsigned short glyphid, unsigned short gattr) const;
+    void             advances(float scale, float * advances) const;
+    bool             cacheAttrs(const Vector<uint16> & attrs);
+    void             memoryUsage(gr_face_memory & usage) const;
     float            getBoundingMetric(unsigned short glyphid, uint8 metric) const;
     uint8            numSubBounds(unsigned short glyphid) const;
     float            getSubBoundingMetric(unsigned short glyphid, uint8 subindex, uint8 metric) const;
@@ -117,13 +122,23 @@ public:
     CLASS_NEW_DELETE;
     
 private:
+    bool        preload(const Face & face);
+    static void preloadTask(void * data, size_t index);
+    const GlyphFace * loadGlyph(unsigned short glyphid) const;
+    void        stripAttrs(size_t num_cold);
+
     const Rect            _empty_slant_box;
     const Loader        * _glyph_loader;
     const GlyphFace *   * _glyphs;
     GlyphBox        *   * _boxes;
+    sparse::mapped_type * _attr_store;     // attributes of preloaded glyphs
+    sparse::mapped_type * _hot_attrs;      // _num_hot attributes per glyph
+    uint8               * _hot_column;     // attribute id to column + 1, or 0
+    mutable volatile long _lock;           // held while a glyph is loaded lazily
     unsigned short        _num_glyphs,
                           _num_attrs,
                           _upem;
+    uint8                 _num_hot;
 };
 
 inline
@@ -156,6 +171,17 @@ const GlyphFace *GlyphCache::glyphSafe(unsigned short glyphid) const
     return glyphid < _num_glyphs ? glyph(glyphid) : NULL;
 }
 
+inline
+int16 GlyphCache::glyphAttr(unsigned short glyphid, unsigned short gattr) const
+{
+    if (glyphid >= _num_glyphs) return 0;
+    const uint8 col = gattr < _num_attrs && _hot_column ? _hot_column[gattr] : 0;
+    if (col)
+        return _hot_attrs[glyphid * _num_hot + col - 1];
+    const GlyphFace * p = glyph(glyphid);
+    return p ? p->attrs()[gattr] : 0;
+}
+
 inline
 float GlyphCache::getBoundingMetric(unsigned short glyphid, uint8 metric) const
 {
@@ -47,6 +47,8 @@ public:
     GlyphFace();
     template<typename I>
     GlyphFace(const Rect & bbox, const Position & adv, I first, const I last);
+    template<typename I>
+    GlyphFace(const Rect & bbox, const Position & adv, I first, const I last, sparse::mapped_type * & store);
 
     const Position    & theAdvance() const;
     const Rect        & theBBox() const { return m_bbox; }
@@ -75,6 +77,14 @@ GlyphFace::GlyphFace(const Rect & bbox, const Position & adv, I first, const I l
 {
 }
 
+template<typename I>
+GlyphFace::GlyphFace(const Rect & bbox, const Position & adv, I first, const I last, sparse::mapped_type * & store)
+: m_bbox(bbox),
+  m_advance(adv),
+  m_attrs(first, last, store)
+{
+}
+
 inline
 const Position & GlyphFace::theAdvance() const {
     return m_advance;
@@ -29,6 +29,10 @@ of the License or (at your option) any later version.
 #include <cstdlib>
 #include "graphite2/Types.h"
 
+#if defined _MSC_VER
+#include <intrin.h>
+#endif
+
 #ifdef GRAPHITE2_CUSTOM_HEADER
 #include GRAPHITE2_CUSTOM_HEADER
 #endif
@@ -48,12 +52,23 @@ typedef size_t          uintptr;
 struct telemetry
 {
     class category;
+    class phase;
 
     static size_t   * _category;
     static void set_category(size_t & t) throw()    { _category = &t; }
     static void stop() throw()                      { _category = 0; }
     static void count_bytes(size_t n) throw()       { if (_category) *_category += n; }
 
+    static double   * _phase;
+    static double     _phase_start;
+    static double now() throw();                    // seconds from a monotonic clock
+    static void set_phase(double * t) throw()
+    {
+        const double n = now();
+        if (_phase) *_phase += n - _phase_start;
+        _phase = t; _phase_start = n;
+    }
+
     size_t  misc,
             silf,
             glyph,
@@ -62,7 +77,24 @@ struct telemetry
             starts,
             transitions;
 
-    telemetry() : misc(0), silf(0), glyph(0), code(0), states(0), starts(0), transitions(0) {}
+    // Seconds spent loading the face, excluding any phase nested in another.
+    struct
+    {
+        double  misc,
+                tables,
+                decompress,
+                glyphs,
+                cmap,
+                features,
+                silf,
+                passes;
+    } time;
+
+    telemetry() : misc(0), silf(0), glyph(0), code(0), states(0), starts(0), transitions(0)
+    {
+        time.misc = time.tables = time.decompress = time.glyphs = time.cmap
+                  = time.features = time.silf = time.passes = 0;
+    }
 };
 
 class telemetry::category
@@ -73,6 +105,14 @@ public:
     ~category() { _category = _prev; }
 };
 
+class telemetry::phase
+{
+    double * _prev;
+public:
+    phase(double & t) : _prev(_phase) { set_phase(&t); }
+    ~phase() { set_phase(_prev); }
+};
+
 #else
 struct telemetry  {};
 #endif
@@ -108,6 +148,53 @@ inline T max(const T a, const T b)
     return a > b ? a : b;
 }
 
+// Returns the previous value, setting it to val if it was old.
+inline long compare_and_swap(volatile long * p, long old, long val)
+{
+#if defined _MSC_VER
+    return _InterlockedCompareExchange(p, val, old);
+#else
+    return __sync_val_compare_and_swap(p, old, val);
+#endif
+}
+
+// Adds delta to *p as one atomic step, returning the new value.
+inline long atomic_add(volatile long * p, long delta)
+{
+#if defined _MSC_VER
+    return _InterlockedExchangeAdd(p, delta) + delta;
+#else
+    return __sync_add_and_fetch(p, delta);
+#endif
+}
+
+// Lets other threads run while this one waits on them.
+void yield_thread();
+
+// Reads *p such that whatever was written before the value was stored with
+// compare_and_swap can be read after.
+template<typename T>
+inline T load_acquire(T const volatile * p)
+{
+#if defined _MSC_VER
+    return *p;      // volatile reads have acquire semantics
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Stores val in *p such that whatever was written before can be read by a
+// thread that reads the value with load_acquire.
+template<typename T>
+inline void store_release(T volatile * p, T val)
+{
+#if defined _MSC_VER
+    *p = val;       // volatile writes have release semantics
+#else
+    __atomic_store_n(p, val, __ATOMIC_RELEASE);
+#endif
+}
+
 } // namespace graphite2
 
 #define CLASS_NEW_DELETE \
@@ -42,6 +42,8 @@ class Error;
 class ShiftCollider;
 class KernCollider;
 class json;
+struct CollisionRange;
+template <typename T> class Vector;
 
 enum passtype;
 
@@ -52,23 +54,27 @@ public:
     ~Pass();
     
     bool readPass(const byte * pPass, size_t pass_length, size_t subtable_base, Face & face,
-        enum passtype pt, uint32 version, Error &e);
+        enum passtype pt, uint32 version, bool lazyRules, Error &e);
     bool runGraphite(vm::Machine & m, FiniteStateMachine & fsm, bool reverse) const;
     void init(Silf *silf) { m_silf = silf; }
     byte collisionLoops() const { return m_numCollRuns; }
+    size_t memoryUsage() const;
     bool reverseDir() const { return m_isReverseDir; }
 
     CLASS_NEW_DELETE
 private:
     void    findNDoRule(Slot* & iSlot, vm::Machine &, FiniteStateMachine& fsm) const;
     int     doAction(const vm::Machine::Code* codeptr, Slot * & slot_out, vm::Machine &) const;
-    bool    testPassConstraint(vm::Machine & m) const;
+    bool    testPassConstraint(vm::Machine & m, Slot * s) const;
+    bool    testPassConstraints(vm::Machine & m, bool * passes, bool & mixed) const;
     bool    testConstraint(const Rule & r, vm::Machine &) const;
     bool    readRules(const byte * rule_map, const size_t num_entries,
                      const byte *precontext, const uint16 * sort_key,
                      const uint16 * o_constraint, const byte *constraint_data, 
                      const uint16 * o_action, const byte * action_data,
-                     Face &, enum passtype pt, Error &e);
+                     Face &, enum passtype pt, bool lazy, Error &e);
+    bool    decodeRules(const Face & face, Error &e);
+    bool    rulesDecoded(const Face & face) const;
     bool    readStates(const byte * starts, const byte * states, const byte * o_rule_map, Face &, Error &e);
     bool    readRanges(const byte * ranges, size_t num_ranges, Error &e);
     uint16  glyphToCol(const uint16 gid) const;
@@ -77,6 +83,13 @@ private:
     void    dumpRuleEventOutput(const FiniteStateMachine & fsm, const Rule & r, Slot * os) const;
     void    adjustSlot(int delta, Slot * & slot_out, SlotMap &) const;
     bool    collisionShift(Segment *seg, int dir, json * const dbgout) const;
+    bool    collisionShiftRange(Segment *seg, Slot *start, Slot * &end, ShiftCollider &coll,
+                     int dir, bool &moved, bool &hasCol, json * const dbgout) const;
+    bool    collisionShiftLoops(Segment *seg, Slot *start, Slot *end, ShiftCollider &coll,
+                     int dir, bool &moved, bool &hasCol, json * const dbgout) const;
+    bool    findIndependentRanges(Segment *seg, Vector<CollisionRange> &ranges) const;
+    bool    collisionShiftConcurrent(Segment *seg, int dir, Vector<CollisionRange> &ranges) const;
+    static void collisionShiftTask(void *data, size_t index);
     bool    collisionKern(Segment *seg, int dir, json * const dbgout) const;
     bool    collisionFinish(Segment *seg, GR_MAYBE_UNUSED json * const dbgout) const;
     bool    resolveCollisions(Segment *seg, Slot *slot, Slot *start, ShiftCollider &coll, bool isRev,
@@ -93,6 +106,12 @@ private:
     State             * m_states;
     vm::Machine::Code * m_codes;
     byte              * m_progs;
+    // Where the rule code lies in the Silf table, for decodeRules
+    const uint16      * m_oConstraint,
+                      * m_oAction;
+    const byte        * m_rcData,
+                      * m_acData;
+    mutable volatile long m_rulesState;
 
     byte   m_numCollRuns;
     byte   m_kernColls;
@@ -108,6 +127,7 @@ private:
     byte m_maxPreCtxt;
     byte m_colThreshold;
     bool m_isReverseDir;
+    byte m_passType;
     vm::Machine::Code m_cPConstraint;
     
 private:        //defensive
@@ -140,6 +140,7 @@ public:
     }
     uint32 purge(unsigned long long minAccessCount, unsigned long long oldAccessTime,
         unsigned long long currentTime);
+    size_t memoryUsage(const Silf & silf) const;
     CLASS_NEW_DELETE
 private:
     uint16 findPosition(const uint16 * cmapGlyphs, uint16 length, SegCacheEntry ** entry) const
@@ -255,10 +256,13 @@ public:
     size_t segmentCount() const { return m_segmentCount; }
     const Features & features() const { return m_features; }
     void clear(SegCacheStore * store);
+    size_t memoryUsage(const SegCacheStore * store, const Silf & silf) const;
 
     CLASS_NEW_DELETE
 private:
     void freeLevel(SegCacheStore * store, SegCachePrefixArray prefixes, size_t level);
+    size_t levelMemoryUsage(const SegCacheStore * store, const Silf & silf,
+                            SegCachePrefixArray prefixes, size_t level) const;
     void purgeLevel(SegCacheStore * store, SegCachePrefixArray prefixes, size_t level,
                     unsigned long long minAccessCount, unsigned long long oldAccessTime);
 
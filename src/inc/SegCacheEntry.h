@@ -34,6 +34,7 @@ of the License or (at your option) any later version.
 namespace graphite2 {
 
 class Segment;
+class Silf;
 class Slot;
 class SegCacheEntry;
 class SegCachePrefixEntry;
@@ -100,6 +101,7 @@ public:
         return 0;
     }
     unsigned long long lastAccess() const { return m_lastAccess; };
+    size_t memoryUsage(size_t length, const Silf & silf) const;
 
     CLASS_NEW_DELETE;
 private:
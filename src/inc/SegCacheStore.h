@@ -61,7 +61,19 @@ public:
     }
     SegCache * getOrCreate(SegCacheStore * cacheStore, const Features & features)
     {
-        for (size_t i = 0; i < m_cacheCount; i++)
+        // The caches are kept in order of their features' hash, so the ones
+        //  that may match are found by binary search.
+        const uint32 hash = features.hash();
+        size_t lo = 0, hi = m_cacheCount;
+        while (lo < hi)
+        {
+            const size_t mid = (lo + hi) >> 1;
+            if (m_caches[mid]->features().hash() < hash)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (size_t i = lo; i < m_cacheCount && m_caches[i]->features().hash() == hash; i++)
         {
             if (m_caches[i]->features() == features)
                 return m_caches[i];
@@ -71,16 +83,18 @@ public:
         {
             if (m_cacheCount > 0)
             {
-                memcpy(newData, m_caches, sizeof(SegCache*) * m_cacheCount);
+                memcpy(newData, m_caches, sizeof(SegCache*) * lo);
+                memcpy(newData + lo + 1, m_caches + lo, sizeof(SegCache*) * (m_cacheCount - lo));
                 free(m_caches);
             }
             m_caches = newData;
-            m_caches[m_cacheCount] = new SegCache(cacheStore, features);
+            m_caches[lo] = new SegCache(cacheStore, features);
             m_cacheCount++;
-            return m_caches[m_cacheCount - 1];
+            return m_caches[lo];
         }
         return NULL;
     }
+    size_t memoryUsage(const SegCacheStore * cacheStore, const Silf & silf) const;
     CLASS_NEW_DELETE
 private:
     SegCache ** m_caches;
@@ -110,6 +124,7 @@ public:
     bool isSpaceGlyph(uint16 gid) const { return (gid == m_spaceGid) || (gid == m_zwspGid); }
     uint16 maxCmapGid() const { return m_maxCmapGid; }
     uint32 maxSegmentCount() const { return m_maxSegments; };
+    size_t memoryUsage(const Silf * silfs) const;
 
     CLASS_NEW_DELETE
 private:
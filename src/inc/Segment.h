@@ -88,7 +88,11 @@ public:
 
     enum {
         SEG_INITCOLLISIONS = 1,
-        SEG_HASCOLLISIONS = 2
+        SEG_HASCOLLISIONS = 2,
+        SEG_POSITIONED = 4,         // slot positions and cluster ends are valid for ...
+        SEG_POSRTL = 8,             // ... this direction,
+        SEG_POSFINAL = 16,          // ... with collision offsets applied,
+        SEG_POSCURRDIR = 32         // ... with the slots in this order
     };
 
     unsigned int slotCount() const { return m_numGlyphs; }      //one slot per glyph
@@ -128,6 +132,8 @@ public:
     uint16 getClassGlyph(uint16 cid, uint16 offset) const { return m_silf->getClassGlyph(cid, offset); }
     uint16 findClassIndex(uint16 cid, uint16 gid) const { return m_silf->findClassIndex(cid, gid); }
     int addFeatures(const Features& feats) { m_feats.push_back(feats); return m_feats.size() - 1; }
+    int findOrAddFeatures(const Features& feats);
+    size_t numFeatures() const { return m_feats.size(); }
     uint32 getFeature(int index, uint8 findex) const { const FeatureRef* pFR=m_face->theSill().theFeatureMap().featureRef(findex); if (!pFR) return 0; else return pFR->getFeatureVal(m_feats[index]); }
     void setFeature(int index, uint8 findex, uint32 val) {
         const FeatureRef* pFR=m_face->theSill().theFeatureMap().featureRef(findex); 
@@ -141,7 +147,7 @@ public:
     bool currdir() const { return ((m_dir >> 6) ^ m_dir) & 1; }
     unsigned int passBits() const { return m_passBits; }
     void mergePassBits(const unsigned int val) { m_passBits &= val; }
-    int16 glyphAttr(uint16 gid, uint16 gattr) const { const GlyphFace * p = m_face->glyphs().glyphSafe(gid); return p ? p->attrs()[gattr] : 0; }
+    int16 glyphAttr(uint16 gid, uint16 gattr) const { return m_face->glyphs().glyphAttr(gid, gattr); }
     int32 getGlyphMetric(Slot *iSlot, uint8 metric, uint8 attrLevel, bool rtl) const;
     float glyphAdvance(uint16 gid) const { return m_face->glyphs().glyph(gid)->theAdvance().x; }
     const Rect &theGlyphBBoxTemporary(uint16 gid) const { return m_face->glyphs().glyph(gid)->theBBox(); }   //warning value may become invalid when another glyph is accessed
@@ -149,24 +155,31 @@ public:
     int numAttrs() const { return m_silf->numUser(); }
     int defaultOriginal() const { return m_defaultOriginal; }
     const Face * getFace() const { return m_face; }
-    const Features & getFeatures(unsigned int /*charIndex*/) { assert(m_feats.size() == 1); return m_feats[0]; }
+    const Features & getFeatures(unsigned int charIndex) { assert(charIndex < m_numCharinfo); return m_feats[m_charinfo[charIndex].fid()]; }
     void bidiPass(int paradir, uint8 aMirror);
     int8 getSlotBidiClass(Slot *s) const;
     void doMirror(uint16 aMirror);
     Slot *addLineEnd(Slot *nSlot);
     void delLineEnd(Slot *s);
+    bool justifyWhitespace(Slot *pSlot, Slot *pFirst, Slot *end, float width, float base, float scale);
+    int breakWeightBefore(const Slot *s) const;
     bool hasJustification() const { return m_justifies.size() != 0; }
     void reverseSlots();
 
     bool isWhitespace(const int cid) const;
+    void invalidatePositions() { m_flags &= ~SEG_POSITIONED; }
+    void markDirty(Slot *s) const { findRoot(s)->markDirty(true); }
     bool hasCollisionInfo() const { return (m_flags & SEG_HASCOLLISIONS) && m_collisions; }
     SlotCollision *collisionInfo(const Slot *s) const { return m_collisions ? m_collisions + s->index() : 0; }
     CLASS_NEW_DELETE
 
 public:       //only used by: GrSegment* makeAndInitialize(const GrFont *font, const GrFace *face, uint32 script, const FeaturesHandle& pFeats/*must not be IsNull*/, encform enc, const void* pStart, size_t nChars, int dir);
-    bool read_text(const Face *face, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void*pStart, size_t nChars);
+    bool read_text(const Face *face, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void*pStart, size_t nChars,
+                   const gr_feature_run *runs = 0, size_t nRuns = 0);
     void finalise(const Font *font, bool reverse=false);
+    void fetchAdvances(const Font *font) const;
     float justify(Slot *pSlot, const Font *font, float width, enum justFlags flags, Slot *pFirst, Slot *pLast);
+    bool breakLines(const Font *font, float width, gr_line_width_fn widthFn, void *appData, int maxBreak, bool justifyLast, Vector<Slot *> &lines);
     bool initCollisions();
   
 private:
@@ -207,6 +220,8 @@ void Segment::finalise(const Font *font, bool reverse)
 {
     if (!m_first) return;
 
+    if (font)
+        fetchAdvances(font);
     m_advance = positionSlots(font, m_first, m_last, m_silf->dir(), true);
     //associateChars(0, m_numCharinfo);
     if (reverse && currdir() != (m_dir & 1))
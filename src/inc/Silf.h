@@ -28,6 +28,7 @@ of the License or (at your option) any later version.
 
 #include "graphite2/Font.h"
 #include "inc/Main.h"
+#include "inc/List.h"
 #include "inc/Pass.h"
 
 namespace graphite2 {
@@ -74,11 +75,16 @@ public:
     Silf() throw();
     ~Silf() throw();
     
-    bool readGraphite(const byte * const pSilf, size_t lSilf, Face &face, uint32 version);
+    bool readGraphite(const byte * const pSilf, size_t lSilf, Face &face, uint32 version, bool lazyRules = false);
     bool runGraphite(Segment *seg, uint8 firstPass=0, uint8 lastPass=0, int dobidi = 0) const;
     uint16 findClassIndex(uint16 cid, uint16 gid) const;
     uint16 getClassGlyph(uint16 cid, unsigned int index) const;
+    // As above, but searching the class data even where the class is indexed.
+    uint16 searchClassIndex(uint16 cid, uint16 gid) const;
+    uint16 searchClassGlyph(uint16 cid, unsigned int index) const;
     uint16 findPseudo(uint32 uid) const;
+    void hotAttrs(Vector<uint16> & attrs) const;
+    void memoryUsage(gr_face_memory & usage) const;
     uint8 numUser() const { return m_aUser; }
     uint8 aPseudo() const { return m_aPseudo; }
     uint8 aBreak() const { return m_aBreak; }
@@ -105,11 +111,30 @@ public:
 private:
     size_t readClassMap(const byte *p, size_t data_len, uint32 version, Error &e);
     template<typename T> inline uint32 readClassOffsets(const byte *&p, size_t data_len, Error &e);
+    bool indexPseudos();
+    void indexClasses();
+
+    // A precomputed gid to index map for one lookup class. The table is either
+    // dense, indexed by gid - base, or when bits is non-zero an open addressed
+    // hash of (gid, index) pairs. glyphs maps indices back to gids.
+    struct ClassIndex
+    {
+        uint16        * table,
+                      * glyphs;
+        uint32          size,
+                        num_glyphs;
+        uint16          base;
+        uint8           bits;
+    };
+    static void readPassTask(void *data, size_t index);
 
     Pass          * m_passes;
     Pseudo        * m_pseudos;
+    uint16        * m_pseudoIndex;
     uint32        * m_classOffsets;
     uint16        * m_classData;
+    ClassIndex    * m_classIndex;
+    uint16        * m_classIndexData;
     Justinfo      * m_justs;
     uint8           m_numPasses;
     uint8           m_numJusts;
@@ -117,7 +142,7 @@ private:
                     m_flags, m_dir;
 
     uint8       m_aPseudo, m_aBreak, m_aUser, m_aBidi, m_aMirror, m_aPassBits,
-                m_iMaxComp, m_aCollision;
+                m_iMaxComp, m_aCollision, m_pseudoBits;
     uint16      m_aLig, m_numPseudo, m_nClass, m_nLinear,
                 m_gEndLine;
     gr_faceinfo m_silfinfo;
@@ -64,7 +64,8 @@ class Slot
         INSERTED    = 2,
         COPIED      = 4,
         POSITIONED  = 8,
-        ATTACHED    = 16
+        ATTACHED    = 16,
+        DIRTY       = 32
     };
 
 public:
@@ -105,6 +106,8 @@ public:
     bool isPositioned() const { return (m_flags & POSITIONED) ? true : false; }
     void markPositioned(bool state) { if (state) m_flags |= POSITIONED; else m_flags &= ~POSITIONED; }
     bool isInsertBefore() const { return !(m_flags & INSERTED); }
+    bool isDirty() const { return (m_flags & DIRTY) ? true : false; }
+    void markDirty(bool state) { if (state) m_flags |= DIRTY; else m_flags &= ~DIRTY; }
     uint8 getBidiLevel() const { return m_bidiLevel; }
     void setBidiLevel(uint8 level) { m_bidiLevel = level; }
     int8 getBidiClass(const Segment *seg);
@@ -155,6 +158,7 @@ private:
     Position m_advance;     // .advance slot attribute
     Position m_attach;      // attachment point on us
     Position m_with;        // attachment point position on parent
+    Position m_clusterEnd;  // pen position after this cluster when last positioned
     float    m_just;        // Justification inserted space
     uint8    m_flags;       // holds bit flags
     byte     m_attLevel;    // attachment level
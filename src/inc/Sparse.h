@@ -60,12 +60,25 @@ private:
     sparse(const sparse &);
     sparse & operator = (const sparse &);
 
+    template<typename I>
+    static bool extent(I first, const I last, key_type & n_chunks, size_t & n_values);
+    template<typename I>
+    void        fill(I first, const I last);
+
 public:
     template<typename I>
     sparse(I first, const I last);
+    // As above but the values are placed at store, which is advanced past them
+    //  and must stay alive as long as this does.
+    template<typename I>
+    sparse(I first, const I last, mapped_type * & store);
     sparse() throw();
     ~sparse() throw();
 
+    // The number of mapped_type a sparse made from [first, last) needs.
+    template<typename I>
+    static size_t storage(I first, const I last);
+
     operator bool () const throw();
     mapped_type     operator [] (const key_type k) const throw();
 
@@ -82,35 +95,57 @@ private:
         mapped_type   * values;
     }           m_array;
     key_type    m_nchunks;
+    bool        m_external;     // the values belong to someone else
 };
 
 
 inline
-sparse::sparse() throw() : m_nchunks(0)
+sparse::sparse() throw() : m_nchunks(0), m_external(false)
 {
     m_array.map = const_cast<graphite2::sparse::chunk *>(&empty_chunk);
 }
 
 
+// Find the maximum extent of the key space, fails if the keys are out of order.
 template <typename I>
-sparse::sparse(I attr, const I last)
-: m_nchunks(0)
+bool sparse::extent(I attr, const I last, key_type & n_chunks, size_t & n_values)
 {
-    m_array.map = 0;
-
-    // Find the maximum extent of the key space.
-    size_t n_values=0;
+    n_chunks = 0;
+    n_values = 0;
     long lastkey = -1;
-    for (I i = attr; i != last; ++i, ++n_values)
+    for (; attr != last; ++attr, ++n_values)
     {
-        const typename std::iterator_traits<I>::value_type v = *i;
+        const typename std::iterator_traits<I>::value_type v = *attr;
         if (v.second == 0)      { --n_values; continue; }
-        if (v.first <= lastkey) { m_nchunks = 0; return; }
+        if (v.first <= lastkey) return false;
 
         lastkey = v.first;
         const key_type k = v.first / SIZEOF_CHUNK;
-        if (k >= m_nchunks) m_nchunks = k+1;
+        if (k >= n_chunks) n_chunks = k+1;
     }
+    return true;
+}
+
+
+template <typename I>
+size_t sparse::storage(I attr, const I last)
+{
+    key_type n_chunks;
+    size_t n_values;
+    if (!extent(attr, last, n_chunks, n_values) || n_chunks == 0)
+        return 0;
+    return (n_chunks*sizeof(chunk) + sizeof(mapped_type)-1) / sizeof(mapped_type) + n_values;
+}
+
+
+template <typename I>
+sparse::sparse(I attr, const I last)
+: m_nchunks(0), m_external(false)
+{
+    m_array.map = 0;
+
+    size_t n_values;
+    if (!extent(attr, last, m_nchunks, n_values)) { m_nchunks = 0; return; }
     if (m_nchunks == 0)
     {
         m_array.map=const_cast<graphite2::sparse::chunk *>(&empty_chunk);
@@ -126,7 +161,34 @@ sparse::sparse(I attr, const I last)
         free(m_array.values); m_array.map=0;
         return;
     }
+    fill(attr, last);
+}
+
+
+template <typename I>
+sparse::sparse(I attr, const I last, mapped_type * & store)
+: m_nchunks(0), m_external(true)
+{
+    m_array.map = 0;
+
+    size_t n_values;
+    if (!extent(attr, last, m_nchunks, n_values)) { m_nchunks = 0; return; }
+    if (m_nchunks == 0)
+    {
+        m_array.map=const_cast<graphite2::sparse::chunk *>(&empty_chunk);
+        return;
+    }
 
+    m_array.values = store;
+    store += (m_nchunks*sizeof(chunk) + sizeof(mapped_type)-1) / sizeof(mapped_type) + n_values;
+    fill(attr, last);
+}
+
+
+// Lay the values out in the zeroed storage m_array points at.
+template <typename I>
+void sparse::fill(I attr, const I last)
+{
     // coverity[forward_null : FALSE] Since m_array is union and m_array.values is not NULL
     chunk * ci = m_array.map;
     ci->offset = (m_nchunks*sizeof(chunk) + sizeof(mapped_type)-1)/sizeof(mapped_type);
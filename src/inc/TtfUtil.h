@@ -141,10 +141,16 @@ public:
     gid16 CmapSubtable4Lookup(const void * pCmapSubtabel4, unsigned int nUnicodeId, int rangeKey = 0);
     unsigned int CmapSubtable4NextCodepoint(const void *pCmap31, unsigned int nUnicodeId,
         int * pRangeKey = 0);
+    bool CmapSubtable4Ordered(const void * pCmap31);
+    int CmapSubtable4RangeKey(const void * pCmap31, unsigned int nUnicodeId,
+        unsigned int & nFirst, unsigned int & nLast);
     bool CheckCmapSubtable12(const void *pCmap310, const void * pCmapEnd /*, unsigned int maxgid*/);
     gid16 CmapSubtable12Lookup(const void * pCmap310, unsigned int uUnicodeId, int rangeKey = 0);
     unsigned int CmapSubtable12NextCodepoint(const void *pCmap310, unsigned int nUnicodeId,
         int * pRangeKey = 0);
+    bool CmapSubtable12Ordered(const void * pCmap310);
+    int CmapSubtable12RangeKey(const void * pCmap310, unsigned int uUnicodeId,
+        unsigned int & uFirst, unsigned int & uLast);
 
     ///////////////////////////////// horizontal metric data for a glyph
     bool HorMetrics(gid16 nGlyphId, const void * pHmtx, size_t lHmtxSize, 
@@ -27,6 +27,7 @@ of the License or (at your option) any later version.
 #pragma once
 
 #include <cstdlib>
+#include <cstring>
 #include "inc/Main.h"
 
 namespace graphite2 {
@@ -40,6 +41,7 @@ struct _utf_codec
 
     static void     put(codeunit_t * cp, const uchar_t , int8 & len) throw();
     static uchar_t  get(const codeunit_t * cp, int8 & len) throw();
+    static void     decode(const codeunit_t * & cp, const codeunit_t * base, uchar_t * usv, size_t * offset, size_t n) throw();
     static bool     validate(const codeunit_t * s, const codeunit_t * e) throw();
 };
 
@@ -65,6 +67,16 @@ public:
         else                { l = -1; return 0xFFFD; }
     }
 
+    inline
+    static void decode(const codeunit_t * & cp, const codeunit_t * base, uchar_t * usv, size_t * offset, size_t n) throw()
+    {
+        for (int8 l; n; --n, ++cp)
+        {
+            *offset++ = cp - base;
+            *usv++ = get(cp, l);
+        }
+    }
+
     inline
     static bool validate(codeunit_t * s, codeunit_t * e) throw()
     {
@@ -107,6 +119,40 @@ public:
         return (uh<<10) + ul + surrogate_offset;
     }
 
+    // As get, for n characters, with runs of non-surrogates copied a word at
+    // a time.
+    inline
+    static void decode(const codeunit_t * & cp, const codeunit_t * base, uchar_t * usv, size_t * offset, size_t n) throw()
+    {
+        const size_t    run = sizeof(uintptr)/sizeof(codeunit_t);
+        const uintptr   lanes = ~uintptr(0)/0xFFFF;     // 1 in each code unit
+        const uchar_t * const end = usv + n;
+        while (usv != end)
+        {
+            if (size_t(end - usv) >= run)
+            {
+                uintptr w;
+                memcpy(&w, cp, sizeof w);
+                const uintptr s = (w & (lanes*0xF800)) ^ (lanes*0xD800);   // 0 for a surrogate
+                if (!((s - lanes) & ~s & (lanes*0x8000)))
+                {
+                    const size_t o = cp - base;
+                    for (size_t i = 0; i != run; ++i)
+                    {
+                        usv[i] = cp[i];
+                        offset[i] = o + i;
+                    }
+                    usv += run; offset += run; cp += run;
+                    continue;
+                }
+            }
+            int8 l;
+            *offset++ = cp - base;
+            *usv++ = get(cp, l);
+            cp += abs(l);
+        }
+    }
+
     inline
     static bool validate(codeunit_t * s, codeunit_t * e) throw()
     {
@@ -165,6 +211,39 @@ public:
         return u;
     }
 
+    // As get, for n characters, with runs of ASCII copied a word at a time.
+    inline
+    static void decode(const codeunit_t * & cp, const codeunit_t * base, uchar_t * usv, size_t * offset, size_t n) throw()
+    {
+        const size_t    run = sizeof(uintptr);
+        const uintptr   high_bits = ~uintptr(0)/0xFF*0x80;
+        const uchar_t * const end = usv + n;
+        while (usv != end)
+        {
+            // Every character is at least one byte so there are enough to read.
+            if (size_t(end - usv) >= run)
+            {
+                uintptr w;
+                memcpy(&w, cp, sizeof w);
+                if (!(w & high_bits))
+                {
+                    const size_t o = cp - base;
+                    for (size_t i = 0; i != run; ++i)
+                    {
+                        usv[i] = cp[i];
+                        offset[i] = o + i;
+                    }
+                    usv += run; offset += run; cp += run;
+                    continue;
+                }
+            }
+            int8 l;
+            *offset++ = cp - base;
+            *usv++ = get(cp, l);
+            cp += abs(l);
+        }
+    }
+
     inline
     static bool validate(codeunit_t * s, codeunit_t * e) throw()
     {
@@ -239,6 +318,13 @@ struct utf
     static bool validate(codeunit_t * s, codeunit_t * e) throw() {
         return _utf_codec<sizeof(C)*8>::validate(s,e);
     }
+
+    // Decode n characters at cp, storing each one and the offset of its first
+    // code unit from base. Malformed input decodes as the iterators do.
+    inline
+    static void decode(const codeunit_t * & cp, const codeunit_t * base, uchar_t * usv, size_t * offset, size_t n) throw() {
+        _utf_codec<sizeof(C)*8>::decode(cp, base, usv, offset, n);
+    }
 };
 
 
@@ -0,0 +1,292 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// usage: advancetest fontfile.ttf...
+// Makes and destroys fonts at several sizes and checks, through
+// gr_face_memory.advances, that fonts of the same size share one table of
+// advances, that a face keeps a few tables no font uses and frees the rest,
+// and that hinted fonts keep their own. Also checks the advances of fonts made
+// from a face that loads glyphs lazily match those from one that preloads them,
+// and that a hinted font with a batched advance callback asks for each glyph
+// once, in one call per segment, and positions as one calling it per glyph.
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <graphite2/Segment.h>
+#include "inc/Face.h"
+#include "inc/Font.h"
+#include "inc/GlyphCache.h"
+
+using namespace graphite2;
+
+namespace
+{
+
+// How many tables no font uses a face keeps, as in Face.cpp.
+const size_t spare_advances = 4;
+
+gr_face_memory memory(const gr_face * face)
+{
+    gr_face_memory usage;
+    memset(&usage, 0, sizeof usage);
+    usage.size = sizeof usage;
+    gr_face_memory_usage(face, &usage);
+    return usage;
+}
+
+float hinted_advance(const void *, gr_uint16)
+{
+    return 1.f;
+}
+
+// Counts the calls made to the advance callbacks of a hinted font.
+struct callbacks
+{
+    int single_calls,
+        batch_calls;
+    std::vector<int> requests;      // by glyph
+};
+
+float scaled_advance(gr_uint16 gid)
+{
+    return 3.f + gid % 7;
+}
+
+float counted_advance(const void * handle, gr_uint16 gid)
+{
+    ++static_cast<callbacks *>(const_cast<void *>(handle))->single_calls;
+    return scaled_advance(gid);
+}
+
+void counted_advances(const void * handle, const gr_uint16 * gids, float * advances, size_t n)
+{
+    callbacks & c = *static_cast<callbacks *>(const_cast<void *>(handle));
+    ++c.batch_calls;
+    for (; n; --n, ++gids, ++advances)
+    {
+        ++c.requests[*gids];
+        *advances = scaled_advance(*gids);
+    }
+}
+
+// Advances from a lazy face must be those from a preloaded one, whether or
+// not the glyph has been loaded yet.
+int same_advances(const char * name, const gr_font * lazy, const gr_font * preloaded, const gr_face * face)
+{
+    const unsigned int n = face->glyphs().numGlyphs();
+    for (unsigned int gid = 0; gid != n; ++gid)
+    {
+        const float expected = face->glyphs().glyph(gid)->theAdvance().x * preloaded->scale();
+        if (lazy->advance(gid) != expected || preloaded->advance(gid) != expected)
+        {
+            fprintf(stderr, "%s: glyph %u at scale %g has advances %g lazily and %g preloaded, not %g\n",
+                    name, gid, lazy->scale(), lazy->advance(gid), preloaded->advance(gid), expected);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int check_tables(const char * name, const gr_face * face, size_t tables, size_t table_size, const char * when)
+{
+    const size_t usage = memory(face).advances;
+    if (usage == tables * table_size)
+        return 0;
+    fprintf(stderr, "%s: %s the advance tables take %u bytes, not %u tables of %u\n",
+            name, when, unsigned(usage), unsigned(tables), unsigned(table_size));
+    return 1;
+}
+
+// Shape each text with a font that has both callbacks, one that only has the
+// batched one and one that only has the per glyph one. The batched callback
+// must be called at most once a segment and never be asked for a glyph twice,
+// and the fonts must position the glyphs alike.
+int test_callbacks(const char * name, gr_face * face)
+{
+    static const char * const texts[] = { "The quick brown fox", "jumps over the lazy dog.", "The lazy dog" };
+    const unsigned int n = face->glyphs().numGlyphs();
+    callbacks both = { 0, 0, std::vector<int>(n) },
+              batch = { 0, 0, std::vector<int>(n) },
+              single = { 0, 0, std::vector<int>(n) };
+    const gr_font_ops both_ops = { sizeof(gr_font_ops), counted_advance, 0, counted_advances },
+                      batch_ops = { sizeof(gr_font_ops), 0, 0, counted_advances },
+                      single_ops = { sizeof(gr_font_ops), counted_advance, 0, 0 };
+    gr_font * const fonts[] = { gr_make_font_with_ops(12.f, &both, &both_ops, face),
+                                gr_make_font_with_ops(12.f, &batch, &batch_ops, face),
+                                gr_make_font_with_ops(12.f, &single, &single_ops, face) };
+    callbacks * const counts[] = { &both, &batch, &single };
+
+    int failed = 0;
+    for (size_t t = 0; t != sizeof texts / sizeof texts[0]; ++t)
+    {
+        gr_segment * segs[3];
+        for (int f = 0; f != 3; ++f)
+        {
+            const int calls = counts[f]->batch_calls;
+            segs[f] = gr_make_seg(fonts[f], face, 0, 0, gr_utf8, texts[t], strlen(texts[t]), 0);
+            if (counts[f]->batch_calls > calls + 1)
+            {
+                fprintf(stderr, "%s: shaping \"%s\" called the batched advance callback %d times\n",
+                        name, texts[t], counts[f]->batch_calls - calls);
+                ++failed;
+            }
+        }
+        if (segs[0] && segs[1] && segs[2])
+        {
+            const gr_slot * s[3] = { gr_seg_first_slot(segs[0]), gr_seg_first_slot(segs[1]), gr_seg_first_slot(segs[2]) };
+            for (; s[0] && s[1] && s[2]; s[0] = gr_slot_next_in_segment(s[0]),
+                                         s[1] = gr_slot_next_in_segment(s[1]),
+                                         s[2] = gr_slot_next_in_segment(s[2]))
+            {
+                const float x = gr_slot_origin_X(s[2]),
+                            adv = gr_slot_advance_X(s[2], face, fonts[2]);
+                if (gr_slot_origin_X(s[0]) != x || gr_slot_origin_X(s[1]) != x
+                        || gr_slot_advance_X(s[0], face, fonts[0]) != adv
+                        || gr_slot_advance_X(s[1], face, fonts[1]) != adv)
+                {
+                    fprintf(stderr, "%s: glyph %u in \"%s\" is placed differently by the batched advance callback\n",
+                            name, gr_slot_gid(s[2]), texts[t]);
+                    ++failed;
+                    break;
+                }
+            }
+        }
+        for (int f = 0; f != 3; ++f)
+            gr_seg_destroy(segs[f]);
+    }
+
+    if (both.single_calls)
+    {
+        fprintf(stderr, "%s: the per glyph advance callback was called %d times, though the batched one was given\n",
+                name, both.single_calls);
+        ++failed;
+    }
+    if (!both.batch_calls && single.single_calls)
+    {
+        fprintf(stderr, "%s: the batched advance callback was never called\n", name);
+        ++failed;
+    }
+    if (both.batch_calls != batch.batch_calls)
+    {
+        fprintf(stderr, "%s: the batched advance callback was called %d times with both callbacks and %d with it alone\n",
+                name, both.batch_calls, batch.batch_calls);
+        ++failed;
+    }
+    for (unsigned int gid = 0; gid != n; ++gid)
+    {
+        if (both.requests[gid] > 1 || batch.requests[gid] > 1)
+        {
+            fprintf(stderr, "%s: the advance of glyph %u was asked for %d and %d times\n",
+                    name, gid, both.requests[gid], batch.requests[gid]);
+            ++failed;
+            break;
+        }
+    }
+    for (int f = 0; f != 3; ++f)
+        gr_font_destroy(fonts[f]);
+    return failed;
+}
+
+int test_font(const char * name)
+{
+    gr_face * const lazy = gr_make_file_face(name, gr_face_default),
+            * const preloaded = gr_make_file_face(name, gr_face_preloadGlyphs);
+    if (!lazy || !preloaded)
+    {
+        gr_face_destroy(lazy);
+        gr_face_destroy(preloaded);
+        return 0;
+    }
+
+    int failed = check_tables(name, lazy, 0, 0, "with no font");
+    const unsigned int loaded = memory(lazy).glyphs_loaded;
+    gr_font * const a = gr_make_font(12.f, lazy),
+            * const pa = gr_make_font(12.f, preloaded);
+    const size_t table_size = memory(lazy).advances;
+    if (!table_size || memory(lazy).glyphs_loaded != loaded)
+    {
+        fprintf(stderr, "%s: making a font took %u bytes of advances and loaded %u glyphs\n",
+                name, unsigned(table_size), memory(lazy).glyphs_loaded - loaded);
+        ++failed;
+    }
+    failed += same_advances(name, a, pa, preloaded);
+
+    // Fonts of the same size share a table, hinted fonts don't use them.
+    const gr_font_ops ops = { sizeof(gr_font_ops), hinted_advance, 0, 0 };
+    gr_font * const b = gr_make_font(12.f, lazy),
+            * const hinted = gr_make_font_with_ops(12.f, &ops, &ops, lazy);
+    failed += check_tables(name, lazy, 1, table_size, "with two fonts of one size");
+    gr_font * const c = gr_make_font(16.f, lazy);
+    failed += check_tables(name, lazy, 2, table_size, "with fonts of two sizes");
+    gr_font_destroy(hinted);
+    gr_font_destroy(a);
+    gr_font_destroy(b);
+    gr_font_destroy(c);
+    failed += check_tables(name, lazy, 2, table_size, "with their fonts destroyed");
+
+    // Only the most recently made of the tables no font uses are kept.
+    gr_font * fonts[spare_advances + 1];
+    for (size_t i = 0; i != spare_advances + 1; ++i)
+        fonts[i] = gr_make_font(20.f + 4 * i, lazy);
+    failed += check_tables(name, lazy, spare_advances + 3, table_size, "with seven sizes");
+    for (size_t i = 0; i != spare_advances + 1; ++i)
+        gr_font_destroy(fonts[i]);
+    failed += check_tables(name, lazy, spare_advances, table_size, "with seven sizes destroyed");
+    gr_font * const kept = gr_make_font(20.f + 4 * spare_advances, lazy);
+    failed += check_tables(name, lazy, spare_advances, table_size, "remaking a kept size");
+    gr_font * const freed = gr_make_font(12.f, lazy);
+    failed += check_tables(name, lazy, spare_advances + 1, table_size, "remaking a freed size");
+    gr_font_destroy(kept);
+    gr_font_destroy(freed);
+    failed += check_tables(name, lazy, spare_advances, table_size, "with the remade sizes destroyed");
+
+    // Again once shaping has loaded some glyphs but not others.
+    const char text[] = "Hello, world!";
+    gr_segment * const seg = gr_make_seg(pa, lazy, 0, 0, gr_utf8, text, sizeof text - 1, 0);
+    gr_seg_destroy(seg);
+    gr_font * const d = gr_make_font(40.f, lazy),
+            * const pd = gr_make_font(40.f, preloaded);
+    failed += same_advances(name, d, pd, preloaded);
+    gr_font_destroy(d);
+    gr_font_destroy(pd);
+
+    gr_font_destroy(pa);
+    failed += test_callbacks(name, lazy);
+    gr_face_destroy(lazy);
+    gr_face_destroy(preloaded);
+    return failed;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s fontfile.ttf...\n", argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+    for (int arg = 1; arg != argc; ++arg)
+        failed += test_font(argv[arg]);
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,266 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <graphite2/Font.h>
+#include <graphite2/Log.h>
+#include "readfile.h"
+
+#if defined _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+// usage: ./facebench [-n iterations] fontfile.ttf...
+// Loads each font repeatedly with every combination of face options and reports
+// the average time a load takes, how long it then takes to map every code point
+// through the face, and what gr_face_memory_usage says the face holds in total and
+// in its cmap cache afterwards. Each combination runs in a child process so the
+// peak resident set it reports belongs to that combination alone. When graphite2
+// is built with GRAPHITE2_TELEMETRY, the load time is also broken down by load
+// phase, read from the timings gr_start_logging writes to the start of the log.
+
+namespace
+{
+
+const struct { unsigned int flag; const char * name; } face_options[] =
+{
+    { gr_face_dumbRendering, "dumb" },
+    { gr_face_preloadGlyphs, "glyphs" },
+    { gr_face_cacheCmap,     "cmap" },
+    { gr_face_lazyRules,     "lazy" }
+};
+const unsigned int num_options = sizeof face_options / sizeof *face_options;
+
+// The load phases of the "time" object in a face's log, and their column headings.
+const struct { const char * key, * name; } phases[] =
+{
+    { "tables", "tables" },
+    { "decompress", "decomp" },
+    { "glyphs", "glyphs" },
+    { "cmap", "cmap" },
+    { "features", "feats" },
+    { "silf", "silf" },
+    { "passes", "passes" },
+    { "misc", "misc" }
+};
+const unsigned int num_phases = sizeof phases / sizeof *phases;
+
+char log_path[1024];
+
+double now()
+{
+#if defined _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return double(count.QuadPart) / double(freq.QuadPart);
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+const char * describe(unsigned int opts, char * buf)
+{
+    *buf = 0;
+    for (unsigned int i = 0; i != num_options; ++i)
+    {
+        if (!(opts & face_options[i].flag)) continue;
+        if (*buf) strcat(buf, "+");
+        strcat(buf, face_options[i].name);
+    }
+    return *buf ? buf : "default";
+}
+
+// Maps every Unicode code point through the face, returning how many it supports.
+unsigned int map_all(const gr_face * face)
+{
+    unsigned int n = 0;
+    for (gr_uint32 usv = 0; usv != 0x110000; ++usv)
+        n += gr_face_is_char_supported(face, usv, 0) != 0;
+    return n;
+}
+
+size_t total(const gr_face_memory & mem)
+{
+    return mem.glyphs + mem.boxes + mem.cmap + mem.classes + mem.passes
+         + mem.segcache + mem.tables + mem.advances;
+}
+
+// The peak resident set of this process in KiB, or -1 where it isn't known.
+long peak_rss()
+{
+#if defined _WIN32
+    return -1;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Adds the time the face took in each load phase to times, by logging the face
+// and reading the timings from the log. Fails if the log has none, as when
+// graphite2 is built without GRAPHITE2_TELEMETRY or with GRAPHITE2_NTRACING.
+bool add_phase_times(gr_face * face, double * times)
+{
+    if (!gr_start_logging(face, log_path))
+        return false;
+    gr_stop_logging(face);
+    char * const log = read_file(log_path);
+    const char * time = log ? strstr(log, "\"time\"") : 0;
+    const char * const end = time ? strchr(time, '}') : 0;
+    bool found = end != 0;
+    for (unsigned int i = 0; found && i != num_phases; ++i)
+    {
+        char key[32];
+        snprintf(key, sizeof key, "\"%s\"", phases[i].key);
+        const char * p = strstr(time, key);
+        found = p && p < end && (p = strchr(p, ':')) != 0;
+        if (found) times[i] += strtod(p + 1, 0);
+    }
+    free(log);
+    return found;
+}
+
+void run(const char * file, unsigned int opts, int iterations)
+{
+    char name[64];
+    bool loaded = true, timed = true;
+    double elapsed = 0, mapping = 0, held = 0, cmap_size = 0, times[num_phases] = {};
+    for (int n = 0; n != iterations && loaded; ++n)
+    {
+        double start = now();
+        gr_face * face = gr_make_file_face(file, opts);
+        elapsed += now() - start;
+        loaded = face != 0;
+        if (!face) continue;
+        timed = timed && add_phase_times(face, times);
+        start = now();
+        map_all(face);
+        mapping += now() - start;
+        gr_face_memory mem;
+        mem.size = sizeof mem;
+        if (gr_face_memory_usage(face, &mem))
+        {
+            held += total(mem);
+            cmap_size += mem.cmap;
+        }
+        gr_face_destroy(face);
+    }
+
+    if (!loaded)
+    {
+        printf("  %-22s failed to load\n", describe(opts, name));
+        return;
+    }
+    const double ms = 1000. / iterations, kib = 1024. * iterations;
+    printf("  %-22s %9.3f %8.3f %9.1f %9.1f %9ld", describe(opts, name), elapsed * ms,
+            mapping * ms, held / kib, cmap_size / kib, peak_rss());
+    for (unsigned int i = 0; i != num_phases; ++i)
+    {
+        if (timed)  printf(" %8.3f", times[i] * ms);
+        else        printf(" %8s", "-");
+    }
+    printf("\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 20, arg = 1;
+    if (argc > 2 && !strcmp(argv[1], "-n"))
+    {
+        iterations = atoi(argv[2]);
+        arg = 3;
+    }
+    if (argc - arg < 1 || iterations < 1)
+    {
+        fprintf(stderr, "usage: %s [-n iterations] fontfile.ttf...\n", argv[0]);
+        return 1;
+    }
+
+#if defined _WIN32
+    char dir[MAX_PATH];
+    if (!GetTempPathA(sizeof dir, dir) || !GetTempFileNameA(dir, "gr", 0, log_path))
+        return 1;
+#else
+    strcpy(log_path, "/tmp/facebenchXXXXXX");
+    const int fd = mkstemp(log_path);
+    if (fd < 0)
+        return 1;
+    close(fd);
+#endif
+
+    printf("%-24s %9s %8s %9s %9s %9s", "options", "load ms", "map ms", "held KiB",
+            "cmap KiB", "peak KiB");
+    for (unsigned int i = 0; i != num_phases; ++i)
+        printf(" %8s", phases[i].name);
+    printf("\n");
+    for (; arg != argc; ++arg)
+    {
+        printf("%s\n", argv[arg]);
+        for (unsigned int opts = 0; opts != 1u << num_options; ++opts)
+        {
+#if defined _WIN32
+            run(argv[arg], opts, iterations);
+#else
+            fflush(stdout);
+            const pid_t child = fork();
+            if (child == 0)
+            {
+                run(argv[arg], opts, iterations);
+                fflush(stdout);
+                _exit(0);
+            }
+            int status;
+            if (child < 0 || waitpid(child, &status, 0) != child
+                    || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                char name[64];
+                printf("  %-22s crashed\n", describe(opts, name));
+            }
+#endif
+        }
+    }
+    remove(log_path);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "readfile.h"
+
+#include "inc/Decompressor.h"
+
+// usage: ./lz4bench [-n iterations] fontfile.ttf
+// Decompresses the font's Silf and Glat tables, if LZ4 compressed, repeatedly and reports
+// the decompression throughput.
+
+namespace
+{
+
+unsigned long be32(const unsigned char *p)
+{
+    return (unsigned long)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 1000, arg = 1;
+    if (argc > 2 && !strcmp(argv[1], "-n"))
+    {
+        iterations = atoi(argv[2]);
+        arg = 3;
+    }
+    if (argc - arg != 1)
+    {
+        fprintf(stderr, "usage: %s [-n iterations] fontfile.ttf\n", argv[0]);
+        return 1;
+    }
+
+    size_t len = 0;
+    unsigned char * const font = reinterpret_cast<unsigned char *>(read_file(argv[arg], &len));
+    if (!font || len < 12)
+    {
+        fprintf(stderr, "%s: could not read font %s\n", argv[0], argv[arg]);
+        return 2;
+    }
+
+    const unsigned numTables = font[4] << 8 | font[5];
+    if (12 + 16 * numTables > len)
+    {
+        fprintf(stderr, "%s: bad table directory in %s\n", argv[0], argv[arg]);
+        return 2;
+    }
+    int status = 0;
+    for (unsigned i = 0; i != numTables; ++i)
+    {
+        const unsigned char * const entry = font + 12 + 16 * i;
+        const unsigned long offset = be32(entry + 8),
+                            size = be32(entry + 12);
+        if ((memcmp(entry, "Silf", 4) && memcmp(entry, "Glat", 4))
+                || offset > len || size > len - offset || size < 8)
+            continue;
+
+        // Compressed tables have the scheme in the top 5 bits of the word after
+        // the version and the uncompressed size in the rest.
+        const unsigned long hdr = be32(font + offset + 4);
+        if (hdr >> 27 != 1)
+            continue;
+        const size_t out_size = hdr & 0x07ffffff;
+        unsigned char * const out = static_cast<unsigned char *>(malloc(out_size));
+        if (!out) return 3;
+
+        int res = 0;
+        const clock_t start = clock();
+        for (int n = 0; n != iterations; ++n)
+            res = lz4::decompress(font + offset + 8, size - 8, out, out_size);
+        const double secs = double(clock() - start) / CLOCKS_PER_SEC;
+
+        if (res != int(out_size))
+        {
+            fprintf(stderr, "%s: %.4s failed to decompress\n", argv[0], entry);
+            status = 4;
+        }
+        else
+            printf("%.4s: %lu -> %lu bytes, %d iterations: %.1f ms, %.1f MB/s\n",
+                    entry, size - 8, (unsigned long)out_size, iterations, secs * 1000,
+                    secs > 0 ? out_size * double(iterations) / secs / 1e6 : 0.);
+        free(out);
+    }
+    free(font);
+    return status;
+}
@@ -0,0 +1,145 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#include <graphite2/Segment.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* usage: ./segbench [-r] [-n iterations] [-s ppem] fontfile.ttf textfile
+ * Shapes every line of the text file, repeatedly, and reports the time taken. */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-r] [-n iterations] [-s ppem] fontfile.ttf textfile\n", prog);
+}
+
+static char *readText(const char *fname, size_t *len)
+{
+    char *buf;
+    long size;
+    FILE *f = fopen(fname, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = (char *)malloc(size + 1);
+    if (buf && fread(buf, 1, size, f) != (size_t)size)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    if (!buf) return NULL;
+    buf[size] = 0;
+    *len = size;
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    int rtl = 0, iterations = 10, i, arg;
+    float ppem = 16.f;
+    size_t len, numLines = 0, numSlots = 0;
+    char *text, *line;
+    gr_face *face;
+    gr_font *font;
+    clock_t start, elapsed;
+
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (!strcmp(argv[arg], "-r"))
+            rtl = 1;
+        else if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+            iterations = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            ppem = (float)atof(argv[++arg]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - arg != 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    face = gr_make_file_face(argv[arg], gr_face_preloadAll);
+    if (!face)
+    {
+        fprintf(stderr, "%s: could not load font %s\n", argv[0], argv[arg]);
+        return 2;
+    }
+    font = gr_make_font(ppem, face);
+    text = readText(argv[arg + 1], &len);
+    if (!font || !text)
+    {
+        fprintf(stderr, "%s: could not read text %s\n", argv[0], argv[arg + 1]);
+        return 3;
+    }
+
+    start = clock();
+    for (i = 0; i < iterations; ++i)
+    {
+        for (line = text; line < text + len; )
+        {
+            char *eol = strchr(line, '\n');
+            const char *pError = NULL;
+            size_t numChars;
+            gr_segment *seg;
+            if (!eol) eol = text + len;
+            numChars = gr_count_unicode_characters(gr_utf8, line, eol, (const void **)&pError);
+            if (numChars && !pError)
+            {
+                seg = gr_make_seg(font, face, 0, 0, gr_utf8, line, numChars, rtl);
+                if (seg)
+                {
+                    if (i == 0)
+                    {
+                        ++numLines;
+                        numSlots += gr_seg_n_slots(seg);
+                    }
+                    gr_seg_destroy(seg);
+                }
+            }
+            line = eol + 1;
+        }
+    }
+    elapsed = clock() - start;
+
+    printf("%s: %lu lines, %lu glyphs, %d iterations: %.1f ms, %.2f us per line\n",
+            argv[arg], (unsigned long)numLines, (unsigned long)numSlots, iterations,
+            elapsed * 1000. / CLOCKS_PER_SEC,
+            numLines ? elapsed * 1e6 / CLOCKS_PER_SEC / ((double)numLines * iterations) : 0.);
+
+    free(text);
+    gr_font_destroy(font);
+    gr_face_destroy(face);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// usage: classtest fontfile.ttf...
+// Looks up every glyph in every class of each font's Silf table, and every
+// index in each class, and checks the class indexes built when the face loads
+// give what searching the class data does.
+#include <cstdio>
+#include <graphite2/Font.h>
+#include "inc/Face.h"
+#include "inc/GlyphCache.h"
+#include "inc/Silf.h"
+
+using namespace graphite2;
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s fontfile.ttf...\n", argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+    unsigned int classes = 0;
+    for (int arg = 1; arg != argc; ++arg)
+    {
+        gr_face * const face = gr_make_file_face(argv[arg], gr_face_default);
+        const Silf * const silf = face ? face->chooseSilf(0) : 0;
+        if (!silf)
+        {
+            gr_face_destroy(face);
+            continue;
+        }
+
+        const unsigned int num_glyphs = face->glyphs().numGlyphs();
+        for (uint16 cid = 0; cid != silf->numClasses(); ++cid, ++classes)
+        {
+            for (unsigned int gid = 0; gid <= num_glyphs; ++gid)
+            {
+                const uint16 found = silf->findClassIndex(cid, uint16(gid)),
+                             searched = silf->searchClassIndex(cid, uint16(gid));
+                if (found != searched)
+                {
+                    fprintf(stderr, "%s: glyph %u in class %u is at %u, searching finds %u\n",
+                            argv[arg], gid, cid, found, searched);
+                    ++failed;
+                    break;
+                }
+            }
+            for (unsigned int index = 0; index <= num_glyphs; ++index)
+            {
+                const uint16 found = silf->getClassGlyph(cid, index),
+                             searched = silf->searchClassGlyph(cid, index);
+                if (found != searched)
+                {
+                    fprintf(stderr, "%s: index %u in class %u is glyph %u, searching finds %u\n",
+                            argv[arg], index, cid, found, searched);
+                    ++failed;
+                    break;
+                }
+            }
+        }
+        gr_face_destroy(face);
+    }
+    if (!classes)
+    {
+        fprintf(stderr, "no font had any classes\n");
+        ++failed;
+    }
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,301 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// usage: cmaptest fontfile.ttf...
+// Maps every code point through each font's cmap in batches, both in code point
+// order and in the short steps and jumps that text makes, and checks the
+// batched lookups agree with looking each character up alone, and that a cached
+// cmap agrees with them. Each font is tried again with two of its cmap segments
+// swapped, which the batched lookup has to notice.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <graphite2/Font.h>
+#include "readfile.h"
+#include "inc/CmapCache.h"
+#include "inc/Face.h"
+#include "inc/TtfUtil.h"
+
+using namespace graphite2;
+
+namespace
+{
+
+struct font_file
+{
+    unsigned char * data;
+    size_t          size;
+};
+
+unsigned int be16(const unsigned char * p)
+{
+    return p[0] << 8 | p[1];
+}
+
+unsigned long be32(const unsigned char * p)
+{
+    return (unsigned long)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+const void * get_table(const void * handle, unsigned int tag, size_t * len)
+{
+    const font_file & f = *static_cast<const font_file *>(handle);
+    if (f.size < 12) return 0;
+    const unsigned int num_tables = be16(f.data + 4);
+    for (unsigned int i = 0; i != num_tables && 12 + 16 * (i + 1) <= f.size; ++i)
+    {
+        const unsigned char * const entry = f.data + 12 + 16 * i;
+        if (be32(entry) != tag) continue;
+        const unsigned long offset = be32(entry + 8), length = be32(entry + 12);
+        if (offset > f.size || length > f.size - offset) return 0;
+        *len = length;
+        return f.data + offset;
+    }
+    return 0;
+}
+
+const gr_face_ops ops = { sizeof(gr_face_ops), get_table, 0, 0 };
+
+// The glyph of the first format 12 group covering each code point, which is
+// what a lookup a character at a time gives in the supplementary planes. It is
+// built from the groups because the per character lookup searches them one by
+// one, which is too slow to make for every code point of a font with many groups.
+int * format12_glyphs(const Face & face)
+{
+    const Face::Table cmap(face, Tag::cmap);
+    const void * st = 0;
+    if (!cmap.size()
+            || (!TtfUtil::CheckCmapSubtable12(st = TtfUtil::FindCmapSubtable(cmap, 3, 10, cmap.size()), cmap + cmap.size())
+             && !TtfUtil::CheckCmapSubtable12(st = TtfUtil::FindCmapSubtable(cmap, 0, 4, cmap.size()), cmap + cmap.size())))
+        return 0;
+    int * const gids = static_cast<int *>(malloc(0x110000 * sizeof(int)));
+    if (!gids) return 0;
+    memset(gids, 0xFF, 0x110000 * sizeof(int));
+    const unsigned char * const groups = static_cast<const unsigned char *>(st) + 16;
+    for (unsigned long g = 0, n = be32(groups - 4); g != n; ++g)
+    {
+        const unsigned long first = be32(groups + 12 * g), last = be32(groups + 12 * g + 4),
+                            gid = be32(groups + 12 * g + 8);
+        for (unsigned long u = first; u <= last && u < 0x110000; ++u)
+            if (gids[u] < 0)
+                gids[u] = int((gid + u - first) & 0xFFFF);
+    }
+    for (int u = 0; u != 0x110000; ++u)
+        if (gids[u] < 0) gids[u] = 0;
+    return gids;
+}
+
+int check_lookups(const char * name, const Face & face, const Cmap & cmap)
+{
+    int * const smp = format12_glyphs(face);
+    uint32 usvs[64];
+    uint16 gids[64];
+    int failed = 0;
+
+    // The per character lookup agrees with the groups at their edges and
+    // every so often between.
+    for (uint32 u = 0x10000; smp && u != 0x110000 && !failed; ++u)
+        if ((u % 97 == 0 || smp[u] != (u == 0x10000 ? 0 : smp[u - 1]))
+                && cmap[u] != smp[u])
+        {
+            fprintf(stderr, "%s: U+%04X maps to %u, its format 12 group to %d\n", name, u, cmap[u], smp[u]);
+            ++failed;
+        }
+
+    // Every code point in order, a block at a time, then as text visits them:
+    // mostly short steps either way, with jumps between.
+    srand(1);
+    uint32 u = 0x20;
+    for (uint32 base = 0, b = 0; base != 0x110000 + 64 * 5000 && !failed; base += 64, ++b)
+    {
+        size_t n = 64;
+        if (base < 0x110000)
+            for (size_t i = 0; i != n; ++i)
+                usvs[i] = base + uint32(i);
+        else
+        {
+            n = 1 + size_t(rand()) % 64;
+            for (size_t i = 0; i != n; ++i)
+                usvs[i] = u = rand() % 8 ? (u + rand() % 9 - 3) % 0x110000 : rand() % 0x110000;
+        }
+        cmap.lookup(usvs, gids, n);
+        for (size_t i = 0; i != n && !failed; ++i)
+        {
+            const uint16 gid = usvs[i] > 0xFFFF ? (smp ? uint16(smp[usvs[i]]) : 0) : cmap[usvs[i]];
+            if (gids[i] != gid)
+            {
+                fprintf(stderr, "%s: U+%04X maps to %u in a batch, %u alone\n", name, usvs[i], gids[i], gid);
+                ++failed;
+            }
+        }
+    }
+
+    // Past the end of Unicode.
+    for (size_t i = 0; i != 64; ++i)
+        usvs[i] = 0x10FFE0 + uint32(i);
+    cmap.lookup(usvs, gids, 64);
+    for (size_t i = 0; i != 64 && !failed; ++i)
+        if (gids[i] != cmap[usvs[i]])
+        {
+            fprintf(stderr, "%s: U+%04X maps to %u in a batch, %u alone\n", name, usvs[i], gids[i], cmap[usvs[i]]);
+            ++failed;
+        }
+    free(smp);
+    return failed;
+}
+
+void cached_expected(const Cmap & direct, const int * fmt12, const uint32 * usvs, uint16 * gids)
+{
+    direct.lookup(usvs, gids, 64);
+    for (int i = 0; i != 64; ++i)
+        if (!gids[i] && fmt12 && usvs[i] < 0x10000)
+            gids[i] = uint16(fmt12[usvs[i]]);
+}
+
+// A cached cmap must map every code point as the direct one does, whether its
+// pages are built by a batched lookup or a single one. As it always has, it
+// also maps BMP characters only the format 12 subtable has.
+int check_cached(const char * name, const Face & face, const Cmap & direct)
+{
+    const CachedCmap batched(face), single(face);
+    if (!batched || !single)
+    {
+        fprintf(stderr, "%s: failed to make a cached cmap\n", name);
+        return 1;
+    }
+    int * const fmt12 = format12_glyphs(face);
+    int failed = 0;
+    uint32 usvs[64];
+    uint16 expected[64], gids[64];
+    for (uint32 base = 0x110000 + 64; base != 0 && !failed;)
+    {
+        base -= 64;
+        for (int i = 0; i != 64; ++i)
+            usvs[i] = base + i;
+        cached_expected(direct, fmt12, usvs, expected);
+        for (int i = 63; i >= 0 && !failed; --i)
+            if (single[usvs[i]] != expected[i])
+            {
+                fprintf(stderr, "%s: U+%04X maps to %u cached, %u direct\n", name, usvs[i], single[usvs[i]], expected[i]);
+                ++failed;
+            }
+    }
+    for (uint32 base = 0; base != 0x110000 + 64 && !failed; base += 64)
+    {
+        for (int i = 0; i != 64; ++i)
+            usvs[i] = base + i;
+        cached_expected(direct, fmt12, usvs, expected);
+        batched.lookup(usvs, gids, 64);
+        for (int i = 0; i != 64 && !failed; ++i)
+            if (gids[i] != expected[i] || batched[usvs[i]] != expected[i])
+            {
+                fprintf(stderr, "%s: U+%04X maps to %u cached in a batch, %u direct\n", name, usvs[i], gids[i], expected[i]);
+                ++failed;
+            }
+    }
+    free(fmt12);
+    return failed;
+}
+
+// Swap the first and last segments of the font's format 4 subtable that can
+// be moved, so that it is no longer sorted, returning that subtable.
+const void * unsort_cmap(font_file & f)
+{
+    size_t len = 0;
+    const void * const cmap = get_table(&f, 0x636D6170, &len);
+    if (!cmap) return 0;
+    unsigned char * const st = static_cast<unsigned char *>(const_cast<void *>(
+            TtfUtil::FindCmapSubtable(cmap, 3, 1, len)));
+    if (!st || !TtfUtil::CheckCmapSubtable4(st, static_cast<const unsigned char *>(cmap) + len))
+        return 0;
+    const unsigned int n = be16(st + 6) / 2;
+    unsigned char * const ends = st + 14, * const starts = ends + 2 * n + 2,
+                  * const deltas = starts + 2 * n, * const offsets = deltas + 2 * n;
+    // Only segments mapped by delta can move, the others index the glyph array
+    // relative to where they are. The last segment must stay last.
+    unsigned int i = 0, j = n - 1;
+    while (i < j && be16(offsets + 2 * i)) ++i;
+    while (j > i && (j == n - 1 || be16(offsets + 2 * j))) --j;
+    if (i >= j) return 0;
+    for (unsigned char * a = ends; a != offsets; a += 2 * n + (a == ends ? 2 : 0))
+    {
+        unsigned char t[2] = { a[2 * i], a[2 * i + 1] };
+        memcpy(a + 2 * i, a + 2 * j, 2);
+        memcpy(a + 2 * j, t, 2);
+    }
+    return st;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s fontfile.ttf...\n", argv[0]);
+        return 1;
+    }
+
+    int failed = 0, unsorted = 0;
+    for (int arg = 1; arg != argc; ++arg)
+    {
+        font_file font = { 0, 0 };
+        font.data = reinterpret_cast<unsigned char *>(read_file(argv[arg], &font.size));
+        if (!font.data)
+        {
+            fprintf(stderr, "can't read %s\n", argv[arg]);
+            ++failed;
+            continue;
+        }
+
+        for (int pass = 0; pass != 2; ++pass)
+        {
+            if (pass == 1)
+            {
+                const void * const st = unsort_cmap(font);
+                if (!st) break;
+                if (TtfUtil::CmapSubtable4Ordered(st))
+                {
+                    fprintf(stderr, "%s: a cmap with two segments swapped is still sorted\n", argv[arg]);
+                    ++failed;
+                    break;
+                }
+                ++unsorted;
+            }
+            gr_face * const face = gr_make_face_with_ops(&font, &ops, gr_face_default);
+            if (!face) break;
+            {
+                const DirectCmap direct(*face);
+                if (direct)
+                    failed += check_lookups(argv[arg], *face, direct)
+                            + check_cached(argv[arg], *face, direct);
+            }
+            gr_face_destroy(face);
+        }
+        free(font.data);
+    }
+    if (!unsorted)
+    {
+        fprintf(stderr, "no font's cmap could be unsorted\n");
+        ++failed;
+    }
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,50 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Reads a whole file into memory the caller frees. A NUL follows what was
+// read so a text file can be used as a string, and len, when given, is set
+// to the file's size. Returns NULL if the file can't be read.
+inline char * read_file(const char * path, size_t * len = 0)
+{
+    FILE * f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    const long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char * data = n < 0 ? 0 : static_cast<char *>(malloc(n + 1));
+    if (data && fread(data, 1, n, f) != size_t(n))
+    {
+        free(data);
+        data = 0;
+    }
+    if (data)
+    {
+        data[n] = 0;
+        if (len) *len = size_t(n);
+    }
+    fclose(f);
+    return data;
+}
@@ -47,8 +47,8 @@ int main(int argc, char **argv)
     gr_face *face;
     FT_Library ftlib;
     FT_Face ftface;
-    gr_face_ops faceops = {sizeof(gr_face_ops), &getTable, &releaseTable};          /*<2>*/
-    gr_font_ops fontops = {sizeof(gr_font_ops), &getAdvance, NULL};
+    gr_face_ops faceops = {sizeof(gr_face_ops), &getTable, &releaseTable, NULL};        /*<2>*/
+    gr_font_ops fontops = {sizeof(gr_font_ops), &getAdvance, NULL, NULL};
     /* Set up freetype font face at given point size */
     if (FT_Init_FreeType(&ftlib)) return -1;
     if (FT_New_Face(ftlib, argv[1], 0, &ftface)) return -2;
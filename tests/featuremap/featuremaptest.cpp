@@ -162,6 +162,72 @@ const FeatTableTestE testBadOffset = {
     {{0,10},{1,11},{0,12},{10,13},{0,14},{1,15},{2,16},{2,17},{4,18},{1,19},{2,20}}
 };
 
+struct SillHeader
+{
+    _be<gr_uint32> m_version;
+    _be<gr_uint16> m_numLangs;
+    _be<gr_uint16> m_searchRange;
+    _be<gr_uint16> m_entrySelector;
+    _be<gr_uint16> m_rangeShift;
+};
+
+struct SillLang
+{
+    _be<gr_uint32> m_lang;
+    _be<gr_uint16> m_numSettings;
+    _be<gr_uint16> m_offset;
+};
+
+struct SillSetting
+{
+    _be<gr_uint32> m_featId;
+    _be<gr_uint16> m_value;
+    _be<gr_uint16> m_reserved;
+};
+
+// Languages for the features of testDataB, out of order and with en twice.
+struct SillTableTest
+{
+    SillHeader m_header;
+    SillLang m_langs[5];
+    SillSetting m_settings[5];
+};
+
+const gr_uint32 lang_de = 0x64650000, lang_en = 0x656E0000, lang_fr = 0x66720000,
+                lang_nl = 0x6E6C0000, lang_xx = 0x78780000;
+
+const SillTableTest testSill = {
+    { 0x00010000, 5, 0, 0, 0 },
+    {{lang_fr, 1, sizeof(SillHeader) + 5 * sizeof(SillLang)},
+     {lang_en, 2, sizeof(SillHeader) + 5 * sizeof(SillLang) + 1 * sizeof(SillSetting)},
+     {lang_de, 0, sizeof(SillHeader) + 5 * sizeof(SillLang) + 3 * sizeof(SillSetting)},
+     {lang_en, 1, sizeof(SillHeader) + 5 * sizeof(SillLang) + 3 * sizeof(SillSetting)},
+     {lang_nl, 1, sizeof(SillHeader) + 5 * sizeof(SillLang) + 4 * sizeof(SillSetting)}},
+    {{0x41424345, 1, 0}, {0x41424344, 1, 0}, {0x41424345, 1, 0}, {0x41424344, 0, 0}, {0x41424344, 1, 0}}
+};
+
+const SillHeader testSillEmpty = { 0x00010000, 0, 0, 0, 0 };
+
+// Features with no settings take a whole word each, so together they need
+// more words than a FeatureVal holds inline.
+struct FeatTableTestWide
+{
+    FeatHeader m_header;
+    FeatDefn m_defs[8];
+};
+
+const FeatTableTestWide testDataWide = {
+    { 2, 0, 8, 0, 0},
+    {{0x46563030, 0, 0, sizeof(FeatTableTestWide), 0, 1},
+     {0x46563031, 0, 0, sizeof(FeatTableTestWide), 0, 2},
+     {0x46563032, 0, 0, sizeof(FeatTableTestWide), 0, 3},
+     {0x46563033, 0, 0, sizeof(FeatTableTestWide), 0, 4},
+     {0x46563034, 0, 0, sizeof(FeatTableTestWide), 0, 5},
+     {0x46563035, 0, 0, sizeof(FeatTableTestWide), 0, 6},
+     {0x46563036, 0, 0, sizeof(FeatTableTestWide), 0, 7},
+     {0x46563037, 0, 0, sizeof(FeatTableTestWide), 0, 8}}
+};
+
 #pragma pack(pop)
 
 class face_handle
@@ -216,7 +282,7 @@ private:
 };
 
 const face_handle::table_t	face_handle::no_table = face_handle::table_t(reinterpret_cast<void *>(0),0);
-const gr_face_ops face_handle::ops = { sizeof(gr_face_ops), face_handle::get_table_fn, 0 };
+const gr_face_ops face_handle::ops = { sizeof(gr_face_ops), face_handle::get_table_fn, 0, 0 };
 
 
 template <typename T> void testAssert(const char * msg, const T b)
@@ -267,6 +333,113 @@ template <class T> void testFeatTable(const T & table, const char * testName)
     gr_face_destroy(face);
 }
 
+// Check the values cloneFeatures gives features ABCD and ABCE for a language.
+void testLangFeatures(const SillMap & sill, gr_uint32 lang, gr_uint32 abcd, gr_uint32 abce)
+{
+    const FeatureRef * const refD = sill.theFeatureMap().findFeatureRef(0x41424344),
+                     * const refE = sill.theFeatureMap().findFeatureRef(0x41424345);
+    testAssert("test feat\n", refD && refE);
+    Features * const feats = sill.cloneFeatures(lang);
+    testAssert("clone features for a language\n", feats);
+    testAssertEqual("language feature ABCD %u %u\n", refD->getFeatureVal(*feats), abcd);
+    testAssertEqual("language feature ABCE %u %u\n", refE->getFeatureVal(*feats), abce);
+    delete feats;
+}
+
+template <class T> void testSillTable(const T & table, const char * testName)
+{
+    dummyFace.replace_table(TtfUtil::Tag::Feat, &testDataB, sizeof testDataB);
+    dummyFace.replace_table(TtfUtil::Tag::Sill, &table, sizeof(T));
+    gr_face * face = gr_make_face_with_ops(&dummyFace, &face_handle::ops, gr_face_dumbRendering);
+    if (!face) throw std::runtime_error("failed to load font");
+    fprintf(stderr, testName, NULL);
+    // Feature values only apply to the map of the face that owns the features,
+    // and a face without a Silf table doesn't read them, so read them here.
+    testAssert("readFeatures\n", face->readFeatures());
+    const SillMap & sill = face->theSill();
+    testAssertEqual("test num languages %hu,%hu\n", sill.numLanguages(), gr_uint16(sizeof(T) > sizeof(SillHeader) ? 5 : 0));
+    if (sill.numLanguages())
+    {
+        // The first of the two en entries wins.
+        testLangFeatures(sill, lang_de, 0, 0);
+        testLangFeatures(sill, lang_en, 1, 1);
+        testLangFeatures(sill, lang_fr, 0, 1);
+        testLangFeatures(sill, lang_nl, 1, 0);
+    }
+    testLangFeatures(sill, lang_xx, 0, 0);
+    testLangFeatures(sill, 0, 0, 0);
+    gr_face_destroy(face);
+    dummyFace.replace_table(TtfUtil::Tag::Sill, 0, 0);
+}
+
+const int num_wide = sizeof(testDataWide.m_defs) / sizeof(FeatDefn);
+
+// Check feats holds the first n of vals, and matches a FeatureVal built afresh
+// from the last feature to the first, so it goes straight to its full size.
+void testSameFeatureVal(const FeatureRef * const * refs, const gr_uint32 * vals, int n, const Features & feats)
+{
+    Features fresh;
+    for (int i = n; i--; )
+        testAssert("apply feature value\n", refs[i]->applyValToFeature(vals[i], fresh));
+    testAssertEqual("feature value size %u %u\n", feats.size(), fresh.size());
+    testAssert("feature values equal\n", feats == fresh);
+    testAssertEqual("feature value hash %x %x\n", feats.hash(), fresh.hash());
+    for (int i = 0; i != n; ++i)
+        testAssertEqual("feature value %u %u\n", refs[i]->getFeatureVal(feats), vals[i]);
+}
+
+void testFeatureVal()
+{
+    dummyFace.replace_table(TtfUtil::Tag::Feat, &testDataWide, sizeof testDataWide);
+    gr_face * face = gr_make_face_with_ops(&dummyFace, &face_handle::ops, gr_face_dumbRendering);
+    if (!face) throw std::runtime_error("failed to load font");
+    fprintf(stderr, "FeatureVal\n");
+    testAssert("readFeatures\n", face->readFeatures());
+    const FeatureRef * refs[num_wide];
+    for (int i = 0; i != num_wide; ++i)
+    {
+        refs[i] = face->featureById(testDataWide.m_defs[i].m_featId);
+        testAssert("test feat\n", refs[i]);
+    }
+
+    // Grow from nothing through the inline words and onto the heap.
+    gr_uint32 vals[num_wide];
+    Features feats, small;
+    for (int i = 0; i != num_wide; ++i)
+    {
+        vals[i] = 0x01010101u * (i + 1);
+        testAssert("apply feature value\n", refs[i]->applyValToFeature(vals[i], feats));
+        testSameFeatureVal(refs, vals, i + 1, feats);
+        if (i == 1) small = feats;
+    }
+
+    // Set and clear values at random.
+    srand(1);
+    for (int n = 0; n != 1000; ++n)
+    {
+        const Features before(feats);
+        const int i = rand() % num_wide;
+        const gr_uint32 val = rand() % 2 ? gr_uint32(rand()) << 16 ^ gr_uint32(rand()) : 0;
+        testAssert("apply feature value\n", refs[i]->applyValToFeature(val, feats));
+        testAssert("a changed value changes the feature values\n", (vals[i] == val) == (feats == before));
+        vals[i] = val;
+        testSameFeatureVal(refs, vals, num_wide, feats);
+    }
+
+    // Copy between inline and heap values both ways.
+    Features copy(feats);
+    testAssert("copy heap feature values\n", copy == feats && copy.hash() == feats.hash());
+    copy = small;
+    testAssert("copy inline over heap feature values\n", copy == small && copy.hash() == small.hash());
+    copy = copy;
+    testAssert("copy feature values to themselves\n", copy == small && copy.hash() == small.hash());
+    copy = feats;
+    testAssert("copy heap over inline feature values\n", copy == feats && copy.hash() == feats.hash());
+    testAssert("different sizes of feature values differ\n", !(copy == small));
+
+    gr_face_destroy(face);
+}
+
 int main(int argc, char * argv[])
 {
     gr_face * face = 0;
@@ -281,6 +454,9 @@ int main(int argc, char * argv[])
 		testFeatTable<FeatTableTestC>(testDataCunsorted, "C\n");
 		testFeatTable<FeatTableTestD>(testDataDunsorted, "D\n");
 		testFeatTable<FeatTableTestE>(testDataE, "E\n");
+		testSillTable<SillTableTest>(testSill, "Sill\n");
+		testSillTable<SillHeader>(testSillEmpty, "Sill empty\n");
+		testFeatureVal();
 
 		// test a bad settings offset stradling the end of the table
 		FeatureMap testFeatureMap;
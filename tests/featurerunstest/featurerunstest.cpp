@@ -0,0 +1,312 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// usage: featurerunstest fontdir textdir
+// Shapes each line of a text with gr_make_seg_with_feature_runs, giving its
+// words different feature values, and checks the glyphs of each word match
+// those of the word shaped on its own with gr_make_seg. Does so on a plain
+// face and on a face with a segment cache, which caches each word under its
+// own features. Also checks a segment needing more than 256 distinct feature
+// values isn't made.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <graphite2/Segment.h>
+#include "readfile.h"
+
+namespace
+{
+
+typedef std::vector<std::pair<gr_uint16, float> > glyphs_t;
+
+struct shaper
+{
+    gr_face       * face;
+    gr_font       * font;
+    gr_feature_val* base,       // for characters outside any run
+                  * feats;      // for the runs
+};
+
+struct piece
+{
+    size_t first, length;       // in characters
+    const char * text;
+};
+
+bool make_shaper(shaper & s, gr_face * face, gr_uint32 base_lang, gr_uint32 lang, gr_uint32 feat)
+{
+    s.face = face;
+    s.font = face ? gr_make_font(16.f, face) : 0;
+    s.base = face ? gr_face_featureval_for_lang(face, base_lang) : 0;
+    s.feats = face ? gr_face_featureval_for_lang(face, lang) : 0;
+    if (!s.font || !s.base || !s.feats)
+        return false;
+    return !feat || gr_fref_set_feature_value(gr_face_find_fref(face, feat), 1, s.feats);
+}
+
+void destroy_shaper(shaper & s)
+{
+    gr_featureval_destroy(s.feats);
+    gr_featureval_destroy(s.base);
+    gr_font_destroy(s.font);
+    gr_face_destroy(s.face);
+}
+
+// The glyphs of seg that come from characters first to first + length, in
+// segment order.
+void word_glyphs(gr_segment * seg, const shaper & s, size_t first, size_t length, glyphs_t & glyphs)
+{
+    glyphs.clear();
+    for (const gr_slot * g = gr_seg_first_slot(seg); g; g = gr_slot_next_in_segment(g))
+        if (size_t(gr_slot_before(g)) - first < length)
+            glyphs.push_back(std::make_pair(gr_slot_gid(g), gr_slot_advance_X(g, s.face, s.font)));
+}
+
+// Words cycle through the segment's features, the run features and the
+// default features. On odd lines the words with the segment's features are in
+// no run. On even lines a run with the run features covers the whole line, and
+// later runs override it for the other words.
+const gr_feature_val * word_feats(const shaper & s, size_t word)
+{
+    switch (word % 3)
+    {
+    case 0:     return s.base;
+    case 1:     return s.feats;
+    default:    return 0;
+    }
+}
+
+void make_runs(const shaper & s, const std::vector<piece> & words, int line, std::vector<gr_feature_run> & runs)
+{
+    runs.clear();
+    if (line % 2 == 0)
+    {
+        const gr_feature_run all = { s.feats, 0, words.back().first + words.back().length + 10 };
+        runs.push_back(all);
+    }
+    for (size_t i = 0; i != words.size(); ++i)
+    {
+        if (i % 3 == (line % 2 ? 0 : 1))
+            continue;
+        const gr_feature_run r = { word_feats(s, i), words[i].first, words[i].length };
+        runs.push_back(r);
+    }
+}
+
+// Split a line into words, each taking the spaces after it.
+void split_words(const char * line, std::vector<piece> & words)
+{
+    words.clear();
+    size_t n = 0;
+    bool space = true;
+    for (const char * p = line; *p; ++p)
+    {
+        if ((*p & 0xC0) == 0x80) continue;
+        if (space && *p != ' ')
+        {
+            const piece w = { n, 0, p };
+            words.push_back(w);
+        }
+        space = *p == ' ';
+        if (!words.empty()) ++words.back().length;
+        ++n;
+    }
+}
+
+// Returns the number of failures, and counts in changed the lines the runs
+// change the glyphs of.
+int test_lines(const shaper & s, const shaper & plain, const char * text, char * lines, int rtl, int & changed)
+{
+    int failed = 0, n = 0;
+    std::vector<piece> words;
+    std::vector<gr_feature_run> runs;
+    glyphs_t a, b;
+    for (char * line = strtok(lines, "\r\n"); line; line = strtok(0, "\r\n"), ++n)
+    {
+        split_words(line, words);
+        if (words.empty()) continue;
+        make_runs(s, words, n, runs);
+        const size_t len = gr_count_unicode_characters(gr_utf8, line, 0, 0);
+        gr_segment * const seg = gr_make_seg_with_feature_runs(s.font, s.face, 0, s.base, &runs[0], runs.size(),
+                                                               gr_utf8, line, len, rtl),
+                   * const whole = gr_make_seg(s.font, s.face, 0, s.base, gr_utf8, line, len, rtl);
+        if (!seg || !whole)
+        {
+            fprintf(stderr, "%s line %d: failed to make a segment\n", text, n + 1);
+            gr_seg_destroy(seg);
+            gr_seg_destroy(whole);
+            ++failed;
+            continue;
+        }
+
+        // The words are shaped on their own on the plain face, so the cache
+        // of a cached face plays no part in what the result should be.
+        for (size_t i = 0; i != words.size(); ++i)
+        {
+            const gr_feature_val * const feats = word_feats(plain, i);
+            gr_segment * const word = gr_make_seg(plain.font, plain.face, 0, feats,
+                                                  gr_utf8, words[i].text, words[i].length, rtl);
+            word_glyphs(seg, s, words[i].first, words[i].length, a);
+            if (word) word_glyphs(word, plain, 0, words[i].length, b);
+            if (!word || a != b)
+            {
+                fprintf(stderr, "%s line %d word %u: the glyphs differ from the word shaped on its own\n",
+                        text, n + 1, unsigned(i + 1));
+                ++failed;
+            }
+            gr_seg_destroy(word);
+        }
+
+        word_glyphs(seg, s, 0, len, a);
+        word_glyphs(whole, s, 0, len, b);
+        if (a != b) ++changed;
+        gr_seg_destroy(seg);
+        gr_seg_destroy(whole);
+    }
+    return failed;
+}
+
+int test_runs(const char * fontdir, const char * textdir, const char * fontname, const char * text,
+              const char * base_lang, const char * lang, const char * feat, int rtl, bool cache)
+{
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", fontdir, fontname);
+    shaper plain, cached;
+    const gr_uint32 base_tag = gr_str_to_tag(base_lang), tag = gr_str_to_tag(lang),
+                    feat_tag = feat ? gr_str_to_tag(feat) : 0;
+    bool ok = make_shaper(plain, gr_make_file_face(path, 0), base_tag, tag, feat_tag);
+    cached.face = 0;
+#ifndef GRAPHITE2_NSEGCACHE
+    if (cache)
+        ok = make_shaper(cached, gr_make_file_face_with_seg_cache(path, 1000, 0), base_tag, tag, feat_tag) && ok;
+#endif
+    snprintf(path, sizeof path, "%s/%s", textdir, text);
+    char * lines = read_file(path);
+    int failed = 0;
+    if (!ok || !lines)
+    {
+        fprintf(stderr, "failed to load %s or %s\n", fontname, text);
+        ++failed;
+    }
+    else
+    {
+        int changed = 0;
+        failed += test_lines(plain, plain, text, lines, rtl, changed);
+        if (!changed)
+        {
+            fprintf(stderr, "%s: the runs' features change no line\n", text);
+            ++failed;
+        }
+        if (cached.face)
+        {
+            free(lines);
+            lines = read_file(path);
+            failed += test_lines(cached, plain, text, lines, rtl, changed);
+            // Again, now the words are in the cache.
+            free(lines);
+            lines = read_file(path);
+            failed += test_lines(cached, plain, text, lines, rtl, changed);
+        }
+    }
+    free(lines);
+    if (cached.face) destroy_shaper(cached);
+    destroy_shaper(plain);
+    return failed;
+}
+
+// A segment can hold 256 distinct feature values, one of them its own.
+bool make_runs_seg(gr_face * face, size_t n)
+{
+    gr_feature_val * const defaults = gr_face_featureval_for_lang(face, 0);
+    std::vector<gr_feature_val *> feats;
+    std::vector<gr_feature_run> runs;
+    const std::string text(n, 'a');
+    for (size_t k = 1; k <= n; ++k)
+    {
+        // Each bit of k picks a feature that takes a value other than its default.
+        gr_feature_val * const f = gr_featureval_clone(defaults);
+        for (gr_uint16 i = 0, bit = 0; i != gr_face_n_fref(face) && k >> bit; ++i)
+        {
+            const gr_feature_ref * const ref = gr_face_fref(face, i);
+            if (gr_fref_id(ref) == 1 || gr_fref_n_values(ref) < 2) continue;
+            const gr_uint16 val = gr_fref_feature_value(ref, defaults);
+            if (k >> bit++ & 1)
+                gr_fref_set_feature_value(ref, gr_fref_value(ref, 0) == val ? gr_fref_value(ref, 1) : gr_fref_value(ref, 0), f);
+        }
+        feats.push_back(f);
+        const gr_feature_run r = { f, k - 1, 1 };
+        runs.push_back(r);
+    }
+    gr_segment * const seg = gr_make_seg_with_feature_runs(0, face, 0, defaults, &runs[0], runs.size(),
+                                                           gr_utf8, text.c_str(), n, 0);
+    gr_seg_destroy(seg);
+    for (size_t k = 0; k != feats.size(); ++k)
+        gr_featureval_destroy(feats[k]);
+    gr_featureval_destroy(defaults);
+    return seg != 0;
+}
+
+int test_too_many_runs(gr_face * face, const char * fontname)
+{
+    if (!face)
+    {
+        fprintf(stderr, "failed to load %s\n", fontname);
+        return 1;
+    }
+    int failed = 0;
+    if (!make_runs_seg(face, 255))
+    {
+        fprintf(stderr, "%s: a segment with 256 distinct feature values fails\n", fontname);
+        ++failed;
+    }
+    if (make_runs_seg(face, 256))
+    {
+        fprintf(stderr, "%s: a segment with 257 distinct feature values is made\n", fontname);
+        ++failed;
+    }
+    gr_face_destroy(face);
+    return failed;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s fontdir textdir\n", argv[0]);
+        return 1;
+    }
+    int failed = 0;
+    failed += test_runs(argv[1], argv[2], "charis_fast.ttf", "udhr_eng.txt", "vie", "", "smcp", 0, true);
+    // The segment cache doesn't shape Arabic words the same as a whole line.
+    failed += test_runs(argv[1], argv[2], "Scheherazadegr.ttf", "udhr_arb.txt", "snd", "urd", 0, 1, false);
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", argv[1], "charis_fast.ttf");
+    failed += test_too_many_runs(gr_make_file_face(path, 0), "charis_fast.ttf");
+#ifndef GRAPHITE2_NSEGCACHE
+    failed += test_too_many_runs(gr_make_file_face_with_seg_cache(path, 1000, 0), "charis_fast.ttf");
+#endif
+    return failed ? 2 : 0;
+}
@@ -59,6 +59,7 @@ fn('gr_face_n_fref', c_uint16, c_void_p)
 fn('gr_face_fref', c_void_p, c_void_p, c_uint16)
 fn('gr_face_n_languages', c_ushort, c_void_p)
 fn('gr_face_lang_by_index', c_uint32, c_void_p, c_uint16)
+fn('gr_make_shared_face', c_void_p, c_void_p)
 fn('gr_face_destroy', None, c_void_p)
 fn('gr_face_n_glyphs', c_ushort, c_void_p)
 fn('gr_face_info', POINTER(FaceInfo), c_void_p)
@@ -86,6 +87,7 @@ fn('gr_cinfo_before', c_int, c_void_p)
 fn('gr_cinfo_base', c_size_t, c_void_p)
 fn('gr_count_unicode_characters', c_size_t, c_int, c_void_p, c_void_p, POINTER(c_void_p))
 fn('gr_make_seg', c_void_p, c_void_p, c_void_p, c_uint32, c_void_p, c_int, c_void_p, c_size_t, c_int)
+fn('gr_make_seg_with_feature_runs', c_void_p, c_void_p, c_void_p, c_uint32, c_void_p, c_void_p, c_size_t, c_int, c_void_p, c_size_t, c_int)
 fn('gr_seg_destroy', None, c_void_p)
 fn('gr_seg_advance_X', c_float, c_void_p)
 fn('gr_seg_advance_Y', c_float, c_void_p)
@@ -95,6 +97,7 @@ fn('gr_seg_n_slots', c_uint, c_void_p)
 fn('gr_seg_first_slot', c_void_p, c_void_p)
 fn('gr_seg_last_slot', c_void_p, c_void_p)
 fn('gr_seg_justify', c_float, c_void_p, c_void_p, c_void_p, c_double, c_int, c_void_p, c_void_p)
+fn('gr_seg_break_lines', c_uint, c_void_p, c_void_p, c_double, c_void_p, c_void_p, c_int, c_int, POINTER(c_void_p), c_uint)
 fn('gr_slot_next_in_segment', c_void_p, c_void_p)
 fn('gr_slot_prev_in_segment', c_void_p, c_void_p)
 fn('gr_slot_attached_to', c_void_p, c_void_p)
@@ -0,0 +1,289 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// usage: linebreaktest fontdir textdir
+// Breaks each line of a text into lines of a fixed width with
+// gr_seg_break_lines, and again the way tests/examples/linebreak.c does, by
+// walking the slots, calling gr_slot_linebreak_before and justifying each line
+// with gr_seg_justify. The line starts and glyph positions must be the same.
+// Also checks justifying a line by stretching its whitespace directly gives
+// what the general justification code does.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <graphite2/Log.h>
+#include <graphite2/Segment.h>
+#include "readfile.h"
+
+namespace
+{
+
+const int max_lines = 256;
+
+int break_weight(const gr_segment * seg, int index)
+{
+    return index >= 0 && unsigned(index) < gr_seg_n_cinfo(seg)
+            ? gr_cinfo_break_weight(gr_seg_cinfo(seg, index)) : 0;
+}
+
+// The weight of a break before s as gr_seg_break_lines sees it: the better of
+// breaking after the previous character and before this one, 0 for none.
+int break_weight_before(const gr_segment * seg, const gr_slot * s)
+{
+    const gr_slot * p = gr_slot_prev_in_segment(s);
+    if (!p || !gr_slot_can_insert_before(s))
+        return 0;
+    const int wafter = break_weight(seg, gr_slot_after(p)),
+              wbefore = -break_weight(seg, gr_slot_before(s));
+    if (wbefore > 0 && (wafter <= 0 || wbefore < wafter))
+        return wbefore;
+    return wafter > 0 ? wafter : 0;
+}
+
+float leading_edge(const gr_slot * s, const gr_face * face, const gr_font * font, bool rtl)
+{
+    return rtl ? -(gr_slot_origin_X(s) + gr_slot_advance_X(s, face, font)) : gr_slot_origin_X(s);
+}
+
+// Break the segment by hand, returning the number of lines.
+int break_by_hand(gr_segment * seg, const gr_face * face, const gr_font * font, float width, bool rtl,
+                  const gr_slot ** starts)
+{
+    const gr_slot * ends[max_lines];
+    int n = 0;
+    const gr_slot * start = gr_seg_first_slot(seg);
+    float lineStart = leading_edge(start, face, font, rtl);
+    starts[n] = start;
+    for (const gr_slot * s = gr_slot_next_in_segment(start); s; s = gr_slot_next_in_segment(s))
+    {
+        if (leading_edge(s, face, font, rtl) - lineStart <= width)
+            continue;
+
+        const gr_slot * b, * fallback = 0;
+        for (b = s; b != start; b = gr_slot_prev_in_segment(b))
+        {
+            const int weight = break_weight_before(seg, b);
+            if (weight > 0 && weight <= gr_breakWord)
+                break;
+            if (!fallback && gr_slot_can_insert_before(b))
+                fallback = b;
+        }
+        if (b == start)
+            b = fallback;
+        if (!b)
+        {
+            for (b = gr_slot_next_in_segment(s); b && !gr_slot_can_insert_before(b); b = gr_slot_next_in_segment(b)) {}
+            if (!b)
+                break;
+        }
+        if (n + 1 == max_lines)
+            return -1;
+        ends[n++] = gr_slot_prev_in_segment(b);
+        gr_slot_linebreak_before(const_cast<gr_slot *>(b));
+        start = s = b;
+        lineStart = leading_edge(start, face, font, rtl);
+        starts[n] = start;
+    }
+    ends[n++] = gr_seg_last_slot(seg);
+    for (int i = 0; i != n; ++i)
+        gr_seg_justify(seg, starts[i], font, width, gr_justCompleteLine, 0, ends[i]);
+    return n;
+}
+
+bool same_line(const gr_slot * s, const gr_slot * t)
+{
+    for (; s && t; s = gr_slot_next_in_segment(s), t = gr_slot_next_in_segment(t))
+        if (gr_slot_gid(s) != gr_slot_gid(t)
+                || gr_slot_origin_X(s) != gr_slot_origin_X(t)
+                || gr_slot_origin_Y(s) != gr_slot_origin_Y(t))
+            return false;
+    return s == t;
+}
+
+int test_breaks(const char * fontdir, const char * textdir, const char * fontname, const char * text,
+                float width, int rtl)
+{
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", fontdir, fontname);
+    gr_face * const face = gr_make_file_face(path, 0);
+    gr_font * const font = face ? gr_make_font(16.f, face) : 0;
+    snprintf(path, sizeof path, "%s/%s", textdir, text);
+    char * const lines = read_file(path);
+    if (!font || !lines)
+    {
+        fprintf(stderr, "failed to load %s or %s\n", fontname, text);
+        free(lines);
+        gr_font_destroy(font);
+        gr_face_destroy(face);
+        return 1;
+    }
+
+    int failed = 0, n = 0, broken = 0;
+    for (char * line = strtok(lines, "\r\n"); line; line = strtok(0, "\r\n"), ++n)
+    {
+        const size_t len = gr_count_unicode_characters(gr_utf8, line, 0, 0);
+        gr_segment * const a = gr_make_seg(font, face, 0, 0, gr_utf8, line, len, rtl),
+                   * const b = gr_make_seg(font, face, 0, 0, gr_utf8, line, len, rtl);
+        if (!a || !b)
+        {
+            gr_seg_destroy(a);
+            gr_seg_destroy(b);
+            continue;
+        }
+
+        const gr_slot * astarts[max_lines], * bstarts[max_lines];
+        const int na = int(gr_seg_break_lines(a, font, width, 0, 0, gr_breakWord, 1, astarts, max_lines)),
+                  nb = break_by_hand(b, face, font, width, rtl != 0, bstarts);
+        bool same = na == nb && na <= max_lines;
+        for (int i = 0; same && i != na; ++i)
+            same = gr_slot_index(astarts[i]) == gr_slot_index(bstarts[i])
+                && same_line(astarts[i], bstarts[i]);
+        if (!same)
+        {
+            fprintf(stderr, "%s line %d: gr_seg_break_lines gives %d lines, breaking by hand gives %d, or they differ\n",
+                    text, n + 1, na, nb);
+            ++failed;
+        }
+        if (na > 1) ++broken;
+        gr_seg_destroy(a);
+        gr_seg_destroy(b);
+    }
+    if (!broken)
+    {
+        fprintf(stderr, "%s: no line was long enough to break\n", text);
+        ++failed;
+    }
+    free(lines);
+    gr_font_destroy(font);
+    gr_face_destroy(face);
+    return failed;
+}
+
+// A font with no justification levels has its lines justified by stretching
+// the whitespace directly, unless the face is logging, which needs the general
+// machinery's trace. So justify each left to right line with and without
+// logging, and check the two ways give the same positions.
+int test_justify_paths(const char * fontdir, const char * textdir, const char * fontname, const char * text)
+{
+    static const char log_path[] = "linebreaktest.json";
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", fontdir, fontname);
+    gr_face * const face = gr_make_file_face(path, 0);
+    gr_font * const font = face ? gr_make_font(16.f, face) : 0;
+    snprintf(path, sizeof path, "%s/%s", textdir, text);
+    char * const lines = read_file(path);
+    if (!font || !lines)
+    {
+        fprintf(stderr, "failed to load %s or %s\n", fontname, text);
+        free(lines);
+        gr_font_destroy(font);
+        gr_face_destroy(face);
+        return 1;
+    }
+    if (!gr_start_logging(face, log_path))
+    {
+        // Tracing is compiled out, so there is only the one way.
+        free(lines);
+        gr_font_destroy(font);
+        gr_face_destroy(face);
+        return 0;
+    }
+    gr_stop_logging(face);
+
+    int failed = 0, n = 0;
+    for (char * line = strtok(lines, "\r\n"); line && n != 50; line = strtok(0, "\r\n"), ++n)
+    {
+        const size_t len = gr_count_unicode_characters(gr_utf8, line, 0, 0);
+        gr_segment * const a = gr_make_seg(font, face, 0, 0, gr_utf8, line, len, 0),
+                   * const b = gr_make_seg(font, face, 0, 0, gr_utf8, line, len, 0);
+        if (!a || !b)
+        {
+            gr_seg_destroy(a);
+            gr_seg_destroy(b);
+            continue;
+        }
+
+        const float width = gr_seg_advance_X(a) * 1.25f;
+        const float wa = gr_seg_justify(a, gr_seg_first_slot(a), font, width, gr_justCompleteLine, 0, 0);
+        gr_start_logging(face, log_path);
+        const float wb = gr_seg_justify(b, gr_seg_first_slot(b), font, width, gr_justCompleteLine, 0, 0);
+        gr_stop_logging(face);
+        if (wa != wb || !same_line(gr_seg_first_slot(a), gr_seg_first_slot(b)))
+        {
+            fprintf(stderr, "%s line %d: justifies to %g wide, or %g with the general code, or they differ\n",
+                    text, n + 1, wa, wb);
+            ++failed;
+        }
+        gr_seg_destroy(a);
+        gr_seg_destroy(b);
+    }
+    remove(log_path);
+    free(lines);
+    gr_font_destroy(font);
+    gr_face_destroy(face);
+    return failed;
+}
+
+// An empty segment is a single line with no slots.
+int test_empty(const char * fontdir, const char * fontname)
+{
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", fontdir, fontname);
+    gr_face * const face = gr_make_file_face(path, 0);
+    gr_font * const font = face ? gr_make_font(16.f, face) : 0;
+    gr_segment * const seg = font ? gr_make_seg(font, face, 0, 0, gr_utf8, "", 0, 0) : 0;
+    const gr_slot * starts[1] = { reinterpret_cast<const gr_slot *>(path) };    // anything but NULL
+    int failed = 0;
+    if (!seg)
+    {
+        fprintf(stderr, "failed to make an empty segment with %s\n", fontname);
+        ++failed;
+    }
+    else if (gr_seg_break_lines(seg, font, 200.f, 0, 0, gr_breakWord, 0, starts, 1) != 1 || starts[0])
+    {
+        fprintf(stderr, "%s: an empty segment does not break into one empty line\n", fontname);
+        ++failed;
+    }
+    gr_seg_destroy(seg);
+    gr_font_destroy(font);
+    gr_face_destroy(face);
+    return failed;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s fontdir textdir\n", argv[0]);
+        return 1;
+    }
+    int failed = 0;
+    failed += test_breaks(argv[1], argv[2], "charis_r_gr.ttf", "udhr_eng.txt", 200.f, 0);
+    failed += test_breaks(argv[1], argv[2], "Annapurnarc2.ttf", "udhr_hin.txt", 200.f, 0);
+    failed += test_breaks(argv[1], argv[2], "Scheherazadegr.ttf", "udhr_arb.txt", 200.f, 1);
+    failed += test_breaks(argv[1], argv[2], "Awami_test.ttf", "awami_tests.txt", 100.f, 1);
+    failed += test_justify_paths(argv[1], argv[2], "charis_fast.ttf", "udhr_eng.txt");
+    failed += test_justify_paths(argv[1], argv[2], "Annapurnarc2.ttf", "udhr_hin.txt");
+    failed += test_empty(argv[1], "charis_r_gr.ttf");
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,146 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// usage: lz4test fontfile.ttf
+// Corrupts the LZ4 compressed Glat table of a font a byte at a time, and
+// checks lz4::check agrees with lz4::decompress about each result, and that
+// a face whose Glat won't decompress fails to load even though Glat is only
+// decompressed as glyphs need it.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <graphite2/Font.h>
+#include "readfile.h"
+#include "inc/Decompressor.h"
+
+namespace
+{
+
+struct font_file
+{
+    unsigned char * data;
+    size_t          size;
+};
+
+unsigned long be32(const unsigned char *p)
+{
+    return (unsigned long)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+const void * get_table(const void * handle, unsigned int tag, size_t * len)
+{
+    const font_file & f = *static_cast<const font_file *>(handle);
+    const unsigned char * const dir = f.data + 12;
+    const unsigned int num_tables = f.data[4] << 8 | f.data[5];
+    for (unsigned int i = 0; i != num_tables; ++i)
+    {
+        const unsigned char * const entry = dir + 16 * i;
+        if (be32(entry) != tag) continue;
+        const unsigned long offset = be32(entry + 8), length = be32(entry + 12);
+        if (offset + length > f.size) return 0;
+        *len = length;
+        return f.data + offset;
+    }
+    return 0;
+}
+
+const gr_face_ops ops = { sizeof(gr_face_ops), get_table, 0, 0 };
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s fontfile.ttf\n", argv[0]);
+        return 1;
+    }
+
+    font_file font = { 0, 0 };
+    font.data = reinterpret_cast<unsigned char *>(read_file(argv[1], &font.size));
+    size_t glat_len = 0;
+    unsigned char * const glat = font.data
+            ? static_cast<unsigned char *>(const_cast<void *>(get_table(&font, 0x476C6174, &glat_len))) : 0;
+    if (!glat || glat_len < 12 || (be32(glat + 4) >> 27) != 1)
+    {
+        fprintf(stderr, "%s has no LZ4 compressed Glat table\n", argv[1]);
+        free(font.data);
+        return 1;
+    }
+
+    unsigned char * const block = glat + 8;
+    const size_t block_len = glat_len - 8,
+                 out_size = be32(glat + 4) & 0x07ffffff;
+    unsigned char * const out = static_cast<unsigned char *>(malloc(out_size));
+    int failed = 0, bad = 0, bad_faces = 0;
+
+    if (lz4::check(block, block_len, out_size) != int(out_size))
+    {
+        fprintf(stderr, "the unchanged Glat table doesn't check\n");
+        ++failed;
+    }
+
+    srand(1);
+    for (int i = 0; i != 2000; ++i)
+    {
+        const size_t at = size_t(rand()) % block_len;
+        const unsigned char was = block[at];
+        block[at] = (unsigned char)rand();
+        const int checked = lz4::check(block, block_len, out_size),
+                  decoded = lz4::decompress(block, block_len, out, out_size);
+        if (checked != decoded)
+        {
+            fprintf(stderr, "byte %u set to %u: check gives %d, decompress %d\n",
+                    unsigned(at), block[at], checked, decoded);
+            ++failed;
+        }
+        // A face only notices a wrong size, so check those fail to load.
+        if (decoded != int(out_size) && bad_faces != 50)
+        {
+            ++bad_faces;
+            gr_face * const face = gr_make_face_with_ops(&font, &ops, gr_face_default);
+            if (face)
+            {
+                fprintf(stderr, "byte %u set to %u: a face with a bad Glat loads\n", unsigned(at), block[at]);
+                ++failed;
+                gr_face_destroy(face);
+            }
+        }
+        bad += decoded != int(out_size);
+        block[at] = was;
+    }
+
+    gr_face * const face = gr_make_face_with_ops(&font, &ops, gr_face_default);
+    if (!face)
+    {
+        fprintf(stderr, "the unchanged font doesn't load\n");
+        ++failed;
+    }
+    gr_face_destroy(face);
+    if (!bad)
+    {
+        fprintf(stderr, "no change made the Glat table fail to decompress\n");
+        ++failed;
+    }
+    free(out);
+    free(font.data);
+    return failed ? 2 : 0;
+}
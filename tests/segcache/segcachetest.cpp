@@ -19,7 +19,9 @@
     Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
     internet at http://www.fsf.org/licenses/lgpl.html.
 */
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
 #include <graphite2/Segment.h>
 #include <graphite2/Log.h>
 #include "inc/Main.h"
@@ -149,6 +151,31 @@ int main(int argc, char ** argv)
         return 3;
     }
     gr_start_logging(api_cast(face), "grsegcache.json");
+    gr_face_memory before;
+    before.size = sizeof before;
+    if (!gr_face_memory_usage(api_cast(face), &before)
+        || before.size != sizeof before
+        || before.glyphs_total != gr_face_n_glyphs(api_cast(face))
+        || before.glyphs_loaded > before.glyphs_total
+        || before.glyphs == 0 || before.passes == 0)
+    {
+        fprintf(stderr, "Bad memory report for the new face\n");
+        return -4;
+    }
+    // A client built before advances was added must only get what it knows of.
+    gr_face_memory older;
+    memset(&older, 0xAB, sizeof older);
+    older.size = offsetof(gr_face_memory, advances);
+    gr_face_memory_usage(api_cast(face), &older);
+    const unsigned char * const tail = reinterpret_cast<unsigned char *>(&older);
+    size_t untouched = older.size;
+    while (untouched != sizeof older && tail[untouched] == 0xAB) ++untouched;
+    if (older.size != offsetof(gr_face_memory, advances) || older.glyphs != before.glyphs
+        || untouched != sizeof older)
+    {
+        fprintf(stderr, "Memory report overran a smaller structure\n");
+        return -4;
+    }
     gr_font *sizedFont = gr_make_font(12, api_cast(face));
     const char * testStrings[] = { "a", "aa", "aaa", "aaab", "aaac", "a b c",
         "aaa ", " aa", "aaaf", "aaad", "aaaa"};
@@ -197,6 +224,15 @@ int main(int argc, char ** argv)
             segCount, accessCount);
         return -2;
     }
+    gr_face_memory after;
+    after.size = sizeof after;
+    gr_face_memory_usage(api_cast(face), &after);
+    if (after.segcache <= before.segcache || after.glyphs_loaded < before.glyphs_loaded)
+    {
+        fprintf(stderr, "Memory report shows the segment cache at %u bytes, up from %u\n",
+            unsigned(after.segcache), unsigned(before.segcache));
+        return -4;
+    }
     gr_font_destroy(sizedFont);
     gr_featureval_destroy(defaultFeatures);
 
@@ -0,0 +1,697 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2016, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// usage: tasktest fontdir textdir
+// Loads faces and shapes text once on the calling thread and once with a
+// gr_face_ops::run_tasks that spreads each batch of tasks over several threads,
+// and checks the results are the same, including the glyphs a face preloads.
+// Also looks characters up in a cached cmap from several threads at once, and
+// shapes through faces shared
+// between threads with gr_make_shared_face.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <pthread.h>
+#include <graphite2/Segment.h>
+#include "readfile.h"
+#include "inc/CmapCache.h"
+#include "inc/Face.h"
+#include "inc/FileFace.h"
+#include "inc/GlyphCache.h"
+#include "inc/GlyphFace.h"
+#include "inc/Silf.h"
+
+using namespace graphite2;
+
+namespace
+{
+
+const int num_threads = 4;
+long tasks_run = 0;     // tasks run on worker threads, to show the executor was used
+
+struct batch
+{
+    gr_task_fn      task;
+    void          * data;
+    size_t          num_tasks;
+    volatile long   next;
+};
+
+void * worker(void * p)
+{
+    batch & b = *static_cast<batch *>(p);
+    for (size_t i; (i = size_t(__sync_fetch_and_add(&b.next, 1))) < b.num_tasks;)
+    {
+        (*b.task)(b.data, i);
+        __sync_fetch_and_add(&tasks_run, 1);
+    }
+    return 0;
+}
+
+void run_tasks(const void *, gr_task_fn task, void * data, size_t num_tasks)
+{
+    batch b = { task, data, num_tasks, 0 };
+    pthread_t threads[num_threads];
+    int n = 0;
+    for (; n != num_threads && pthread_create(threads + n, 0, worker, &b) == 0; ++n) {}
+    worker(&b);
+    while (n) pthread_join(threads[--n], 0);
+}
+
+// A face made from a file whose tables come from FileFace, with or without
+// the threaded executor.
+struct file_face
+{
+    FileFace    file;
+    gr_face   * face;
+
+    file_face(const char * path, unsigned int options, bool threaded)
+    : file(path), face(0)
+    {
+        if (!file) return;
+        gr_face_ops ops = FileFace::ops;
+        if (threaded) ops.run_tasks = run_tasks;
+        face = gr_make_face_with_ops(&file, &ops, options);
+    }
+    ~file_face() { gr_face_destroy(face); }
+};
+
+bool same_positions(gr_segment * a, gr_segment * b)
+{
+    if (!a || !b || gr_seg_n_slots(a) != gr_seg_n_slots(b)
+            || gr_seg_advance_X(a) != gr_seg_advance_X(b))
+        return a == b;
+    for (const gr_slot * s = gr_seg_first_slot(a), * t = gr_seg_first_slot(b); s;
+            s = gr_slot_next_in_segment(s), t = gr_slot_next_in_segment(t))
+        if (gr_slot_gid(s) != gr_slot_gid(t)
+                || gr_slot_origin_X(s) != gr_slot_origin_X(t)
+                || gr_slot_origin_Y(s) != gr_slot_origin_Y(t))
+            return false;
+    return true;
+}
+
+// Shape each line of a text with a serial and a threaded face and compare
+// the positions, which collision avoidance is the part most likely to change.
+int test_collisions(const char * fontdir, const char * textdir, const char * font, const char * text,
+                    unsigned int options, int rtl)
+{
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", fontdir, font);
+    file_face serial(path, options, false),
+              threaded(path, options, true);
+    snprintf(path, sizeof path, "%s/%s", textdir, text);
+    char * const lines = read_file(path);
+    if (!serial.face || !threaded.face || !lines)
+    {
+        fprintf(stderr, "failed to load %s or %s\n", font, text);
+        free(lines);
+        return 1;
+    }
+
+    const long tasks_before = tasks_run;
+    int failed = 0, n = 0;
+    for (char * line = strtok(lines, "\r\n"); line; line = strtok(0, "\r\n"), ++n)
+    {
+        const size_t len = gr_count_unicode_characters(gr_utf8, line, 0, 0);
+        gr_segment * a = gr_make_seg(0, serial.face, 0, 0, gr_utf8, line, len, rtl),
+                   * b = gr_make_seg(0, threaded.face, 0, 0, gr_utf8, line, len, rtl);
+        if (!same_positions(a, b))
+        {
+            fprintf(stderr, "%s line %d: positions differ when collisions are fixed concurrently\n", text, n + 1);
+            ++failed;
+        }
+        gr_seg_destroy(a);
+        gr_seg_destroy(b);
+    }
+    free(lines);
+    if (tasks_run == tasks_before)
+    {
+        fprintf(stderr, "%s: no collision ranges were fixed concurrently\n", text);
+        ++failed;
+    }
+    return failed;
+}
+
+// A font read into memory, so that its tables can be corrupted.
+struct mem_font
+{
+    unsigned char * data;
+    size_t          size;
+};
+
+unsigned long be32(const unsigned char * p)
+{
+    return (unsigned long)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+const void * mem_get_table(const void * handle, unsigned int tag, size_t * len)
+{
+    const mem_font & f = *static_cast<const mem_font *>(handle);
+    if (f.size < 12) return 0;
+    const unsigned int num_tables = f.data[4] << 8 | f.data[5];
+    for (unsigned int i = 0; i != num_tables && 12 + 16 * (i + 1) <= f.size; ++i)
+    {
+        const unsigned char * const entry = f.data + 12 + 16 * i;
+        if (be32(entry) != tag) continue;
+        const unsigned long offset = be32(entry + 8), length = be32(entry + 12);
+        if (offset > f.size || length > f.size - offset) return 0;
+        *len = length;
+        return f.data + offset;
+    }
+    return 0;
+}
+
+unsigned char * mem_table(const mem_font & f, unsigned int tag, size_t & len)
+{
+    len = 0;
+    return static_cast<unsigned char *>(const_cast<void *>(mem_get_table(&f, tag, &len)));
+}
+
+// A face loaded as gr_make_face_with_ops does, but kept if loading fails so
+// that its error can be read.
+struct loaded_face
+{
+    Face  * face;
+    bool    ok;
+
+    loaded_face(const mem_font & font, unsigned int options, bool threaded)
+    : face(0), ok(false)
+    {
+        const gr_face_ops ops = { sizeof(gr_face_ops), mem_get_table, 0, threaded ? run_tasks : 0 };
+        face = new Face(&font, ops);
+        Face::Table silf(*face, Tag::Silf, 0x00050000);
+        ok = silf && face->readGlyphs(options) && face->readFeatures() && face->readGraphite(silf, options);
+    }
+    ~loaded_face() { face->release(); }
+};
+
+bool same_silf(const Silf & a, const Silf & b, unsigned short num_glyphs)
+{
+    if (a.numPasses() != b.numPasses() || a.substitutionPass() != b.substitutionPass()
+            || a.positionPass() != b.positionPass() || a.justificationPass() != b.justificationPass()
+            || a.bidiPass() != b.bidiPass() || a.flags() != b.flags() || a.dir() != b.dir()
+            || a.numJustLevels() != b.numJustLevels() || a.numUser() != b.numUser()
+            || a.aPseudo() != b.aPseudo() || a.aBreak() != b.aBreak() || a.aMirror() != b.aMirror()
+            || a.aPassBits() != b.aPassBits() || a.aBidi() != b.aBidi() || a.aCollision() != b.aCollision()
+            || a.maxCompPerLig() != b.maxCompPerLig() || a.numClasses() != b.numClasses()
+            || a.endLineGlyphid() != b.endLineGlyphid())
+        return false;
+
+    const gr_faceinfo & ia = *a.silfInfo(), & ib = *b.silfInfo();
+    if (ia.extra_ascent != ib.extra_ascent || ia.extra_descent != ib.extra_descent
+            || ia.upem != ib.upem || ia.space_contextuals != ib.space_contextuals
+            || ia.has_bidi_pass != ib.has_bidi_pass || ia.line_ends != ib.line_ends
+            || ia.justifies != ib.justifies)
+        return false;
+
+    gr_face_memory ma, mb;
+    memset(&ma, 0, sizeof ma);
+    memset(&mb, 0, sizeof mb);
+    ma.size = mb.size = sizeof ma;
+    a.memoryUsage(ma);
+    b.memoryUsage(mb);
+    if (ma.classes != mb.classes || ma.passes != mb.passes)
+        return false;
+
+    for (uint16 cid = 0; cid != a.numClasses(); ++cid)
+        for (unsigned int i = 0; i != num_glyphs; ++i)
+            if (a.getClassGlyph(cid, i) != b.getClassGlyph(cid, i))
+                return false;
+    return true;
+}
+
+// Shape the start of every text with both faces, which runs every pass that
+// the text reaches.
+bool same_shaping(const char * textdir, const Face & a, const Face & b, const Silf & silf)
+{
+    static const char * const texts[] = { "udhr_eng.txt", "udhr_arb.txt", "udhr_hin.txt", "udhr_nep.txt",
+                                          "udhr_yor.txt", "awami_tests.txt", "my_HeadwordSyllables.txt" };
+    const int rtl = silf.dir() & 1;
+    bool same = true;
+    for (size_t t = 0; same && t != sizeof texts / sizeof *texts; ++t)
+    {
+        char path[1024];
+        snprintf(path, sizeof path, "%s/%s", textdir, texts[t]);
+        char * const lines = read_file(path);
+        int n = 0;
+        for (char * line = lines ? strtok(lines, "\r\n") : 0; same && line && n != 20; line = strtok(0, "\r\n"), ++n)
+        {
+            const size_t len = gr_count_unicode_characters(gr_utf8, line, 0, 0);
+            gr_segment * const sa = gr_make_seg(0, static_cast<const gr_face *>(&a), 0, 0, gr_utf8, line, len, rtl),
+                       * const sb = gr_make_seg(0, static_cast<const gr_face *>(&b), 0, 0, gr_utf8, line, len, rtl);
+            same = same_positions(sa, sb);
+            gr_seg_destroy(sa);
+            gr_seg_destroy(sb);
+        }
+        free(lines);
+    }
+    return same;
+}
+
+bool read_font(const char * path, mem_font & font)
+{
+    FILE * f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    font.size = size_t(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    font.data = static_cast<unsigned char *>(malloc(font.size));
+    const bool ok = font.data && fread(font.data, 1, font.size, f) == font.size;
+    fclose(f);
+    return ok;
+}
+
+// Load every font in fontdir with and without the executor, which reads the
+// passes of each Silf subtable concurrently. The Silf data must be the same,
+// and so must the error when a byte of the Silf table is corrupted.
+int test_silf_loads(const char * fontdir, const char * textdir)
+{
+    DIR * const dir = opendir(fontdir);
+    if (!dir)
+    {
+        fprintf(stderr, "can't read %s\n", fontdir);
+        return 1;
+    }
+    const long tasks_before = tasks_run;
+    int failed = 0, corrupt_fails = 0;
+    for (const dirent * ent; (ent = readdir(dir)) != 0;)
+    {
+        const size_t nlen = strlen(ent->d_name);
+        if (nlen < 4 || strcmp(ent->d_name + nlen - 4, ".ttf")) continue;
+        char path[1024];
+        snprintf(path, sizeof path, "%s/%s", fontdir, ent->d_name);
+        mem_font font = { 0, 0 };
+        if (!read_font(path, font))
+        {
+            fprintf(stderr, "failed to read %s\n", ent->d_name);
+            free(font.data);
+            ++failed;
+            continue;
+        }
+
+        {
+            loaded_face serial(font, gr_face_default, false),
+                        threaded(font, gr_face_default, true);
+            if (serial.ok != threaded.ok || serial.face->error() != threaded.face->error()
+                    || serial.face->error_context() != threaded.face->error_context())
+            {
+                fprintf(stderr, "%s: loads with error %u:%x, threaded with %u:%x\n", ent->d_name,
+                        serial.face->error(), serial.face->error_context(),
+                        threaded.face->error(), threaded.face->error_context());
+                ++failed;
+            }
+            else if (serial.ok)
+            {
+                const Silf & a = *serial.face->chooseSilf(0), & b = *threaded.face->chooseSilf(0);
+                if (!same_silf(a, b, serial.face->glyphs().numGlyphs()))
+                {
+                    fprintf(stderr, "%s: Silf differs when loaded threaded\n", ent->d_name);
+                    ++failed;
+                }
+                else if (!same_shaping(textdir, *serial.face, *threaded.face, a))
+                {
+                    fprintf(stderr, "%s: shapes differently when loaded threaded\n", ent->d_name);
+                    ++failed;
+                }
+            }
+        }
+
+        size_t silf_len = 0;
+        unsigned char * const silf = mem_table(font, 0x53696C66, silf_len);
+        srand(1);
+        for (int i = 0; silf && i != 40; ++i)
+        {
+            const size_t at = size_t(rand()) % silf_len;
+            const unsigned char was = silf[at];
+            silf[at] = (unsigned char)rand();
+            loaded_face serial(font, gr_face_default, false),
+                        threaded(font, gr_face_default, true);
+            if (serial.ok != threaded.ok || serial.face->error() != threaded.face->error()
+                    || serial.face->error_context() != threaded.face->error_context())
+            {
+                fprintf(stderr, "%s: with Silf byte %u set to %u loads with error %u:%x, threaded with %u:%x\n",
+                        ent->d_name, unsigned(at), silf[at],
+                        serial.face->error(), serial.face->error_context(),
+                        threaded.face->error(), threaded.face->error_context());
+                ++failed;
+            }
+            corrupt_fails += !serial.ok;
+            silf[at] = was;
+        }
+        free(font.data);
+    }
+    closedir(dir);
+    if (tasks_run == tasks_before)
+    {
+        fprintf(stderr, "no passes were read concurrently\n");
+        ++failed;
+    }
+    if (!corrupt_fails)
+    {
+        fprintf(stderr, "no corrupt Silf table failed to load\n");
+        ++failed;
+    }
+    return failed;
+}
+
+bool same_rect(const Rect & a, const Rect & b)
+{
+    return a.bl.x == b.bl.x && a.bl.y == b.bl.y && a.tr.x == b.tr.x && a.tr.y == b.tr.y;
+}
+
+bool same_glyphs(const GlyphCache & a, const GlyphCache & b)
+{
+    if (a.numGlyphs() != b.numGlyphs() || a.numAttrs() != b.numAttrs()
+            || a.unitsPerEm() != b.unitsPerEm() || a.hasBoxes() != b.hasBoxes())
+        return false;
+    for (unsigned short gid = 0; gid != a.numGlyphs(); ++gid)
+    {
+        const GlyphFace & ga = *a.glyph(gid), & gb = *b.glyph(gid);
+        if (ga.theAdvance().x != gb.theAdvance().x || ga.theAdvance().y != gb.theAdvance().y
+                || !same_rect(ga.theBBox(), gb.theBBox()))
+            return false;
+        for (unsigned short attr = 0; attr != a.numAttrs(); ++attr)
+            if (a.glyphAttr(gid, attr) != b.glyphAttr(gid, attr))
+                return false;
+        if (!a.hasBoxes())
+            continue;
+        if (a.numSubBounds(gid) != b.numSubBounds(gid) || !same_rect(a.slant(gid), b.slant(gid)))
+            return false;
+        for (uint8 sub = 0; sub != a.numSubBounds(gid); ++sub)
+            for (uint8 metric = 0; metric != 8; ++metric)
+                if (a.getSubBoundingMetric(gid, sub, metric) != b.getSubBoundingMetric(gid, sub, metric))
+                    return false;
+    }
+    return true;
+}
+
+// Preload the glyphs of every font in fontdir with and without the executor,
+// which reads runs of glyphs and their boxes concurrently. The glyphs must be
+// the same as each other and as those loaded lazily, and so must the error
+// when a byte of Glat, Gloc or glyf is corrupted.
+int test_glyph_loads(const char * fontdir)
+{
+    static const unsigned int tables[] = { 0x476C6174, 0x476C6F63, 0x676C7966 };
+    DIR * const dir = opendir(fontdir);
+    if (!dir)
+    {
+        fprintf(stderr, "can't read %s\n", fontdir);
+        return 1;
+    }
+    const long tasks_before = tasks_run;
+    int failed = 0, corrupt_fails = 0;
+    for (const dirent * ent; (ent = readdir(dir)) != 0;)
+    {
+        const size_t nlen = strlen(ent->d_name);
+        if (nlen < 4 || strcmp(ent->d_name + nlen - 4, ".ttf")) continue;
+        char path[1024];
+        snprintf(path, sizeof path, "%s/%s", fontdir, ent->d_name);
+        mem_font font = { 0, 0 };
+        if (!read_font(path, font))
+        {
+            fprintf(stderr, "failed to read %s\n", ent->d_name);
+            free(font.data);
+            ++failed;
+            continue;
+        }
+
+        {
+            loaded_face serial(font, gr_face_preloadGlyphs, false),
+                        threaded(font, gr_face_preloadGlyphs, true);
+            if (serial.ok != threaded.ok || serial.face->error() != threaded.face->error()
+                    || serial.face->error_context() != threaded.face->error_context())
+            {
+                fprintf(stderr, "%s: preloads with error %u:%x, threaded with %u:%x\n", ent->d_name,
+                        serial.face->error(), serial.face->error_context(),
+                        threaded.face->error(), threaded.face->error_context());
+                ++failed;
+            }
+            else if (serial.ok && !same_glyphs(serial.face->glyphs(), threaded.face->glyphs()))
+            {
+                fprintf(stderr, "%s: glyphs differ when preloaded threaded\n", ent->d_name);
+                ++failed;
+            }
+
+            // A preload reads its own way, so check it against reading each
+            // glyph as it is first asked for.
+            loaded_face lazy(font, gr_face_default, false);
+            if (serial.ok && (!lazy.ok || !same_glyphs(serial.face->glyphs(), lazy.face->glyphs())))
+            {
+                fprintf(stderr, "%s: glyphs differ when preloaded\n", ent->d_name);
+                ++failed;
+            }
+        }
+
+        srand(1);
+        for (size_t t = 0; t != sizeof tables / sizeof *tables; ++t)
+        {
+            size_t len = 0;
+            unsigned char * const table = mem_table(font, tables[t], len);
+            for (int i = 0; table && len && i != 20; ++i)
+            {
+                const size_t at = size_t(rand()) % len;
+                const unsigned char was = table[at];
+                table[at] = (unsigned char)rand();
+                loaded_face serial(font, gr_face_preloadGlyphs, false),
+                            threaded(font, gr_face_preloadGlyphs, true);
+                if (serial.ok != threaded.ok || serial.face->error() != threaded.face->error()
+                        || serial.face->error_context() != threaded.face->error_context())
+                {
+                    fprintf(stderr, "%s: with byte %u of table %x set to %u preloads with error %u:%x, threaded with %u:%x\n",
+                            ent->d_name, unsigned(at), tables[t], table[at],
+                            serial.face->error(), serial.face->error_context(),
+                            threaded.face->error(), threaded.face->error_context());
+                    ++failed;
+                }
+                else if (serial.ok && !same_glyphs(serial.face->glyphs(), threaded.face->glyphs()))
+                {
+                    fprintf(stderr, "%s: with byte %u of table %x set to %u glyphs differ when preloaded threaded\n",
+                            ent->d_name, unsigned(at), tables[t], table[at]);
+                    ++failed;
+                }
+                corrupt_fails += !serial.ok;
+                table[at] = was;
+            }
+        }
+        free(font.data);
+    }
+    closedir(dir);
+    if (tasks_run == tasks_before)
+    {
+        fprintf(stderr, "no glyphs were preloaded concurrently\n");
+        ++failed;
+    }
+    if (!corrupt_fails)
+    {
+        fprintf(stderr, "no corrupt glyph table failed to load\n");
+        ++failed;
+    }
+    return failed;
+}
+
+struct sharing
+{
+    const gr_face * base;
+    char         ** lines;
+    gr_segment   ** expected;
+    size_t          num_lines;
+    volatile long   next,
+                    failed;
+};
+
+// Each thread starts at a different line and wraps round, so that threads
+// read glyphs while others are reading them too.
+void * shape_shared(void * p)
+{
+    sharing & sh = *static_cast<sharing *>(p);
+    const size_t start = size_t(__sync_fetch_and_add(&sh.next, 1)) * sh.num_lines / (num_threads + 1);
+    for (size_t i = 0; i != sh.num_lines; ++i)
+    {
+        const size_t l = (start + i) % sh.num_lines;
+        const size_t len = gr_count_unicode_characters(gr_utf8, sh.lines[l], 0, 0);
+        gr_face * const face = gr_make_shared_face(sh.base);
+        gr_segment * const seg = face ? gr_make_seg(0, face, 0, 0, gr_utf8, sh.lines[l], len, 1) : 0;
+        if (!same_positions(seg, sh.expected[l]) || !seg)
+            __sync_fetch_and_add(&sh.failed, 1);
+        gr_seg_destroy(seg);
+        gr_face_destroy(face);
+    }
+    return 0;
+}
+
+// Make, use and destroy faces sharing one face's data on several threads at
+// once, then check a shared face still shapes once the original is gone. With
+// glyphs or rules loaded lazily the threads also race to read them.
+int test_shared_faces(const char * fontdir, const char * textdir, const char * font, const char * text,
+                      unsigned int options)
+{
+    char fontpath[1024], path[1024];
+    snprintf(fontpath, sizeof fontpath, "%s/%s", fontdir, font);
+    gr_face * const base = gr_make_file_face(fontpath, options),
+            * const reference = gr_make_file_face(fontpath, gr_face_default);
+    snprintf(path, sizeof path, "%s/%s", textdir, text);
+    char * const text_data = read_file(path);
+    size_t num_lines = 0;
+    for (const char * c = text_data; c && *c; ++c)
+        num_lines += *c == '\n';
+    char ** const lines = static_cast<char **>(calloc(num_lines + 1, sizeof(char *)));
+    gr_segment ** const expected = static_cast<gr_segment **>(calloc(num_lines + 1, sizeof(gr_segment *)));
+    num_lines = 0;
+    for (char * line = lines && text_data ? strtok(text_data, "\r\n") : 0; line; line = strtok(0, "\r\n"))
+        lines[num_lines++] = line;
+    if (!base || !reference || !num_lines || !expected)
+    {
+        fprintf(stderr, "failed to load %s or %s\n", font, text);
+        free(expected);
+        free(lines);
+        free(text_data);
+        gr_face_destroy(base);
+        gr_face_destroy(reference);
+        return 1;
+    }
+
+    for (size_t l = 0; l != num_lines; ++l)
+        expected[l] = gr_make_seg(0, reference, 0, 0, gr_utf8, lines[l],
+                                  gr_count_unicode_characters(gr_utf8, lines[l], 0, 0), 1);
+    sharing sh = { base, lines, expected, num_lines, 0, 0 };
+    pthread_t threads[num_threads];
+    int n = 0;
+    for (; n != num_threads && pthread_create(threads + n, 0, shape_shared, &sh) == 0; ++n) {}
+    shape_shared(&sh);
+    while (n) pthread_join(threads[--n], 0);
+
+    int failed = 0;
+    if (sh.failed)
+    {
+        fprintf(stderr, "%s: %ld segments shaped through shared faces differ\n", font, sh.failed);
+        ++failed;
+    }
+
+    const size_t len = gr_count_unicode_characters(gr_utf8, lines[0], 0, 0);
+    gr_face * const shared = gr_make_shared_face(base);
+    gr_face_destroy(base);
+    gr_segment * const seg = shared ? gr_make_seg(0, shared, 0, 0, gr_utf8, lines[0], len, 1) : 0;
+    if (!seg || !same_positions(seg, expected[0]))
+    {
+        fprintf(stderr, "%s: a shared face shapes differently once its base face is destroyed\n", font);
+        ++failed;
+    }
+    gr_seg_destroy(seg);
+    for (size_t l = 0; l != num_lines; ++l)
+        gr_seg_destroy(expected[l]);
+    gr_face_destroy(shared);
+    gr_face_destroy(reference);
+    free(expected);
+    free(lines);
+    free(text_data);
+    return failed;
+}
+
+
+struct cmap_lookups
+{
+    const Cmap    * cmap;
+    const uint16  * expected;
+    volatile long   next,
+                    failed;
+};
+
+// Each thread starts at a different block and wraps round, so that threads
+// build pages while others read them.
+void * lookup_cached(void * p)
+{
+    cmap_lookups & l = *static_cast<cmap_lookups *>(p);
+    const uint32 start = uint32(__sync_fetch_and_add(&l.next, 1)) * 0x1100 / (num_threads + 1);
+    for (uint32 b = 0; b != 0x1100; ++b)
+    {
+        const uint32 base = ((start + b) % 0x1100) << 8;
+        for (uint32 u = base; u != base + 0x100; ++u)
+            if ((*l.cmap)[u] != l.expected[u])
+                __sync_fetch_and_add(&l.failed, 1);
+    }
+    return 0;
+}
+
+// A cached cmap builds its pages as characters are first looked up, so check
+// pages built by several threads at once map as those built on one thread.
+int test_cached_cmap(const char * fontdir, const char * font)
+{
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", fontdir, font);
+    gr_face * const reference = gr_make_file_face(path, gr_face_cacheCmap),
+            * const face = gr_make_file_face(path, gr_face_cacheCmap);
+    uint16 * const expected = static_cast<uint16 *>(malloc(0x110000 * sizeof(uint16)));
+    if (!reference || !face || !expected)
+    {
+        fprintf(stderr, "failed to load %s\n", font);
+        free(expected);
+        gr_face_destroy(face);
+        gr_face_destroy(reference);
+        return 1;
+    }
+    for (uint32 u = 0; u != 0x110000; ++u)
+        expected[u] = reference->cmap()[u];
+
+    cmap_lookups l = { &face->cmap(), expected, 0, 0 };
+    pthread_t threads[num_threads];
+    int n = 0;
+    for (; n != num_threads && pthread_create(threads + n, 0, lookup_cached, &l) == 0; ++n) {}
+    lookup_cached(&l);
+    while (n) pthread_join(threads[--n], 0);
+
+    int failed = 0;
+    if (l.failed)
+    {
+        fprintf(stderr, "%s: %ld characters map differently when cached from several threads\n", font, l.failed);
+        ++failed;
+    }
+    free(expected);
+    gr_face_destroy(face);
+    gr_face_destroy(reference);
+    return failed;
+}
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s fontdir textdir\n", argv[0]);
+        return 1;
+    }
+    int failed = 0;
+    // Glyphs loaded lazily are read before the ranges are handed out.
+    failed += test_collisions(argv[1], argv[2], "Awami_test.ttf", "awami_tests.txt", gr_face_default, 1);
+    failed += test_collisions(argv[1], argv[2], "Awami_test.ttf", "awami_tests.txt", gr_face_preloadAll, 1);
+    failed += test_collisions(argv[1], argv[2], "Awami_compressed_test.ttf", "awami_tests.txt", gr_face_default, 1);
+    failed += test_silf_loads(argv[1], argv[2]);
+    failed += test_glyph_loads(argv[1]);
+    failed += test_cached_cmap(argv[1], "charis_r_gr.ttf");
+    failed += test_cached_cmap(argv[1], "Scheherazadegr.ttf");
+    // Without a preload the threads race to read each glyph, and to decompress
+    // Glat in the compressed font.
+    failed += test_shared_faces(argv[1], argv[2], "Awami_test.ttf", "awami_tests.txt", gr_face_default);
+    failed += test_shared_faces(argv[1], argv[2], "Awami_compressed_test.ttf", "awami_tests.txt", gr_face_default);
+    failed += test_shared_faces(argv[1], argv[2], "Awami_test.ttf", "awami_tests.txt", gr_face_preloadGlyphs);
+    failed += test_shared_faces(argv[1], argv[2], "Awami_test.ttf", "awami_tests.txt", gr_face_preloadGlyphs | gr_face_lazyRules);
+    return failed ? 2 : 0;
+}
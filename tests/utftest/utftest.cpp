@@ -1,5 +1,10 @@
 #include <graphite2/Segment.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inc/UtfCodec.h"
+
+using graphite2::uchar_t;
 
 struct test8
 {
@@ -42,6 +47,146 @@ struct test16 tests16[] = {
 
 const int numtests16 = sizeof(tests16)/sizeof(test16);
 
+// Decode text with utf<C>::decode in blocks of random size, as Segment does,
+// and one character at a time with the iterator. Each start offset up to a
+// word moves the word sized fast paths across the text, so that they meet
+// surrogate pairs and multibyte sequences straddling a word boundary.
+template <typename C>
+int test_decode(const char * name, const C * text, size_t len)
+{
+    typedef typename graphite2::utf<C>::const_iterator iterator;
+    uchar_t usvs[1024], dusvs[1024];
+    size_t offsets[1024], doffsets[1024];
+    for (size_t start = 0; start != 2 * sizeof(size_t); ++start)
+    {
+        const C * const base = text + start;
+        size_t n = 0;
+        iterator i = base;
+        for (const iterator e = text + len; i != e && n != 1024; ++i, ++n)
+        {
+            usvs[n] = *i;
+            offsets[n] = static_cast<const C *>(i) - base;
+        }
+
+        const C * cp = base;
+        for (size_t done = 0, block; done != n; done += block)
+        {
+            block = 1 + size_t(rand()) % 70;
+            if (block > n - done) block = n - done;
+            graphite2::utf<C>::decode(cp, base, dusvs + done, doffsets + done, block);
+        }
+        for (size_t k = 0; k != n; ++k)
+        {
+            if (usvs[k] != dusvs[k] || offsets[k] != doffsets[k])
+            {
+                fprintf(stderr, "decode %s: from %u character %u is U+%04X at %u, the iterator gives U+%04X at %u\n",
+                        name, unsigned(start), unsigned(k), dusvs[k], unsigned(doffsets[k]),
+                        usvs[k], unsigned(offsets[k]));
+                return 1;
+            }
+        }
+        if (cp != static_cast<const C *>(i))
+        {
+            fprintf(stderr, "decode %s: from %u stops at the wrong code unit\n", name, unsigned(start));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Pieces of text the random texts are made from: mostly runs of the common
+// case, with valid multi code unit characters and malformed sequences mixed in.
+uchar_t random_usv()
+{
+    switch (rand() % 8)
+    {
+    case 0:  return 0x80 + rand() % 0x780;
+    case 1:  return 0x800 + rand() % 0xD000;
+    case 2:  return 0x10000 + rand() % 0x100000;
+    default: return 0x20 + rand() % 0x60;
+    }
+}
+
+size_t random_utf8(unsigned char * s, size_t len)
+{
+    size_t n = 0;
+    while (n + 4 <= len)
+    {
+        graphite2::int8 l;
+        if (rand() % 16)
+            graphite2::_utf_codec<8>::put(s + n, random_usv(), l);
+        else
+        {
+            // a stray or truncated byte sequence, or one that is too long
+            l = 1 + rand() % 3;
+            for (int k = 0; k != l; ++k)
+                s[n + k] = (unsigned char)(0x80 + rand() % 0x80);
+        }
+        n += l;
+    }
+    return n;
+}
+
+size_t random_utf16(unsigned short * s, size_t len)
+{
+    size_t n = 0;
+    while (n + 2 <= len)
+    {
+        graphite2::int8 l = 1;
+        switch (rand() % 16)
+        {
+        case 0:  s[n] = (unsigned short)(0xD800 + rand() % 0x800); break;  // a lone surrogate
+        case 1:  s[n] = (unsigned short)(0xDC00 + rand() % 0x400);
+                 s[n + 1] = (unsigned short)(0xD800 + rand() % 0x400); l = 2; break; // swapped pair
+        default: graphite2::_utf_codec<16>::put(s + n, random_usv(), l); break;
+        }
+        n += l;
+    }
+    return n;
+}
+
+size_t random_utf32(unsigned int * s, size_t len)
+{
+    for (size_t n = 0; n != len; ++n)
+        s[n] = rand() % 16 ? random_usv() : 0x110000 + rand();
+    return len;
+}
+
+int test_decodes()
+{
+    // Leave room after the text for the code units a malformed character
+    // at its end may read.
+    unsigned char text8[1000];
+    unsigned short text16[1000];
+    unsigned int text32[1000];
+    srand(1);
+    for (int i = 0; i != 200; ++i)
+    {
+        memset(text8, 0, sizeof text8);
+        memset(text16, 0, sizeof text16);
+        const size_t len8 = random_utf8(text8, sizeof text8 / sizeof *text8 - 8),
+                     len16 = random_utf16(text16, sizeof text16 / sizeof *text16 - 8),
+                     len32 = random_utf32(text32, sizeof text32 / sizeof *text32 - 8);
+        if (test_decode("UTF-8", text8, len8)
+                || test_decode("UTF-16", text16, len16)
+                || test_decode("UTF-32", text32, len32))
+            return 1;
+    }
+
+    // Surrogate pairs starting at every code unit of a word.
+    for (size_t at = 0; at != 2 * sizeof(size_t); ++at)
+    {
+        memset(text16, 0, sizeof text16);
+        for (size_t k = 0; k != 64; ++k) text16[k] = 0x61;
+        text16[at] = 0xD83D; text16[at + 1] = 0xDE00;
+        text16[at + 8] = 0xDBFF;                    // a lead surrogate with no trail
+        text16[at + 20] = 0xDC00;                   // a trail surrogate with no lead
+        if (test_decode("UTF-16", text16, 64))
+            return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char * argv[]) {
     int i;
     const void * error;
@@ -101,5 +246,5 @@ int main(int argc, char * argv[]) {
             return (i+1);
         }
     }
-    return 0;
+    return test_decodes() ? 100 : 0;
 }